@@ -0,0 +1,448 @@
+#ifndef EARLEY_H
+#define EARLEY_H
+
+/*
+ * Earley recognizer over a grammar.h grammar (task6), for grammars that
+ * are ambiguous or not LL(k) at all.
+ *
+ * A dotted rule is one integer: production p with the dot before symbol d
+ * is LR(0) item prod_item[p] + d, so an Earley item is that integer plus
+ * its origin set. All sets live back to back in one item array. While a
+ * set is built, a hash of (item, origin) rejects duplicates. Slots are
+ * stamped with a running set number, so the hash is never cleared.
+ *
+ * Prediction uses the nullable flags from first_follow.h: predicting a
+ * nullable B also moves the dot over B at once (Aycock and Horspool), so
+ * completions never have to look back into the set being built. Once a
+ * set is done its items are indexed by the nonterminal after the dot.
+ *
+ * Leo's optimization: when exactly one item of set j waits for A, and A is
+ * its last symbol, completing A from j only leads to completing that
+ * item's left-hand side in turn. Such chains are followed once, memoized
+ * per (set, nonterminal), and only the item at the top is added. Right
+ * recursion then costs a constant number of items per token instead of
+ * one per level of nesting.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "grammar.h"
+
+typedef struct {
+	int32_t item;
+	int32_t origin;
+} EarleyItem;
+
+/* The items of one set that wait for nonterminal nt, and its Leo memo. */
+typedef struct {
+	int nt;
+	int first;
+	int count;
+	int leo;
+	EarleyItem top;
+} EarleyWait;
+
+enum {
+	EARLEY_LEO_UNKNOWN,
+	EARLEY_LEO_NONE,
+	EARLEY_LEO_TOP
+};
+
+typedef struct {
+	const Grammar *g;
+	const bool *nullable;
+	int start;
+	bool use_leo;
+
+	/* LR(0) items: production and symbol after the dot (-1 when complete). */
+	int item_count;
+	int *prod_item;
+	int *item_prod;
+	int32_t *item_next;
+
+	/* Set i is items[set_start[i] .. set_start[i + 1]). */
+	EarleyItem *items;
+	int count;
+	int cap;
+	int *set_start;
+	int set_cap;
+	int sets;
+
+	/* Items scanned into the next set; they are distinct by construction. */
+	EarleyItem *scan;
+	int scan_count;
+	int scan_cap;
+
+	/* Dedupe hash: slot i holds an index into items when stamp[i] is epoch + sets. */
+	int *slot;
+	int *stamp;
+	int slot_cap;
+	int epoch;
+
+	/* Waiting items, grouped per set by nonterminal: set i owns waits[wait_start[i] .. wait_start[i + 1]). */
+	EarleyWait *waits;
+	int wait_count;
+	int wait_cap;
+	int *wait_start;
+	int wait_start_cap;
+	int *wait_items;
+	int wait_item_count;
+	int wait_item_cap;
+
+	int *predicted;
+	EarleyWait **chain;
+	int chain_cap;
+
+	int error_pos;
+	long leo_tops;
+} EarleyParser;
+
+static inline void earley_free(EarleyParser *ep) {
+	free(ep->prod_item);
+	free(ep->item_prod);
+	free(ep->item_next);
+	free(ep->items);
+	free(ep->set_start);
+	free(ep->scan);
+	free(ep->slot);
+	free(ep->stamp);
+	free(ep->waits);
+	free(ep->wait_start);
+	free(ep->wait_items);
+	free(ep->predicted);
+	free(ep->chain);
+	memset(ep, 0, sizeof(*ep));
+}
+
+/* Number the LR(0) items of g. g must stay unchanged (and indexed) while ep is used. */
+static inline bool earley_init(EarleyParser *ep, const Grammar *g, const bool *nullable, int start) {
+	memset(ep, 0, sizeof(*ep));
+	ep->g = g;
+	ep->nullable = nullable;
+	ep->start = start;
+	ep->use_leo = true;
+	ep->item_count = g->prod_off[g->prod_count] + g->prod_count;
+	ep->prod_item = malloc(sizeof(int) * (size_t)(g->prod_count + 1));
+	ep->item_prod = malloc(sizeof(int) * (size_t)ep->item_count);
+	ep->item_next = malloc(sizeof(int32_t) * (size_t)ep->item_count);
+	ep->predicted = calloc((size_t)(g->nt_count > 0 ? g->nt_count : 1), sizeof(int));
+	if (!ep->prod_item || !ep->item_prod || !ep->item_next || !ep->predicted) {
+		earley_free(ep);
+		return false;
+	}
+	int item = 0;
+	for (int p = 0; p < g->prod_count; p++) {
+		const Sym *rhs = gram_rhs(g, p);
+		int len = gram_rhs_len(g, p);
+		ep->prod_item[p] = item;
+		for (int d = 0; d <= len; d++, item++) {
+			ep->item_prod[item] = p;
+			ep->item_next[item] = d < len ? (int32_t)rhs[d] : -1;
+		}
+	}
+	ep->prod_item[g->prod_count] = item;
+	return true;
+}
+
+static inline size_t earley_hash(EarleyItem x, int cap) {
+	uint64_t h = ((uint64_t)(uint32_t)x.item << 32 | (uint32_t)x.origin) * 0x9e3779b97f4a7c15ull;
+	return (size_t)(h >> 32) & (size_t)(cap - 1);
+}
+
+/* Find x in the current set; returns its slot, which is free when x is absent. */
+static inline size_t earley_slot(const EarleyParser *ep, EarleyItem x) {
+	int stamp = ep->epoch + ep->sets;
+	size_t i = earley_hash(x, ep->slot_cap);
+	while (ep->stamp[i] == stamp) {
+		EarleyItem y = ep->items[ep->slot[i]];
+		if (y.item == x.item && y.origin == x.origin) {
+			break;
+		}
+		i = (i + 1) & (size_t)(ep->slot_cap - 1);
+	}
+	return i;
+}
+
+/* Double the hash and re-enter the items of the current set. */
+static inline bool earley_rehash(EarleyParser *ep) {
+	int cap = ep->slot_cap > 0 ? ep->slot_cap * 2 : 256;
+	int *slot = malloc(sizeof(int) * (size_t)cap);
+	int *stamp = calloc((size_t)cap, sizeof(int));
+	if (!slot || !stamp) {
+		free(slot);
+		free(stamp);
+		return false;
+	}
+	free(ep->slot);
+	free(ep->stamp);
+	ep->slot = slot;
+	ep->stamp = stamp;
+	ep->slot_cap = cap;
+	for (int k = ep->set_start[ep->sets - 1]; k < ep->count; k++) {
+		size_t i = earley_slot(ep, ep->items[k]);
+		ep->slot[i] = k;
+		ep->stamp[i] = ep->epoch + ep->sets;
+	}
+	return true;
+}
+
+/* Add x to the current set unless it is there already. */
+static inline bool earley_add(EarleyParser *ep, int item, int origin) {
+	EarleyItem x = { item, origin };
+	int size = ep->count - ep->set_start[ep->sets - 1];
+	if (2 * (size + 1) > ep->slot_cap && !earley_rehash(ep)) {
+		return false;
+	}
+	size_t i = earley_slot(ep, x);
+	if (ep->stamp[i] == ep->epoch + ep->sets) {
+		return true;
+	}
+	EarleyItem *grown = gram_grow(ep->items, &ep->cap, ep->count + 1, sizeof(EarleyItem));
+	if (!grown) {
+		return false;
+	}
+	ep->items = grown;
+	ep->items[ep->count] = x;
+	ep->slot[i] = ep->count++;
+	ep->stamp[i] = ep->epoch + ep->sets;
+	return true;
+}
+
+/* Open set number ep->sets, seeded with the items scanned out of the previous one. */
+static inline bool earley_open_set(EarleyParser *ep) {
+	int *grown = gram_grow(ep->set_start, &ep->set_cap, ep->sets + 2, sizeof(int));
+	if (!grown) {
+		return false;
+	}
+	ep->set_start = grown;
+	ep->set_start[ep->sets++] = ep->count;
+	bool ok = true;
+	for (int k = 0; k < ep->scan_count && ok; k++) {
+		ok = earley_add(ep, ep->scan[k].item, ep->scan[k].origin);
+	}
+	ep->scan_count = 0;
+	return ok;
+}
+
+static inline int earley_cmp_wait(const void *a, const void *b) {
+	const int *x = a;
+	const int *y = b;
+	return x[0] != y[0] ? (x[0] < y[0] ? -1 : 1) : (x[1] < y[1] ? -1 : x[1] > y[1]);
+}
+
+/* Group the finished set's items by the nonterminal after their dot. */
+static inline bool earley_close_set(EarleyParser *ep) {
+	int set = ep->sets - 1;
+	int from = ep->set_start[set];
+	ep->set_start[ep->sets] = ep->count;
+	int *starts = gram_grow(ep->wait_start, &ep->wait_start_cap, ep->sets + 1, sizeof(int));
+	if (!starts) {
+		return false;
+	}
+	ep->wait_start = starts;
+	ep->wait_start[set] = ep->wait_count;
+
+	/* (nonterminal, item index) pairs, sorted in place at the end of wait_items. */
+	int n = 0;
+	for (int k = from; k < ep->count; k++) {
+		int32_t next = ep->item_next[ep->items[k].item];
+		n += next >= 0 && !gram_is_term((Sym)next);
+	}
+	int *grown = gram_grow(ep->wait_items, &ep->wait_item_cap, ep->wait_item_count + 3 * n, sizeof(int));
+	EarleyWait *waits = gram_grow(ep->waits, &ep->wait_cap, ep->wait_count + n, sizeof(EarleyWait));
+	if (!grown || !waits) {
+		if (grown) {
+			ep->wait_items = grown;
+		}
+		if (waits) {
+			ep->waits = waits;
+		}
+		return false;
+	}
+	ep->wait_items = grown;
+	ep->waits = waits;
+	int *pairs = ep->wait_items + ep->wait_item_count + n;
+	int m = 0;
+	for (int k = from; k < ep->count; k++) {
+		int32_t next = ep->item_next[ep->items[k].item];
+		if (next >= 0 && !gram_is_term((Sym)next)) {
+			pairs[2 * m] = next;
+			pairs[2 * m + 1] = k;
+			m++;
+		}
+	}
+	qsort(pairs, (size_t)n, 2 * sizeof(int), earley_cmp_wait);
+	for (int i = 0; i < n; i++) {
+		int *out = ep->wait_items + ep->wait_item_count;
+		if (i == 0 || pairs[2 * i] != pairs[2 * (i - 1)]) {
+			EarleyWait *w = &ep->waits[ep->wait_count++];
+			w->nt = pairs[2 * i];
+			w->first = ep->wait_item_count;
+			w->count = 0;
+			w->leo = EARLEY_LEO_UNKNOWN;
+		}
+		*out = pairs[2 * i + 1];
+		ep->wait_item_count++;
+		ep->waits[ep->wait_count - 1].count++;
+	}
+	ep->wait_start[set + 1] = ep->wait_count;
+	return true;
+}
+
+static inline EarleyWait *earley_waiting(const EarleyParser *ep, int set, int nt) {
+	int lo = ep->wait_start[set];
+	int hi = ep->wait_start[set + 1];
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (ep->waits[mid].nt < nt) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo < ep->wait_start[set + 1] && ep->waits[lo].nt == nt ? &ep->waits[lo] : NULL;
+}
+
+/*
+ * Leo's topmost item for completing nt from set, or NULL. The chain is
+ * walked iteratively, since right recursion can make it as long as the
+ * input, and every entry on it is given the same top. The start symbol
+ * in set 0 never gets one, so a completed start item is always added.
+ */
+static inline const EarleyItem *earley_leo(EarleyParser *ep, int set, int nt) {
+	int depth = 0;
+	EarleyItem top = { -1, -1 };
+	EarleyWait *w = earley_waiting(ep, set, nt);
+	while (w != NULL && w->leo == EARLEY_LEO_UNKNOWN) {
+		EarleyItem x = ep->items[ep->wait_items[w->first]];
+		if (w->count != 1 || ep->item_next[x.item + 1] != -1 || (set == 0 && nt == ep->start)) {
+			w->leo = EARLEY_LEO_NONE;
+			break;
+		}
+		EarleyWait **grown = gram_grow(ep->chain, &ep->chain_cap, depth + 1, sizeof(EarleyWait *));
+		if (!grown) {
+			return NULL;
+		}
+		ep->chain = grown;
+		ep->chain[depth++] = w;
+		top.item = x.item + 1;
+		top.origin = x.origin;
+		set = x.origin;
+		nt = ep->g->prod_lhs[ep->item_prod[x.item]];
+		w = set == 0 && nt == ep->start ? NULL : earley_waiting(ep, set, nt);
+	}
+	if (w != NULL && w->leo == EARLEY_LEO_TOP) {
+		top = w->top;
+	}
+	for (int i = 0; i < depth; i++) {
+		ep->chain[i]->leo = EARLEY_LEO_TOP;
+		ep->chain[i]->top = top;
+	}
+	return depth > 0 ? &ep->chain[0]->top : (w != NULL && w->leo == EARLEY_LEO_TOP ? &w->top : NULL);
+}
+
+/* Completed item x in the current set: advance what waited for its left-hand side. */
+static inline bool earley_complete(EarleyParser *ep, EarleyItem x) {
+	int current = ep->sets - 1;
+	if (x.origin == current) {
+		return true;
+	}
+	int A = ep->g->prod_lhs[ep->item_prod[x.item]];
+	if (ep->use_leo) {
+		const EarleyItem *top = earley_leo(ep, x.origin, A);
+		if (top != NULL) {
+			ep->leo_tops++;
+			return earley_add(ep, top->item, top->origin);
+		}
+	}
+	const EarleyWait *w = earley_waiting(ep, x.origin, A);
+	int n = w ? w->count : 0;
+	int first = w ? w->first : 0;
+	bool ok = true;
+	for (int k = 0; k < n && ok; k++) {
+		EarleyItem y = ep->items[ep->wait_items[first + k]];
+		ok = earley_add(ep, y.item + 1, y.origin);
+	}
+	return ok;
+}
+
+static inline bool earley_predict(EarleyParser *ep, int B) {
+	const Grammar *g = ep->g;
+	if (ep->predicted[B] == ep->epoch + ep->sets) {
+		return true;
+	}
+	ep->predicted[B] = ep->epoch + ep->sets;
+	bool ok = true;
+	for (int k = g->nt_first[B]; k < g->nt_first[B + 1] && ok; k++) {
+		ok = earley_add(ep, ep->prod_item[g->nt_prods[k]], ep->sets - 1);
+	}
+	return ok;
+}
+
+/*
+ * Recognize tokens[0..n) (terminal indices, no end marker) as a sentence
+ * of the start symbol. On rejection error_pos is the index of the first
+ * token no item could scan.
+ */
+static inline bool earley_recognize(EarleyParser *ep, const int *tokens, int n) {
+	const Grammar *g = ep->g;
+	ep->epoch += ep->sets;
+	ep->count = 0;
+	ep->sets = 0;
+	ep->scan_count = 0;
+	ep->wait_count = 0;
+	ep->wait_item_count = 0;
+	ep->error_pos = -1;
+
+	bool ok = earley_open_set(ep) && earley_predict(ep, ep->start);
+	for (int i = 0; ok && i <= n; i++) {
+		int a = i < n ? tokens[i] : -1;
+		for (int k = ep->set_start[i]; k < ep->count && ok; k++) {
+			EarleyItem x = ep->items[k];
+			int32_t next = ep->item_next[x.item];
+			if (next < 0) {
+				ok = earley_complete(ep, x);
+			} else if (gram_is_term((Sym)next)) {
+				if (gram_term_index((Sym)next) == a) {
+					EarleyItem *grown = gram_grow(ep->scan, &ep->scan_cap, ep->scan_count + 1, sizeof(EarleyItem));
+					ok = grown != NULL;
+					if (ok) {
+						ep->scan = grown;
+						ep->scan[ep->scan_count].item = x.item + 1;
+						ep->scan[ep->scan_count++].origin = x.origin;
+					}
+				}
+			} else {
+				ok = earley_predict(ep, next);
+				if (ok && ep->nullable[next]) {
+					ok = earley_add(ep, x.item + 1, x.origin);
+				}
+			}
+		}
+		ok = ok && earley_close_set(ep);
+		if (ok && i < n) {
+			if (ep->scan_count == 0) {
+				ep->error_pos = i;
+				return false;
+			}
+			ok = earley_open_set(ep);
+		}
+	}
+	if (!ok) {
+		ep->error_pos = 0;
+		return false;
+	}
+	for (int k = ep->set_start[n]; k < ep->count; k++) {
+		EarleyItem x = ep->items[k];
+		if (x.origin == 0 && ep->item_next[x.item] < 0 && g->prod_lhs[ep->item_prod[x.item]] == ep->start) {
+			return true;
+		}
+	}
+	ep->error_pos = n;
+	return false;
+}
+
+#endif
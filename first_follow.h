@@ -0,0 +1,1234 @@
+#ifndef FIRST_FOLLOW_H
+#define FIRST_FOLLOW_H
+
+/*
+ * FIRST and FOLLOW sets over a grammar.h grammar, shared by task5 and task6.
+ *
+ * Each set is a word-packed bitset: bit 0 is epsilon and terminal t is bit
+ * t + 1, so a union is a handful of 64-bit ORs (vectorized by the compiler)
+ * and "did it grow" is one compare per word. Row A of first/follow starts
+ * at A * words.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "grammar.h"
+
+#define FF_EPS 0
+
+/*
+ * Constraints kept between edits for ff_update, as counted links over
+ * 2 * nt_count nodes: node 2A is FIRST(A) and node 2A + 1 is FOLLOW(A).
+ * An out link u -> v means set u contains set v (without epsilon) and a
+ * seed link puts bit to in set u. The count is the number of production
+ * positions implying the link, so it goes away only with the last one.
+ */
+typedef struct {
+	int to;
+	int count;
+} FfLink;
+
+typedef struct {
+	FfLink *items;
+	int count;
+	int cap;
+} FfLinks;
+
+typedef struct {
+	int nodes;
+	FfLinks *out;
+	FfLinks *in;
+	FfLinks *seed;
+
+	/* Sources whose out or seed links appeared or vanished in the current edit; shrunk when any vanished. */
+	int *dirty;
+	int dirty_count;
+	int dirty_cap;
+	bool shrunk;
+
+	/* Eight ints per node; a node is in the current pass when stamp[u] == epoch. */
+	int *scratch;
+	int epoch;
+} FfDeps;
+
+static inline void ff_deps_free(FfDeps *d) {
+	if (d == NULL) {
+		return;
+	}
+	for (int u = 0; u < d->nodes; u++) {
+		free(d->out[u].items);
+		free(d->in[u].items);
+		free(d->seed[u].items);
+	}
+	free(d->out);
+	free(d->in);
+	free(d->seed);
+	free(d->dirty);
+	free(d->scratch);
+	free(d);
+}
+
+typedef struct {
+	int nt_count;
+	int words;
+	int start;
+	bool *nullable;
+	uint64_t *first;
+	uint64_t *follow;
+
+	/* Built by the first ff_update and dropped by ff_free, so ff_compute starts over. */
+	FfDeps *deps;
+
+	/* Solver threads for ff_compute, used when built with -DFF_PARALLEL; kept by ff_free. */
+	int threads;
+} FirstFollow;
+
+static inline uint64_t *ff_first(const FirstFollow *ff, int A) {
+	return ff->first + (size_t)A * (size_t)ff->words;
+}
+
+static inline uint64_t *ff_follow(const FirstFollow *ff, int A) {
+	return ff->follow + (size_t)A * (size_t)ff->words;
+}
+
+static inline bool ff_test(const uint64_t *set, int bit) {
+	return (set[bit >> 6] >> (bit & 63)) & 1u;
+}
+
+static inline bool ff_add(uint64_t *set, int bit) {
+	uint64_t old = set[bit >> 6];
+	set[bit >> 6] = old | ((uint64_t)1 << (bit & 63));
+	return set[bit >> 6] != old;
+}
+
+static inline bool ff_has_term(const uint64_t *set, int t) {
+	return ff_test(set, t + 1);
+}
+
+/* dst |= src without the epsilon bit; returns true when dst grew. */
+static inline bool ff_union_no_eps(uint64_t *dst, const uint64_t *src, int words) {
+	uint64_t grew = 0;
+	for (int i = 0; i < words; i++) {
+		uint64_t add = i == 0 ? src[i] & ~(uint64_t)1 : src[i];
+		uint64_t merged = dst[i] | add;
+		grew |= merged ^ dst[i];
+		dst[i] = merged;
+	}
+	return grew != 0;
+}
+
+/* FIRST of a symbol sequence; the epsilon bit is set when it is nullable. */
+static inline void ff_first_of_sequence(const FirstFollow *ff, const Sym *seq, int len, uint64_t *out) {
+	for (int k = 0; k < len; k++) {
+		Sym s = seq[k];
+		if (gram_is_term(s)) {
+			ff_add(out, gram_term_index(s) + 1);
+			return;
+		}
+		ff_union_no_eps(out, ff_first(ff, s), ff->words);
+		if (!ff_test(ff_first(ff, s), FF_EPS)) {
+			return;
+		}
+	}
+	ff_add(out, FF_EPS);
+}
+
+static inline void ff_free(FirstFollow *ff) {
+	ff_deps_free(ff->deps);
+	free(ff->nullable);
+	free(ff->first);
+	free(ff->follow);
+	int threads = ff->threads;
+	memset(ff, 0, sizeof(*ff));
+	ff->threads = threads;
+}
+
+/* Size the sets for g; all start empty. */
+static inline bool ff_alloc(FirstFollow *ff, const Grammar *g) {
+	size_t rows = (size_t)(g->nt_count > 0 ? g->nt_count : 1);
+	ff_free(ff);
+	ff->nt_count = g->nt_count;
+	ff->words = (g->term_count + 1 + 63) / 64;
+	ff->nullable = calloc(rows, sizeof(bool));
+	ff->first = calloc(rows * (size_t)ff->words, sizeof(uint64_t));
+	ff->follow = calloc(rows * (size_t)ff->words, sizeof(uint64_t));
+	if (!ff->nullable || !ff->first || !ff->follow) {
+		ff_free(ff);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Widen the sets to g's symbols after an edit interned new ones, keeping
+ * every existing row. New nonterminals start with empty, non-nullable sets.
+ */
+static inline bool ff_grow(FirstFollow *ff, const Grammar *g) {
+	int words = (g->term_count + 1 + 63) / 64;
+	if (g->nt_count <= ff->nt_count && words <= ff->words) {
+		return true;
+	}
+	size_t rows = (size_t)(g->nt_count > 0 ? g->nt_count : 1);
+	bool *nullable = calloc(rows, sizeof(bool));
+	uint64_t *first = calloc(rows * (size_t)words, sizeof(uint64_t));
+	uint64_t *follow = calloc(rows * (size_t)words, sizeof(uint64_t));
+	if (!nullable || !first || !follow) {
+		free(nullable);
+		free(first);
+		free(follow);
+		return false;
+	}
+	for (int a = 0; a < ff->nt_count; a++) {
+		nullable[a] = ff->nullable[a];
+		memcpy(first + (size_t)a * (size_t)words, ff_first(ff, a), sizeof(uint64_t) * (size_t)ff->words);
+		memcpy(follow + (size_t)a * (size_t)words, ff_follow(ff, a), sizeof(uint64_t) * (size_t)ff->words);
+	}
+	free(ff->nullable);
+	free(ff->first);
+	free(ff->follow);
+	ff->nullable = nullable;
+	ff->first = first;
+	ff->follow = follow;
+	ff->nt_count = g->nt_count;
+	ff->words = words;
+	return true;
+}
+
+/*
+ * Inclusion constraints "set[u] contains set[v]" as a graph: once finished,
+ * the edges of u are to[off[u] .. off[u + 1]).
+ */
+typedef struct {
+	int n;
+	int *off;
+	int *to;
+	int edge_count;
+	int from_cap;
+	int *edge_from;
+	int to_cap;
+	int *edge_to;
+} FfGraph;
+
+static inline bool ff_graph_init(FfGraph *gr, int n) {
+	memset(gr, 0, sizeof(*gr));
+	gr->n = n;
+	gr->off = calloc((size_t)n + 2, sizeof(int));
+	return gr->off != NULL;
+}
+
+static inline void ff_graph_free(FfGraph *gr) {
+	free(gr->off);
+	free(gr->to);
+	free(gr->edge_from);
+	free(gr->edge_to);
+	memset(gr, 0, sizeof(*gr));
+}
+
+static inline bool ff_graph_edge(FfGraph *gr, int u, int v) {
+	int *from = gram_grow(gr->edge_from, &gr->from_cap, gr->edge_count + 1, sizeof(int));
+	if (from == NULL) {
+		return false;
+	}
+	gr->edge_from = from;
+	int *to = gram_grow(gr->edge_to, &gr->to_cap, gr->edge_count + 1, sizeof(int));
+	if (to == NULL) {
+		return false;
+	}
+	gr->edge_to = to;
+	gr->edge_from[gr->edge_count] = u;
+	gr->edge_to[gr->edge_count] = v;
+	gr->edge_count++;
+	return true;
+}
+
+/* Bucket the edges by source, the same way gram_index groups productions. */
+static inline bool ff_graph_finish(FfGraph *gr) {
+	gr->to = malloc(sizeof(int) * (size_t)(gr->edge_count > 0 ? gr->edge_count : 1));
+	if (gr->to == NULL) {
+		return false;
+	}
+	for (int e = 0; e < gr->edge_count; e++) {
+		gr->off[gr->edge_from[e] + 2]++;
+	}
+	for (int u = 1; u < gr->n; u++) {
+		gr->off[u + 1] += gr->off[u];
+	}
+	for (int e = 0; e < gr->edge_count; e++) {
+		gr->to[gr->off[gr->edge_from[e] + 1]++] = gr->edge_to[e];
+	}
+	return true;
+}
+
+/*
+ * Strongly connected components by an iterative Tarjan pass. Components
+ * are numbered in the order Tarjan finishes them, so every edge leaving a
+ * component points at a lower number. Returns the component count, or -1
+ * when out of memory.
+ */
+static inline int ff_graph_scc(const FfGraph *gr, int *comp) {
+	size_t n = (size_t)(gr->n > 0 ? gr->n : 1);
+	int *scratch = malloc(sizeof(int) * n * 5);
+	if (scratch == NULL) {
+		return -1;
+	}
+	int *index = scratch;
+	int *low = index + n;
+	int *pos = low + n;
+	int *frames = pos + n;
+	int *stack = frames + n;
+	int next_index = 0;
+	int sp = 0;
+	int comp_count = 0;
+
+	for (int u = 0; u < gr->n; u++) {
+		index[u] = -1;
+		comp[u] = -1;
+	}
+
+	for (int root = 0; root < gr->n; root++) {
+		if (index[root] != -1) {
+			continue;
+		}
+		int depth = 0;
+		index[root] = low[root] = next_index++;
+		pos[root] = gr->off[root];
+		stack[sp++] = root;
+		frames[depth++] = root;
+
+		while (depth > 0) {
+			int v = frames[depth - 1];
+			if (pos[v] < gr->off[v + 1]) {
+				int w = gr->to[pos[v]++];
+				if (index[w] == -1) {
+					index[w] = low[w] = next_index++;
+					pos[w] = gr->off[w];
+					stack[sp++] = w;
+					frames[depth++] = w;
+				} else if (comp[w] == -1 && index[w] < low[v]) {
+					low[v] = index[w];
+				}
+				continue;
+			}
+
+			depth--;
+			if (depth > 0 && low[v] < low[frames[depth - 1]]) {
+				low[frames[depth - 1]] = low[v];
+			}
+			if (low[v] != index[v]) {
+				continue;
+			}
+			do {
+				comp[stack[--sp]] = comp_count;
+			} while (stack[sp] != v);
+			comp_count++;
+		}
+	}
+
+	free(scratch);
+	return comp_count;
+}
+
+/* Components of a graph with their members grouped, as ff_graph_finish groups edges. */
+typedef struct {
+	int count;
+	int *comp;
+	int *first;
+	int *members;
+} FfComponents;
+
+static inline void ff_components_free(FfComponents *cs) {
+	free(cs->comp);
+	free(cs->first);
+	free(cs->members);
+	memset(cs, 0, sizeof(*cs));
+}
+
+/* Members of component c are members[first[c] .. first[c + 1]). */
+static inline bool ff_components(const FfGraph *gr, FfComponents *cs) {
+	size_t n = (size_t)(gr->n > 0 ? gr->n : 1);
+	memset(cs, 0, sizeof(*cs));
+	cs->comp = malloc(sizeof(int) * n);
+	cs->first = calloc(n + 2, sizeof(int));
+	cs->members = malloc(sizeof(int) * n);
+	cs->count = cs->comp && cs->first && cs->members ? ff_graph_scc(gr, cs->comp) : -1;
+	if (cs->count < 0) {
+		ff_components_free(cs);
+		return false;
+	}
+	for (int u = 0; u < gr->n; u++) {
+		cs->first[cs->comp[u] + 2]++;
+	}
+	for (int c = 1; c < cs->count; c++) {
+		cs->first[c + 1] += cs->first[c];
+	}
+	for (int u = 0; u < gr->n; u++) {
+		cs->members[cs->first[cs->comp[u] + 1]++] = u;
+	}
+	return true;
+}
+
+/*
+ * Topological level of each component: 0 when no edge leaves it, else one
+ * more than the highest level it points at. Components on one level do
+ * not depend on each other. Returns the number of levels.
+ */
+static inline int ff_component_levels(const FfGraph *gr, const FfComponents *cs, int *level) {
+	int levels = 0;
+	for (int c = 0; c < cs->count; c++) {
+		level[c] = 0;
+		for (int i = cs->first[c]; i < cs->first[c + 1]; i++) {
+			int m = cs->members[i];
+			for (int e = gr->off[m]; e < gr->off[m + 1]; e++) {
+				int d = cs->comp[gr->to[e]];
+				if (d != c && level[d] + 1 > level[c]) {
+					level[c] = level[d] + 1;
+				}
+			}
+		}
+		if (level[c] + 1 > levels) {
+			levels = level[c] + 1;
+		}
+	}
+	return levels;
+}
+
+/*
+ * Final set of component c, assuming every component it points at is
+ * final. Only the rows of c's members are written. acc is scratch of
+ * words words.
+ */
+static inline void ff_solve_component(const FfGraph *gr, const FfComponents *cs, int c, uint64_t *sets, int words,
+									  uint64_t *acc) {
+	memset(acc, 0, sizeof(uint64_t) * (size_t)words);
+	for (int i = cs->first[c]; i < cs->first[c + 1]; i++) {
+		int m = cs->members[i];
+		ff_union_no_eps(acc, sets + (size_t)m * (size_t)words, words);
+		for (int e = gr->off[m]; e < gr->off[m + 1]; e++) {
+			if (cs->comp[gr->to[e]] != c) {
+				ff_union_no_eps(acc, sets + (size_t)gr->to[e] * (size_t)words, words);
+			}
+		}
+	}
+	for (int i = cs->first[c]; i < cs->first[c + 1]; i++) {
+		uint64_t *set = sets + (size_t)cs->members[i] * (size_t)words;
+		uint64_t eps = set[0] & ((uint64_t)1 << FF_EPS);
+		memcpy(set, acc, sizeof(uint64_t) * (size_t)words);
+		set[0] |= eps;
+	}
+}
+
+/*
+ * Least solution of the constraints over seeded sets, one component at a
+ * time in ff_graph_scc order, so every edge leaving a component points at
+ * a final set. Members of one component include each other and therefore
+ * share a set (apart from their own epsilon bit), which is built with one
+ * union per member and per edge.
+ */
+static inline bool ff_solve(const FfGraph *gr, uint64_t *sets, int words) {
+	FfComponents cs;
+	uint64_t *acc = malloc(sizeof(uint64_t) * (size_t)words);
+	if (acc == NULL || !ff_components(gr, &cs)) {
+		free(acc);
+		return false;
+	}
+	for (int c = 0; c < cs.count; c++) {
+		ff_solve_component(gr, &cs, c, sets, words, acc);
+	}
+	ff_components_free(&cs);
+	free(acc);
+	return true;
+}
+
+#ifdef FF_PARALLEL
+#include <pthread.h>
+
+/*
+ * Level-synchronous solve on a fixed set of threads. Each level's
+ * components are claimed one at a time from a shared counter; a
+ * component writes only its own members' rows and reads rows of lower
+ * levels, so no locks are needed besides the barrier between levels.
+ */
+typedef struct {
+	const FfGraph *gr;
+	const FfComponents *cs;
+	uint64_t *sets;
+	int words;
+	const int *level_first;
+	const int *level_comps;
+	int levels;
+	int threads;
+	int level;
+	int next;
+	int waiting;
+	int generation;
+	bool failed;
+	pthread_mutex_t lock;
+	pthread_cond_t turn;
+} FfPool;
+
+/* Wait for every thread; the last one to arrive opens the next level. */
+static inline void ff_pool_barrier(FfPool *pool) {
+	pthread_mutex_lock(&pool->lock);
+	int generation = pool->generation;
+	if (++pool->waiting == pool->threads) {
+		pool->waiting = 0;
+		pool->level++;
+		pool->next = 0;
+		pool->generation++;
+		pthread_cond_broadcast(&pool->turn);
+	} else {
+		while (generation == pool->generation) {
+			pthread_cond_wait(&pool->turn, &pool->lock);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static inline void *ff_pool_worker(void *arg) {
+	FfPool *pool = arg;
+	uint64_t *acc = malloc(sizeof(uint64_t) * (size_t)pool->words);
+	if (acc == NULL) {
+		__atomic_store_n(&pool->failed, true, __ATOMIC_RELAXED);
+	}
+	while (pool->level < pool->levels) {
+		int level = pool->level;
+		int end = pool->level_first[level + 1];
+		for (;;) {
+			int i = pool->level_first[level] + __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+			if (i >= end || acc == NULL) {
+				break;
+			}
+			ff_solve_component(pool->gr, pool->cs, pool->level_comps[i], pool->sets, pool->words, acc);
+		}
+		ff_pool_barrier(pool);
+	}
+	free(acc);
+	return NULL;
+}
+
+/* ff_solve over all nodes with up to threads threads; the calling thread is one of them. */
+static inline bool ff_solve_parallel(const FfGraph *gr, uint64_t *sets, int words, int threads) {
+	if (threads <= 1) {
+		return ff_solve(gr, sets, words);
+	}
+	FfComponents cs;
+	if (!ff_components(gr, &cs)) {
+		return false;
+	}
+	size_t count = (size_t)(cs.count > 0 ? cs.count : 1);
+	int *level = malloc(sizeof(int) * count);
+	int *level_first = calloc(count + 2, sizeof(int));
+	int *level_comps = malloc(sizeof(int) * count);
+	pthread_t *tids = malloc(sizeof(pthread_t) * (size_t)threads);
+	bool ok = level && level_first && level_comps && tids;
+	FfPool pool;
+	memset(&pool, 0, sizeof(pool));
+	if (ok) {
+		pool.levels = ff_component_levels(gr, &cs, level);
+		for (int c = 0; c < cs.count; c++) {
+			level_first[level[c] + 2]++;
+		}
+		for (int l = 1; l < pool.levels; l++) {
+			level_first[l + 1] += level_first[l];
+		}
+		for (int c = 0; c < cs.count; c++) {
+			level_comps[level_first[level[c] + 1]++] = c;
+		}
+		pool.gr = gr;
+		pool.cs = &cs;
+		pool.sets = sets;
+		pool.words = words;
+		pool.level_first = level_first;
+		pool.level_comps = level_comps;
+		pool.threads = threads;
+		pthread_mutex_init(&pool.lock, NULL);
+		pthread_cond_init(&pool.turn, NULL);
+		int started = 0;
+		while (started < threads - 1 && pthread_create(&tids[started], NULL, ff_pool_worker, &pool) == 0) {
+			started++;
+		}
+		/* Threads that failed to start must not be waited for at the barrier. */
+		pthread_mutex_lock(&pool.lock);
+		pool.threads = started + 1;
+		pthread_mutex_unlock(&pool.lock);
+		ff_pool_worker(&pool);
+		for (int i = 0; i < started; i++) {
+			pthread_join(tids[i], NULL);
+		}
+		pthread_mutex_destroy(&pool.lock);
+		pthread_cond_destroy(&pool.turn);
+		ok = !pool.failed;
+	}
+	free(level);
+	free(level_first);
+	free(level_comps);
+	free(tids);
+	ff_components_free(&cs);
+	return ok;
+}
+#endif
+
+/* Solve FIRST or FOLLOW rows of ff over gr, on ff->threads threads when built with FF_PARALLEL. */
+static inline bool ff_solve_sets(const FirstFollow *ff, const FfGraph *gr, uint64_t *sets) {
+#ifdef FF_PARALLEL
+	if (ff->threads > 1) {
+		return ff_solve_parallel(gr, sets, ff->words, ff->threads);
+	}
+#endif
+	return ff_solve(gr, sets, ff->words);
+}
+
+/* Nullable nonterminals by counting down the unresolved symbols of each production. */
+static inline bool ff_nullable(const Grammar *g, bool *nullable) {
+	size_t nt = (size_t)(g->nt_count > 0 ? g->nt_count : 1);
+	size_t prods = (size_t)(g->prod_count > 0 ? g->prod_count : 1);
+	size_t rhs_len = (size_t)(g->prod_count > 0 ? g->prod_off[g->prod_count] : 0);
+	int *remaining = malloc(sizeof(int) * prods);
+	int *occ_off = calloc(nt + 2, sizeof(int));
+	int *occ = malloc(sizeof(int) * (rhs_len > 0 ? rhs_len : 1));
+	int *queue = malloc(sizeof(int) * nt);
+	bool ok = remaining && occ_off && occ && queue;
+	int head = 0;
+	int tail = 0;
+
+	for (int p = 0; ok && p < g->prod_count; p++) {
+		const Sym *rhs = gram_rhs(g, p);
+		int len = gram_rhs_len(g, p);
+		remaining[p] = len;
+		for (int k = 0; k < len; k++) {
+			if (gram_is_term(rhs[k])) {
+				remaining[p] = -1;
+				break;
+			}
+		}
+		for (int k = 0; k < len && remaining[p] > 0; k++) {
+			occ_off[rhs[k] + 2]++;
+		}
+	}
+	if (ok) {
+		/* Occurrences of B (in all-nonterminal productions) are occ[occ_off[B] .. occ_off[B + 1]). */
+		for (int a = 1; a < g->nt_count; a++) {
+			occ_off[a + 1] += occ_off[a];
+		}
+		for (int p = 0; p < g->prod_count; p++) {
+			const Sym *rhs = gram_rhs(g, p);
+			for (int k = 0; k < gram_rhs_len(g, p) && remaining[p] > 0; k++) {
+				occ[occ_off[rhs[k] + 1]++] = p;
+			}
+		}
+
+		for (int a = 0; a < g->nt_count; a++) {
+			nullable[a] = false;
+		}
+		for (int p = 0; p < g->prod_count; p++) {
+			int A = g->prod_lhs[p];
+			if (remaining[p] == 0 && !nullable[A]) {
+				nullable[A] = true;
+				queue[tail++] = A;
+			}
+		}
+		while (head < tail) {
+			int B = queue[head++];
+			for (int i = occ_off[B]; i < occ_off[B + 1]; i++) {
+				int p = occ[i];
+				int A = g->prod_lhs[p];
+				if (--remaining[p] == 0 && !nullable[A]) {
+					nullable[A] = true;
+					queue[tail++] = A;
+				}
+			}
+		}
+	}
+
+	free(remaining);
+	free(occ_off);
+	free(occ);
+	free(queue);
+	return ok;
+}
+
+/*
+ * FIRST-graph edges of production p (when gr is set) and, when seed is
+ * true, the terminal that ends its nullable prefix added to FIRST(lhs).
+ */
+static inline bool ff_first_production(const Grammar *g, FirstFollow *ff, FfGraph *gr, int p, bool seed) {
+	int A = g->prod_lhs[p];
+	const Sym *rhs = gram_rhs(g, p);
+	int len = gram_rhs_len(g, p);
+	for (int k = 0; k < len; k++) {
+		if (gram_is_term(rhs[k])) {
+			if (seed) {
+				ff_add(ff_first(ff, A), gram_term_index(rhs[k]) + 1);
+			}
+			break;
+		}
+		if (gr && !ff_graph_edge(gr, A, rhs[k])) {
+			return false;
+		}
+		if (!ff->nullable[rhs[k]]) {
+			break;
+		}
+	}
+	return true;
+}
+
+/* FIRST(A) contains FIRST(B) for every B reachable through a nullable prefix. */
+static inline bool ff_compute_first(const Grammar *g, FirstFollow *ff) {
+	FfGraph gr;
+	if (!ff_alloc(ff, g) || !ff_nullable(g, ff->nullable)) {
+		return false;
+	}
+	if (!ff_graph_init(&gr, g->nt_count)) {
+		return false;
+	}
+	bool ok = true;
+	for (int a = 0; a < g->nt_count; a++) {
+		if (ff->nullable[a]) {
+			ff_add(ff_first(ff, a), FF_EPS);
+		}
+	}
+	for (int p = 0; ok && p < g->prod_count; p++) {
+		ok = ff_first_production(g, ff, &gr, p, true);
+	}
+	ok = ok && ff_graph_finish(&gr) && ff_solve_sets(ff, &gr, ff->first);
+	ff_graph_free(&gr);
+	return ok;
+}
+
+/*
+ * FOLLOW seeds and edges of production p. Each B gets FIRST of what
+ * follows it (only the B marked in seed, or all when seed is NULL) and,
+ * when gr is set, an edge to the lhs when that suffix is nullable.
+ * suffix is scratch of ff->words words.
+ */
+static inline bool ff_follow_production(const Grammar *g, FirstFollow *ff, FfGraph *gr, int p,
+										const bool *seed, uint64_t *suffix) {
+	size_t set_bytes = sizeof(uint64_t) * (size_t)ff->words;
+	int A = g->prod_lhs[p];
+	const Sym *rhs = gram_rhs(g, p);
+	memset(suffix, 0, set_bytes);
+	ff_add(suffix, FF_EPS);
+
+	for (int k = gram_rhs_len(g, p) - 1; k >= 0; k--) {
+		Sym B = rhs[k];
+		if (gram_is_term(B)) {
+			memset(suffix, 0, set_bytes);
+			ff_add(suffix, gram_term_index(B) + 1);
+			continue;
+		}
+		if (seed == NULL || seed[B]) {
+			ff_union_no_eps(ff_follow(ff, B), suffix, ff->words);
+		}
+		if (gr && ff_test(suffix, FF_EPS) && B != A && !ff_graph_edge(gr, B, A)) {
+			return false;
+		}
+		if (!ff->nullable[B]) {
+			memset(suffix, 0, set_bytes);
+		}
+		ff_union_no_eps(suffix, ff_first(ff, B), ff->words);
+	}
+	return true;
+}
+
+/*
+ * FOLLOW(B) gets FIRST of what follows B directly, and contains FOLLOW(A)
+ * when that suffix is nullable. Needs ff_compute_first; dollar is the
+ * terminal index of the end marker.
+ */
+static inline bool ff_compute_follow(const Grammar *g, FirstFollow *ff, int dollar) {
+	FfGraph gr;
+	size_t set_bytes = sizeof(uint64_t) * (size_t)ff->words;
+	uint64_t *suffix = malloc(set_bytes);
+	if (suffix == NULL) {
+		return false;
+	}
+	if (!ff_graph_init(&gr, g->nt_count)) {
+		free(suffix);
+		return false;
+	}
+	bool ok = true;
+	memset(ff->follow, 0, set_bytes * (size_t)g->nt_count);
+	ff->start = g->start == GRAM_NO_SYM ? -1 : g->start;
+	if (ff->start >= 0) {
+		ff_add(ff_follow(ff, ff->start), dollar + 1);
+	}
+	for (int p = 0; ok && p < g->prod_count; p++) {
+		ok = ff_follow_production(g, ff, &gr, p, NULL, suffix);
+	}
+	ok = ok && ff_graph_finish(&gr) && ff_solve_sets(ff, &gr, ff->follow);
+	ff_graph_free(&gr);
+	free(suffix);
+	return ok;
+}
+
+static inline bool ff_compute(const Grammar *g, FirstFollow *ff, int dollar) {
+	return ff_compute_first(g, ff) && ff_compute_follow(g, ff, dollar);
+}
+
+/* Room for the nodes of nt_count nonterminals; new nodes have no links. */
+static inline bool ff_deps_reserve(FfDeps *d, int nt_count) {
+	int nodes = 2 * nt_count;
+	if (nodes <= d->nodes) {
+		return true;
+	}
+	int *scratch = calloc((size_t)nodes * 8, sizeof(int));
+	if (scratch == NULL) {
+		return false;
+	}
+	FfLinks **lists[3] = { &d->out, &d->in, &d->seed };
+	for (int i = 0; i < 3; i++) {
+		FfLinks *grown = realloc(*lists[i], sizeof(FfLinks) * (size_t)nodes);
+		if (grown == NULL) {
+			free(scratch);
+			return false;
+		}
+		memset(grown + d->nodes, 0, sizeof(FfLinks) * (size_t)(nodes - d->nodes));
+		*lists[i] = grown;
+	}
+	free(d->scratch);
+	d->scratch = scratch;
+	d->epoch = 0;
+	d->nodes = nodes;
+	return true;
+}
+
+/* Add delta (1 or -1) to the link to `to`; *flipped when the link appeared or vanished. */
+static inline bool ff_links_bump(FfLinks *l, int to, int delta, bool *flipped) {
+	*flipped = false;
+	for (int i = 0; i < l->count; i++) {
+		if (l->items[i].to == to) {
+			l->items[i].count += delta;
+			if (l->items[i].count == 0) {
+				l->items[i] = l->items[--l->count];
+				*flipped = true;
+			}
+			return true;
+		}
+	}
+	if (delta < 0) {
+		return true;
+	}
+	FfLink *grown = gram_grow(l->items, &l->cap, l->count + 1, sizeof(FfLink));
+	if (grown == NULL) {
+		return false;
+	}
+	l->items = grown;
+	l->items[l->count].to = to;
+	l->items[l->count].count = delta;
+	l->count++;
+	*flipped = true;
+	return true;
+}
+
+static inline bool ff_deps_touch(FfDeps *d, int u, int delta) {
+	d->shrunk = d->shrunk || delta < 0;
+	int *grown = gram_grow(d->dirty, &d->dirty_cap, d->dirty_count + 1, sizeof(int));
+	if (grown == NULL) {
+		return false;
+	}
+	d->dirty = grown;
+	d->dirty[d->dirty_count++] = u;
+	return true;
+}
+
+/* Set u contains set v; the reverse link exists exactly while the forward one does. */
+static inline bool ff_deps_link(FfDeps *d, int u, int v, int delta) {
+	bool flipped;
+	if (!ff_links_bump(&d->out[u], v, delta, &flipped)) {
+		return false;
+	}
+	return !flipped || (ff_links_bump(&d->in[v], u, delta, &flipped) && ff_deps_touch(d, u, delta));
+}
+
+static inline bool ff_deps_seed(FfDeps *d, int u, int bit, int delta) {
+	bool flipped;
+	return ff_links_bump(&d->seed[u], bit, delta, &flipped) && (!flipped || ff_deps_touch(d, u, delta));
+}
+
+/*
+ * Links implied by A -> rhs[0..len) under the given nullable flags,
+ * added (delta 1) or taken back (delta -1): what ff_first_production and
+ * ff_follow_production derive from it, with FIRST of what follows B kept
+ * as links to those FIRST nodes instead of a copied set.
+ */
+static inline bool ff_deps_production(FfDeps *d, const bool *nullable, int A, const Sym *rhs, int len, int delta) {
+	bool ok = true;
+	for (int k = 0; ok && k < len; k++) {
+		if (gram_is_term(rhs[k])) {
+			ok = ff_deps_seed(d, 2 * A, gram_term_index(rhs[k]) + 1, delta);
+			break;
+		}
+		ok = ff_deps_link(d, 2 * A, 2 * rhs[k], delta);
+		if (!nullable[rhs[k]]) {
+			break;
+		}
+	}
+	for (int k = 0; ok && k < len; k++) {
+		int B = rhs[k];
+		if (gram_is_term(B)) {
+			continue;
+		}
+		int j = k + 1;
+		for (; ok && j < len; j++) {
+			if (gram_is_term(rhs[j])) {
+				ok = ff_deps_seed(d, 2 * B + 1, gram_term_index(rhs[j]) + 1, delta);
+				break;
+			}
+			ok = ff_deps_link(d, 2 * B + 1, 2 * rhs[j], delta);
+			if (!nullable[rhs[j]]) {
+				break;
+			}
+		}
+		if (ok && j == len && B != A) {
+			ok = ff_deps_link(d, 2 * B + 1, 2 * A + 1, delta);
+		}
+	}
+	return ok;
+}
+
+/* Links of every production of g, plus the end marker in FOLLOW(start). */
+static inline FfDeps *ff_deps_build(const Grammar *g, const FirstFollow *ff, int dollar) {
+	FfDeps *d = calloc(1, sizeof(FfDeps));
+	bool ok = d != NULL && ff_deps_reserve(d, g->nt_count);
+	for (int p = 0; ok && p < g->prod_count; p++) {
+		ok = ff_deps_production(d, ff->nullable, g->prod_lhs[p], gram_rhs(g, p), gram_rhs_len(g, p), 1);
+	}
+	ok = ok && (ff->start < 0 || ff_deps_seed(d, 2 * ff->start + 1, dollar + 1, 1));
+	if (!ok) {
+		ff_deps_free(d);
+		return NULL;
+	}
+	d->dirty_count = 0;
+	d->shrunk = false;
+	return d;
+}
+
+/*
+ * The nonterminals where nullable differs from ff->nullable flipped: move
+ * the links of every production mentioning one over to the new flags and
+ * fix the epsilon bits of their FIRST sets, then adopt the new flags.
+ */
+static inline bool ff_deps_renullable(FfDeps *d, const Grammar *g, FirstFollow *ff, const bool *nullable,
+									  bool *first_changed) {
+	bool ok = true;
+	for (int p = 0; ok && p < g->prod_count; p++) {
+		const Sym *rhs = gram_rhs(g, p);
+		int len = gram_rhs_len(g, p);
+		bool mentions = false;
+		for (int k = 0; k < len && !mentions; k++) {
+			mentions = !gram_is_term(rhs[k]) && nullable[rhs[k]] != ff->nullable[rhs[k]];
+		}
+		if (mentions) {
+			ok = ff_deps_production(d, ff->nullable, g->prod_lhs[p], rhs, len, -1) &&
+				 ff_deps_production(d, nullable, g->prod_lhs[p], rhs, len, 1);
+		}
+	}
+	for (int a = 0; ok && a < g->nt_count; a++) {
+		if (nullable[a] == ff->nullable[a]) {
+			continue;
+		}
+		ff->nullable[a] = nullable[a];
+		ff_first(ff, a)[0] ^= (uint64_t)1 << FF_EPS;
+		if (first_changed) {
+			first_changed[a] = true;
+		}
+	}
+	return ok;
+}
+
+static inline uint64_t *ff_node_set(const FirstFollow *ff, int u) {
+	return (u & 1) ? ff_follow(ff, u >> 1) : ff_first(ff, u >> 1);
+}
+
+static inline void ff_note_changed(int u, bool *first_changed, bool *follow_changed) {
+	bool *changed = (u & 1) ? follow_changed : first_changed;
+	if (changed) {
+		changed[u >> 1] = true;
+	}
+}
+
+/* Seeds of u and every set it contains, unioned into set u; true when it grew. */
+static inline bool ff_deps_pull(const FfDeps *d, const FirstFollow *ff, int u) {
+	uint64_t *set = ff_node_set(ff, u);
+	bool grew = false;
+	for (int i = 0; i < d->seed[u].count; i++) {
+		grew = ff_add(set, d->seed[u].items[i].to) || grew;
+	}
+	for (int i = 0; i < d->out[u].count; i++) {
+		grew = ff_union_no_eps(set, ff_node_set(ff, d->out[u].items[i].to), ff->words) || grew;
+	}
+	return grew;
+}
+
+/*
+ * Links only appeared, so sets only grow: pull into each dirty source and
+ * pass any growth on to the sets containing it until nothing changes.
+ */
+static inline void ff_deps_grow_sets(FfDeps *d, const FirstFollow *ff, bool *first_changed, bool *follow_changed) {
+	int n = d->nodes;
+	int *stamp = d->scratch;
+	int *queue = stamp + (size_t)n;
+	int head = 0;
+	int size = 0;
+	d->epoch++;
+	for (int i = 0; i < d->dirty_count; i++) {
+		int u = d->dirty[i];
+		if (stamp[u] != d->epoch) {
+			stamp[u] = d->epoch;
+			queue[(head + size++) % n] = u;
+		}
+	}
+	while (size > 0) {
+		int u = queue[head];
+		head = (head + 1) % n;
+		size--;
+		stamp[u] = 0;
+		if (!ff_deps_pull(d, ff, u)) {
+			continue;
+		}
+		ff_note_changed(u, first_changed, follow_changed);
+		for (int i = 0; i < d->in[u].count; i++) {
+			int w = d->in[u].items[i].to;
+			if (stamp[w] != d->epoch) {
+				stamp[w] = d->epoch;
+				queue[(head + size++) % n] = w;
+			}
+		}
+	}
+}
+
+/*
+ * A link vanished, so sets may shrink: clear every set that contains a
+ * dirty source, directly or not, and solve that region again one
+ * component at a time, by the same iterative Tarjan pass as ff_graph_scc.
+ * Sets a component contains are final by the time it completes, and its
+ * own members are cleared, so unioning all of them is safe.
+ */
+static inline bool ff_deps_shrink_sets(FfDeps *d, const FirstFollow *ff, bool *first_changed, bool *follow_changed) {
+	size_t n = (size_t)d->nodes;
+	size_t set_bytes = sizeof(uint64_t) * (size_t)ff->words;
+	int *stamp = d->scratch;
+	int *region = stamp + n;
+	int *index = region + n;
+	int *low = index + n;
+	int *pos = low + n;
+	int *frames = pos + n;
+	int *stack = frames + n;
+	int *comp = stack + n;
+	int count = 0;
+	int epoch = ++d->epoch;
+
+	for (int i = 0; i < d->dirty_count; i++) {
+		int u = d->dirty[i];
+		if (stamp[u] != epoch) {
+			stamp[u] = epoch;
+			region[count++] = u;
+		}
+	}
+	for (int head = 0; head < count; head++) {
+		const FfLinks *in = &d->in[region[head]];
+		for (int i = 0; i < in->count; i++) {
+			if (stamp[in->items[i].to] != epoch) {
+				stamp[in->items[i].to] = epoch;
+				region[count++] = in->items[i].to;
+			}
+		}
+	}
+
+	uint64_t *old = malloc(set_bytes * (size_t)(count > 0 ? count : 1));
+	uint64_t *acc = malloc(set_bytes);
+	if (!old || !acc) {
+		free(old);
+		free(acc);
+		return false;
+	}
+	for (int i = 0; i < count; i++) {
+		int u = region[i];
+		uint64_t *set = ff_node_set(ff, u);
+		memcpy(old + (size_t)i * (size_t)ff->words, set, set_bytes);
+		memset(set, 0, set_bytes);
+		if (!(u & 1) && ff->nullable[u >> 1]) {
+			ff_add(set, FF_EPS);
+		}
+		index[u] = -1;
+		comp[u] = -1;
+	}
+
+	int next_index = 0;
+	int sp = 0;
+	int comp_count = 0;
+	for (int r = 0; r < count; r++) {
+		int root = region[r];
+		if (index[root] != -1) {
+			continue;
+		}
+		int depth = 0;
+		index[root] = low[root] = next_index++;
+		pos[root] = 0;
+		stack[sp++] = root;
+		frames[depth++] = root;
+
+		while (depth > 0) {
+			int v = frames[depth - 1];
+			if (pos[v] < d->out[v].count) {
+				int w = d->out[v].items[pos[v]++].to;
+				if (stamp[w] != epoch) {
+					continue;
+				}
+				if (index[w] == -1) {
+					index[w] = low[w] = next_index++;
+					pos[w] = 0;
+					stack[sp++] = w;
+					frames[depth++] = w;
+				} else if (comp[w] == -1 && index[w] < low[v]) {
+					low[v] = index[w];
+				}
+				continue;
+			}
+
+			depth--;
+			if (depth > 0 && low[v] < low[frames[depth - 1]]) {
+				low[frames[depth - 1]] = low[v];
+			}
+			if (low[v] != index[v]) {
+				continue;
+			}
+			int bottom = sp;
+			do {
+				comp[stack[--bottom]] = comp_count;
+			} while (stack[bottom] != v);
+			memset(acc, 0, set_bytes);
+			for (int i = bottom; i < sp; i++) {
+				int u = stack[i];
+				for (int k = 0; k < d->seed[u].count; k++) {
+					ff_add(acc, d->seed[u].items[k].to);
+				}
+				for (int k = 0; k < d->out[u].count; k++) {
+					ff_union_no_eps(acc, ff_node_set(ff, d->out[u].items[k].to), ff->words);
+				}
+			}
+			for (int i = bottom; i < sp; i++) {
+				ff_union_no_eps(ff_node_set(ff, stack[i]), acc, ff->words);
+			}
+			sp = bottom;
+			comp_count++;
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (memcmp(old + (size_t)i * (size_t)ff->words, ff_node_set(ff, region[i]), set_bytes) != 0) {
+			ff_note_changed(region[i], first_changed, follow_changed);
+		}
+	}
+	free(old);
+	free(acc);
+	return true;
+}
+
+/* ff_compute, reporting which rows differ from before. */
+static inline bool ff_recompute(const Grammar *g, FirstFollow *ff, int dollar, bool *first_changed,
+								bool *follow_changed) {
+	size_t row_bytes = sizeof(uint64_t) * (size_t)ff->words;
+	size_t set_bytes = row_bytes * (size_t)(ff->nt_count > 0 ? ff->nt_count : 1);
+	uint64_t *first = malloc(set_bytes);
+	uint64_t *follow = malloc(set_bytes);
+	bool ok = first && follow;
+	if (ok) {
+		memcpy(first, ff->first, set_bytes);
+		memcpy(follow, ff->follow, set_bytes);
+		ok = ff_compute(g, ff, dollar);
+	}
+	for (int a = 0; ok && a < g->nt_count; a++) {
+		size_t at = (size_t)a * (size_t)ff->words;
+		if (first_changed) {
+			first_changed[a] = memcmp(first + at, ff_first(ff, a), row_bytes) != 0;
+		}
+		if (follow_changed) {
+			follow_changed[a] = memcmp(follow + at, ff_follow(ff, a), row_bytes) != 0;
+		}
+	}
+	free(first);
+	free(follow);
+	return ok;
+}
+
+/*
+ * Bring ff up to date after the alternative lhs -> rhs[0..len) was added
+ * to g (added) or removed from it. The first call builds the counted
+ * links of FfDeps; from then on an edit adjusts the links of its own
+ * production, plus those of productions mentioning a nonterminal whose
+ * nullability it flipped, and only sets containing a link that appeared
+ * or vanished are solved again. Symbols the edit interned get empty rows
+ * first; the first production ever added, which fixes the start symbol,
+ * falls back to ff_compute.
+ * first_changed and follow_changed (either may be NULL) receive which
+ * sets differ afterwards.
+ */
+static inline bool ff_update(const Grammar *g, FirstFollow *ff, int dollar, int lhs, const Sym *rhs, int len,
+							 bool added, bool *first_changed, bool *follow_changed) {
+	int n = g->nt_count;
+	int start = g->start == GRAM_NO_SYM ? -1 : g->start;
+	if (!ff_grow(ff, g)) {
+		return false;
+	}
+	if (start != ff->start) {
+		return ff_recompute(g, ff, dollar, first_changed, follow_changed);
+	}
+
+	/*
+	 * Nullability can only flip when the alternative is all nullable
+	 * nonterminals: adding one to a non-nullable lhs, or removing one that
+	 * may have been the only way lhs derives epsilon.
+	 */
+	bool rhs_nullable = true;
+	for (int k = 0; k < len && rhs_nullable; k++) {
+		rhs_nullable = !gram_is_term(rhs[k]) && ff->nullable[rhs[k]];
+	}
+	bool *nullable = NULL;
+	if (rhs_nullable && ff->nullable[lhs] != added) {
+		nullable = malloc(sizeof(bool) * (size_t)(n > 0 ? n : 1));
+		if (nullable == NULL || !ff_nullable(g, nullable)) {
+			free(nullable);
+			return false;
+		}
+	}
+
+	for (int a = 0; a < n; a++) {
+		if (first_changed) {
+			first_changed[a] = false;
+		}
+		if (follow_changed) {
+			follow_changed[a] = false;
+		}
+	}
+	bool ok = true;
+	if (ff->deps == NULL) {
+		/* g already has the edit; take it back out so the links match the sets. */
+		ff->deps = ff_deps_build(g, ff, dollar);
+		ok = ff->deps != NULL && ff_deps_production(ff->deps, ff->nullable, lhs, rhs, len, added ? -1 : 1);
+	}
+	if (ok && (ok = ff_deps_reserve(ff->deps, n))) {
+		ff->deps->dirty_count = 0;
+		ff->deps->shrunk = false;
+		ok = ff_deps_production(ff->deps, ff->nullable, lhs, rhs, len, added ? 1 : -1);
+	}
+	if (ok && nullable) {
+		ok = ff_deps_renullable(ff->deps, g, ff, nullable, first_changed);
+	}
+	if (ok && !ff->deps->shrunk) {
+		ff_deps_grow_sets(ff->deps, ff, first_changed, follow_changed);
+	} else if (ok) {
+		ok = ff_deps_shrink_sets(ff->deps, ff, first_changed, follow_changed);
+	}
+	if (!ok) {
+		/* The links may be half updated; drop them and let the caller start over. */
+		ff_deps_free(ff->deps);
+		ff->deps = NULL;
+	}
+	free(nullable);
+	return ok;
+}
+
+#endif
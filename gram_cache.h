@@ -0,0 +1,312 @@
+#ifndef GRAM_CACHE_H
+#define GRAM_CACHE_H
+
+/*
+ * On-disk cache of grammar analysis results (task6, task9).
+ *
+ * A cache file is a header, a section table and the section payloads,
+ * each 8-byte aligned:
+ *
+ *   GramCacheHeader | GramCacheSection[count] | payload | payload | ...
+ *
+ * The header carries a 64-bit FNV-1a hash of everything the results were
+ * computed from (the tool, its tokenization mode and the raw grammar
+ * text). A tool hashes its input, maps the file with one mmap and uses the
+ * cached sections only when magic, version, byte order and hash all match;
+ * otherwise it analyzes the grammar as usual and rewrites the file. Files
+ * are written to a temporary name and renamed into place, so a reader
+ * never sees a half-written cache.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "grammar.h"
+#include "gram_file.h"
+
+#define GRAM_CACHE_MAGIC "GRMCACHE"
+#define GRAM_CACHE_VERSION 2u
+#define GRAM_CACHE_BYTE_ORDER 0x01020304u
+#define GRAM_CACHE_MAX_SECTIONS 32
+
+#define GRAM_HASH_INIT 0xcbf29ce484222325ull
+
+#define GRAM_CACHE_TAG(a, b, c, d) \
+	((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint64_t hash;
+	uint32_t count;
+	uint32_t reserved;
+} GramCacheHeader;
+
+typedef struct {
+	uint32_t tag;
+	uint32_t reserved;
+	uint64_t offset;
+	uint64_t size;
+} GramCacheSection;
+
+/* Sections collected for writing; data is borrowed until the write. */
+typedef struct {
+	uint64_t hash;
+	int count;
+	GramCacheSection sections[GRAM_CACHE_MAX_SECTIONS];
+	const void *data[GRAM_CACHE_MAX_SECTIONS];
+} GramCacheWriter;
+
+/* A mapped cache file, valid until gram_cache_close. */
+typedef struct {
+	GramFile file;
+	const char *base;
+	size_t size;
+	const GramCacheHeader *header;
+	const GramCacheSection *sections;
+} GramCache;
+
+static inline uint64_t gram_hash(uint64_t h, const void *data, size_t len) {
+	const unsigned char *p = data;
+	for (size_t i = 0; i < len; i++) {
+		h ^= p[i];
+		h *= 0x100000001b3ull;
+	}
+	return h;
+}
+
+static inline uint64_t gram_hash_str(uint64_t h, const char *s) {
+	return gram_hash(h, s, strlen(s) + 1);
+}
+
+static inline void gram_cache_writer_init(GramCacheWriter *w, uint64_t hash) {
+	memset(w, 0, sizeof(*w));
+	w->hash = hash;
+}
+
+static inline bool gram_cache_add(GramCacheWriter *w, uint32_t tag, const void *data, size_t size) {
+	if (w->count >= GRAM_CACHE_MAX_SECTIONS) {
+		return false;
+	}
+	w->sections[w->count].tag = tag;
+	w->sections[w->count].size = size;
+	w->data[w->count] = data;
+	w->count++;
+	return true;
+}
+
+static inline uint64_t gram_cache_align(uint64_t off) {
+	return (off + 7) & ~(uint64_t)7;
+}
+
+static inline bool gram_cache_write(GramCacheWriter *w, const char *path) {
+	GramCacheHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, GRAM_CACHE_MAGIC, sizeof(h.magic));
+	h.version = GRAM_CACHE_VERSION;
+	h.byte_order = GRAM_CACHE_BYTE_ORDER;
+	h.hash = w->hash;
+	h.count = (uint32_t)w->count;
+
+	uint64_t off = gram_cache_align(sizeof(h) + sizeof(GramCacheSection) * (size_t)w->count);
+	for (int i = 0; i < w->count; i++) {
+		w->sections[i].offset = off;
+		off = gram_cache_align(off + w->sections[i].size);
+	}
+
+	size_t len = strlen(path);
+	char *tmp = malloc(len + 5);
+	if (tmp == NULL) {
+		return false;
+	}
+	memcpy(tmp, path, len);
+	memcpy(tmp + len, ".tmp", 5);
+	FILE *out = fopen(tmp, "wb");
+	if (out == NULL) {
+		free(tmp);
+		return false;
+	}
+
+	static const char pad[8];
+	bool ok = fwrite(&h, sizeof(h), 1, out) == 1;
+	if (ok && w->count > 0) {
+		ok = fwrite(w->sections, sizeof(GramCacheSection), (size_t)w->count, out) == (size_t)w->count;
+	}
+	uint64_t pos = sizeof(h) + sizeof(GramCacheSection) * (size_t)w->count;
+	for (int i = 0; ok && i < w->count; i++) {
+		size_t gap = (size_t)(w->sections[i].offset - pos);
+		ok = fwrite(pad, 1, gap, out) == gap;
+		size_t size = (size_t)w->sections[i].size;
+		if (ok && size > 0) {
+			ok = fwrite(w->data[i], 1, size, out) == size;
+		}
+		pos = w->sections[i].offset + size;
+	}
+	if (fclose(out) != 0) {
+		ok = false;
+	}
+	if (ok) {
+		ok = rename(tmp, path) == 0;
+	}
+	if (!ok) {
+		remove(tmp);
+	}
+	free(tmp);
+	return ok;
+}
+
+static inline void gram_cache_close(GramCache *c) {
+	gram_file_unmap(&c->file);
+	memset(c, 0, sizeof(*c));
+}
+
+/* Map path; false when it is missing, malformed or was built from other input. */
+static inline bool gram_cache_open(GramCache *c, const char *path, uint64_t hash) {
+	memset(c, 0, sizeof(*c));
+	if (!gram_file_map(&c->file, path)) {
+		return false;
+	}
+	if (c->file.size < sizeof(GramCacheHeader)) {
+		gram_cache_close(c);
+		return false;
+	}
+	c->base = c->file.data;
+	c->size = c->file.size;
+	c->header = (const GramCacheHeader *)c->base;
+	c->sections = (const GramCacheSection *)(c->header + 1);
+
+	const GramCacheHeader *h = c->header;
+	bool ok = memcmp(h->magic, GRAM_CACHE_MAGIC, sizeof(h->magic)) == 0 && h->version == GRAM_CACHE_VERSION &&
+			  h->byte_order == GRAM_CACHE_BYTE_ORDER && h->hash == hash && h->count <= GRAM_CACHE_MAX_SECTIONS &&
+			  sizeof(*h) + sizeof(GramCacheSection) * h->count <= c->size;
+	for (uint32_t i = 0; ok && i < h->count; i++) {
+		const GramCacheSection *s = &c->sections[i];
+		ok = s->offset % 8 == 0 && s->offset <= c->size && s->size <= c->size - s->offset;
+	}
+	if (!ok) {
+		gram_cache_close(c);
+	}
+	return ok;
+}
+
+/* Payload of the section tagged tag, or NULL; *size receives its length. */
+static inline const void *gram_cache_get(const GramCache *c, uint32_t tag, size_t *size) {
+	for (uint32_t i = 0; i < c->header->count; i++) {
+		if (c->sections[i].tag == tag) {
+			*size = (size_t)c->sections[i].size;
+			return c->base + c->sections[i].offset;
+		}
+	}
+	*size = 0;
+	return NULL;
+}
+
+/* Like gram_cache_get, but only when the payload is exactly size bytes. */
+static inline const void *gram_cache_get_sized(const GramCache *c, uint32_t tag, size_t size) {
+	size_t got;
+	const void *data = gram_cache_get(c, tag, &got);
+	return data != NULL && got == size ? data : NULL;
+}
+
+typedef struct {
+	int32_t mode;
+	int32_t nt_count;
+	int32_t term_count;
+	int32_t prod_count;
+	int32_t names_len;
+	int32_t start;
+} GramCacheCounts;
+
+#define GRAM_CACHE_COUNTS GRAM_CACHE_TAG('G', 'C', 'N', 'T')
+#define GRAM_CACHE_NAMES GRAM_CACHE_TAG('G', 'N', 'A', 'M')
+#define GRAM_CACHE_NT_NAME GRAM_CACHE_TAG('G', 'N', 'T', 'N')
+#define GRAM_CACHE_TERM_NAME GRAM_CACHE_TAG('G', 'T', 'M', 'N')
+#define GRAM_CACHE_LHS GRAM_CACHE_TAG('G', 'L', 'H', 'S')
+#define GRAM_CACHE_OFF GRAM_CACHE_TAG('G', 'O', 'F', 'F')
+#define GRAM_CACHE_RHS GRAM_CACHE_TAG('G', 'R', 'H', 'S')
+
+/* Interned symbols and productions of g; counts must outlive the write. */
+static inline bool gram_cache_put_grammar(GramCacheWriter *w, const Grammar *g, GramCacheCounts *counts) {
+	memset(counts, 0, sizeof(*counts));
+	counts->mode = (int32_t)g->mode;
+	counts->nt_count = g->nt_count;
+	counts->term_count = g->term_count;
+	counts->prod_count = g->prod_count;
+	counts->names_len = g->names_len;
+	counts->start = g->start == GRAM_NO_SYM ? -1 : (int32_t)g->start;
+	int rhs_len = g->prod_count > 0 ? g->prod_off[g->prod_count] : 0;
+	return gram_cache_add(w, GRAM_CACHE_COUNTS, counts, sizeof(*counts)) &&
+		   gram_cache_add(w, GRAM_CACHE_NAMES, g->names, (size_t)g->names_len) &&
+		   gram_cache_add(w, GRAM_CACHE_NT_NAME, g->nt_name, sizeof(int) * (size_t)g->nt_count) &&
+		   gram_cache_add(w, GRAM_CACHE_TERM_NAME, g->term_name, sizeof(int) * (size_t)g->term_count) &&
+		   gram_cache_add(w, GRAM_CACHE_LHS, g->prod_lhs, sizeof(Sym) * (size_t)g->prod_count) &&
+		   gram_cache_add(w, GRAM_CACHE_OFF, g->prod_off, sizeof(int) * (size_t)(g->prod_count > 0 ? g->prod_count + 1 : 0)) &&
+		   gram_cache_add(w, GRAM_CACHE_RHS, g->rhs, sizeof(Sym) * (size_t)rhs_len);
+}
+
+static inline bool gram_cache_sym_ok(const GramCacheCounts *n, Sym s) {
+	return gram_is_term(s) ? gram_term_index(s) < n->term_count : (int)s < n->nt_count;
+}
+
+/* Rebuild g (symbol IDs unchanged) from the cached grammar sections; does not index it. */
+static inline bool gram_cache_get_grammar(const GramCache *c, Grammar *g) {
+	const GramCacheCounts *n = gram_cache_get_sized(c, GRAM_CACHE_COUNTS, sizeof(GramCacheCounts));
+	if (n == NULL || n->nt_count < 0 || n->term_count < 0 || n->prod_count < 0 || n->names_len < 0) {
+		return false;
+	}
+	const char *names = gram_cache_get_sized(c, GRAM_CACHE_NAMES, (size_t)n->names_len);
+	const int *nt_name = gram_cache_get_sized(c, GRAM_CACHE_NT_NAME, sizeof(int) * (size_t)n->nt_count);
+	const int *term_name = gram_cache_get_sized(c, GRAM_CACHE_TERM_NAME, sizeof(int) * (size_t)n->term_count);
+	const Sym *lhs = gram_cache_get_sized(c, GRAM_CACHE_LHS, sizeof(Sym) * (size_t)n->prod_count);
+	const int *off = gram_cache_get_sized(c, GRAM_CACHE_OFF,
+										  sizeof(int) * (size_t)(n->prod_count > 0 ? n->prod_count + 1 : 0));
+	size_t rhs_size;
+	const Sym *rhs = gram_cache_get(c, GRAM_CACHE_RHS, &rhs_size);
+	if (!names || !nt_name || !term_name || !lhs || !off || !rhs || n->names_len == 0 ||
+		names[n->names_len - 1] != '\0') {
+		return false;
+	}
+
+	gram_init(g, (GramTokMode)n->mode);
+	for (int i = 0; i < n->nt_count; i++) {
+		if (nt_name[i] < 0 || nt_name[i] >= n->names_len || gram_nt(g, names + nt_name[i]) != (Sym)i) {
+			return false;
+		}
+	}
+	for (int t = 0; t < n->term_count; t++) {
+		if (term_name[t] < 0 || term_name[t] >= n->names_len ||
+			gram_term(g, names + term_name[t]) != gram_term_sym(t)) {
+			return false;
+		}
+	}
+	for (int p = 0; p < n->prod_count; p++) {
+		int start = off[p];
+		int len = off[p + 1] - start;
+		if (start < 0 || len < 0 || (size_t)(start + len) > rhs_size / sizeof(Sym) || !gram_cache_sym_ok(n, lhs[p]) ||
+			gram_is_term(lhs[p])) {
+			return false;
+		}
+		for (int i = 0; i < len; i++) {
+			if (!gram_cache_sym_ok(n, rhs[start + i])) {
+				return false;
+			}
+		}
+		if (gram_add_prod(g, lhs[p], &rhs[start], len) != p) {
+			return false;
+		}
+	}
+	/* The start symbol need not be lhs[0] once productions were removed. */
+	if (n->prod_count == 0 ? n->start != -1 : n->start < 0 || n->start >= n->nt_count) {
+		return false;
+	}
+	if (n->prod_count > 0) {
+		g->start = (Sym)n->start;
+	}
+	return true;
+}
+
+#endif
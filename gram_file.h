@@ -0,0 +1,147 @@
+#ifndef GRAM_FILE_H
+#define GRAM_FILE_H
+
+/*
+ * Non-interactive grammar loading (the -f flag of the grammar labs).
+ *
+ * The file is mapped read-only and scanned once: each line is handed to
+ * gram_parse_production in place, so nothing is copied, trimmed or split
+ * with strtok on the way. The format is the interactive one without the
+ * prompts: an optional first line with the production count, then one
+ * "A->alpha|beta" per line. Blank lines are skipped; with a count, lines
+ * after the last production are ignored. Errors carry the line and column.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "grammar.h"
+
+/* A read-only mapping of a whole file; an empty file maps to size 0. */
+typedef struct {
+	const char *data;
+	size_t size;
+	void *base;
+} GramFile;
+
+static inline bool gram_file_map(GramFile *f, const char *path) {
+	memset(f, 0, sizeof(*f));
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return false;
+	}
+	f->size = (size_t)st.st_size;
+	f->data = "";
+	if (f->size > 0) {
+		void *base = mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (base == MAP_FAILED) {
+			close(fd);
+			memset(f, 0, sizeof(*f));
+			return false;
+		}
+		f->base = base;
+		f->data = base;
+	}
+	close(fd);
+	return true;
+}
+
+static inline void gram_file_unmap(GramFile *f) {
+	if (f->base != NULL) {
+		munmap(f->base, f->size);
+	}
+	memset(f, 0, sizeof(*f));
+}
+
+static inline bool gram_load_fail(GramError *err, int line, int col, const char *msg) {
+	err->line = line;
+	err->col = col;
+	err->msg = msg;
+	return false;
+}
+
+/* Load the grammar text data[0..size) into g, which need not be NUL-terminated. */
+static inline bool gram_load_buffer(Grammar *g, const char *data, size_t size, GramError *err) {
+	long expected = -1;
+	long loaded = 0;
+	int line = 0;
+	size_t pos = 0;
+	while (pos < size && (expected < 0 || loaded < expected)) {
+		const char *start = data + pos;
+		const char *nl = memchr(start, '\n', size - pos);
+		size_t len = nl ? (size_t)(nl - start) : size - pos;
+		pos += len + 1;
+		line++;
+		if (len > (size_t)INT_MAX - 1) {
+			return gram_load_fail(err, line, 1, "line too long");
+		}
+		int n = (int)len;
+		int i = gram_skip_space(start, n, 0);
+		if (i == n) {
+			continue;
+		}
+
+		/* A first line of digits alone is the production count. */
+		if (expected < 0 && loaded == 0 && isdigit((unsigned char)start[i])) {
+			int j = i;
+			long count = 0;
+			while (j < n && isdigit((unsigned char)start[j]) && count <= INT_MAX) {
+				count = count * 10 + (start[j++] - '0');
+			}
+			if (gram_skip_space(start, n, j) == n) {
+				if (count == 0 || count > INT_MAX) {
+					return gram_load_fail(err, line, i + 1, "production count must be between 1 and INT_MAX");
+				}
+				expected = count;
+				continue;
+			}
+		}
+
+		GramError at;
+		if (!gram_parse_production(g, start, n, &at)) {
+			return gram_load_fail(err, line, at.col, at.msg);
+		}
+		loaded++;
+	}
+	if (expected > loaded) {
+		return gram_load_fail(err, line + 1, 1, "fewer productions than the count on the first line");
+	}
+	if (g->prod_count == 0) {
+		return gram_load_fail(err, line > 0 ? line : 1, 1, "no productions");
+	}
+	return true;
+}
+
+/* Map path and load it into g; on failure err->line is 0 when the file could not be read. */
+static inline bool gram_load_file(Grammar *g, const char *path, GramError *err) {
+	GramFile f;
+	if (!gram_file_map(&f, path)) {
+		return gram_load_fail(err, 0, 0, "cannot read file");
+	}
+	bool ok = gram_load_buffer(g, f.data, f.size, err);
+	gram_file_unmap(&f);
+	return ok;
+}
+
+/* "path:line:col: message" on stderr. */
+static inline void gram_print_error(const char *path, const GramError *err) {
+	if (err->line > 0) {
+		fprintf(stderr, "%s:%d:%d: %s\n", path, err->line, err->col, err->msg);
+	} else {
+		fprintf(stderr, "%s: %s\n", path, err->msg);
+	}
+}
+
+#endif
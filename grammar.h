@@ -0,0 +1,642 @@
+#ifndef GRAMMAR_H
+#define GRAMMAR_H
+
+/*
+ * Shared grammar representation for the grammar labs (task4, task5, task6,
+ * task8, task9).
+ *
+ * Symbols are interned to dense 16-bit IDs. Nonterminals are numbered
+ * 0 .. nt_count-1 and terminals GRAM_TERM_BASE + 0 .. term_count-1, so the
+ * kind of a symbol is a single bit test and either range can index arrays
+ * directly. Productions are stored as one flat array of symbol IDs with an
+ * offset table; epsilon is an empty right-hand side.
+ *
+ * Nonterminals are an uppercase letter or a bracketed name such as
+ * <expr_list>, optionally followed by primes (E', <stmt>''). All storage
+ * grows on demand; a Grammar starts with gram_init and is released with
+ * gram_free.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+
+#define GRAM_MAX_NAME 64
+#define GRAM_MAX_SYMS 0x7FFF
+
+#define GRAM_TERM_BASE 0x8000u
+#define GRAM_NO_SYM 0xFFFFu
+
+typedef uint16_t Sym;
+
+/*
+ * How right-hand sides are split into terminals: GRAM_TOK_CHAR makes every
+ * character a symbol; GRAM_TOK_WORD keeps runs of lowercase letters and
+ * digits (such as "id") together as one terminal.
+ */
+typedef enum {
+	GRAM_TOK_CHAR,
+	GRAM_TOK_WORD
+} GramTokMode;
+
+typedef struct {
+	GramTokMode mode;
+
+	/* Symbol names, NUL-terminated, packed into one pool. */
+	char *names;
+	int names_len;
+	int names_cap;
+
+	int nt_count;
+	int nt_cap;
+	int *nt_name;
+	int term_count;
+	int term_cap;
+	int *term_name;
+
+	/* Open-addressing name -> index tables, -1 marks an empty slot. */
+	int *nt_hash;
+	int nt_hash_size;
+	int *term_hash;
+	int term_hash_size;
+
+	/* Right-hand side of production p is rhs[prod_off[p] .. prod_off[p + 1]). */
+	int prod_count;
+	int lhs_cap;
+	Sym *prod_lhs;
+	int off_cap;
+	int *prod_off;
+	int rhs_cap;
+	Sym *rhs;
+
+	/*
+	 * Start symbol: the left-hand side of the first production added,
+	 * GRAM_NO_SYM until then. Removing productions never moves it.
+	 */
+	Sym start;
+
+	/* Built by gram_index: productions of A are nt_prods[nt_first[A] .. nt_first[A + 1]). */
+	int first_cap;
+	int *nt_first;
+	int prods_cap;
+	int *nt_prods;
+
+	/* Symbols of the alternative being parsed. */
+	int scratch_cap;
+	Sym *scratch;
+} Grammar;
+
+/* Why and where grammar text failed to parse; line and col count from 1. */
+typedef struct {
+	int line;
+	int col;
+	const char *msg;
+} GramError;
+
+static inline bool gram_is_term(Sym s) {
+	return (s & GRAM_TERM_BASE) != 0;
+}
+
+static inline int gram_term_index(Sym s) {
+	return (int)(s - GRAM_TERM_BASE);
+}
+
+static inline Sym gram_term_sym(int t) {
+	return (Sym)(GRAM_TERM_BASE + (unsigned)t);
+}
+
+static inline const char *gram_nt_name(const Grammar *g, int a) {
+	return g->names + g->nt_name[a];
+}
+
+static inline const char *gram_term_name(const Grammar *g, int t) {
+	return g->names + g->term_name[t];
+}
+
+static inline const char *gram_name(const Grammar *g, Sym s) {
+	return gram_is_term(s) ? gram_term_name(g, gram_term_index(s)) : gram_nt_name(g, s);
+}
+
+static inline int gram_rhs_len(const Grammar *g, int p) {
+	return g->prod_off[p + 1] - g->prod_off[p];
+}
+
+static inline const Sym *gram_rhs(const Grammar *g, int p) {
+	return &g->rhs[g->prod_off[p]];
+}
+
+static inline void *gram_grow(void *ptr, int *cap, int need, size_t elem) {
+	if (need <= *cap && ptr != NULL) {
+		return ptr;
+	}
+	int cap2 = *cap > 0 ? *cap : 64;
+	while (cap2 < need) {
+		cap2 *= 2;
+	}
+	void *p = realloc(ptr, (size_t)cap2 * elem);
+	if (p == NULL) {
+		return NULL;
+	}
+	*cap = cap2;
+	return p;
+}
+
+/* Empty grammar; does not release storage, see gram_free. */
+static inline void gram_init(Grammar *g, GramTokMode mode) {
+	memset(g, 0, sizeof(*g));
+	g->mode = mode;
+	g->start = GRAM_NO_SYM;
+}
+
+static inline void gram_free(Grammar *g) {
+	GramTokMode mode = g->mode;
+	free(g->names);
+	free(g->nt_name);
+	free(g->term_name);
+	free(g->nt_hash);
+	free(g->term_hash);
+	free(g->prod_lhs);
+	free(g->prod_off);
+	free(g->rhs);
+	free(g->nt_first);
+	free(g->nt_prods);
+	free(g->scratch);
+	gram_init(g, mode);
+}
+
+static inline int *gram_dup_ints(const int *src, int count) {
+	int *dst = malloc(sizeof(int) * (size_t)(count > 0 ? count : 1));
+	if (dst != NULL && count > 0) {
+		memcpy(dst, src, sizeof(int) * (size_t)count);
+	}
+	return dst;
+}
+
+/* Give an empty dst the symbol table of src but none of its productions. */
+static inline bool gram_copy_symbols(Grammar *dst, const Grammar *src) {
+	gram_init(dst, src->mode);
+	dst->names = malloc((size_t)(src->names_cap > 0 ? src->names_cap : 1));
+	dst->nt_name = gram_dup_ints(src->nt_name, src->nt_count);
+	dst->term_name = gram_dup_ints(src->term_name, src->term_count);
+	dst->nt_hash = gram_dup_ints(src->nt_hash, src->nt_hash_size);
+	dst->term_hash = gram_dup_ints(src->term_hash, src->term_hash_size);
+	if (!dst->names || !dst->nt_name || !dst->term_name || !dst->nt_hash || !dst->term_hash) {
+		gram_free(dst);
+		return false;
+	}
+	memcpy(dst->names, src->names, (size_t)src->names_len);
+	dst->names_len = src->names_len;
+	dst->names_cap = src->names_cap > 0 ? src->names_cap : 1;
+	dst->nt_count = dst->nt_cap = src->nt_count;
+	dst->term_count = dst->term_cap = src->term_count;
+	dst->nt_hash_size = src->nt_hash_size;
+	dst->term_hash_size = src->term_hash_size;
+	return true;
+}
+
+static inline unsigned gram_hash_name(const char *s) {
+	unsigned h = 2166136261u;
+	while (*s) {
+		h = (h ^ (unsigned char)*s++) * 16777619u;
+	}
+	return h;
+}
+
+/* Slot holding name in the nonterminal or terminal table, or the empty slot where it goes. */
+static inline int gram_hash_slot(const Grammar *g, bool term, const char *name) {
+	const int *table = term ? g->term_hash : g->nt_hash;
+	const int *offs = term ? g->term_name : g->nt_name;
+	unsigned mask = (unsigned)(term ? g->term_hash_size : g->nt_hash_size) - 1;
+	unsigned h = gram_hash_name(name) & mask;
+	while (table[h] != -1 && strcmp(g->names + offs[table[h]], name) != 0) {
+		h = (h + 1) & mask;
+	}
+	return (int)h;
+}
+
+/* Keep the table at most half full. */
+static inline bool gram_hash_reserve(Grammar *g, bool term) {
+	int count = term ? g->term_count : g->nt_count;
+	int size = term ? g->term_hash_size : g->nt_hash_size;
+	if ((count + 1) * 2 <= size) {
+		return true;
+	}
+	int size2 = size > 0 ? size * 2 : 64;
+	int *table = malloc(sizeof(int) * (size_t)size2);
+	if (table == NULL) {
+		return false;
+	}
+	for (int i = 0; i < size2; i++) {
+		table[i] = -1;
+	}
+	const int *offs = term ? g->term_name : g->nt_name;
+	for (int i = 0; i < count; i++) {
+		unsigned h = gram_hash_name(g->names + offs[i]) & (unsigned)(size2 - 1);
+		while (table[h] != -1) {
+			h = (h + 1) & (unsigned)(size2 - 1);
+		}
+		table[h] = i;
+	}
+	if (term) {
+		free(g->term_hash);
+		g->term_hash = table;
+		g->term_hash_size = size2;
+	} else {
+		free(g->nt_hash);
+		g->nt_hash = table;
+		g->nt_hash_size = size2;
+	}
+	return true;
+}
+
+static inline int gram_find_nt(const Grammar *g, const char *name) {
+	if (g->nt_hash_size == 0) {
+		return -1;
+	}
+	return g->nt_hash[gram_hash_slot(g, false, name)];
+}
+
+static inline int gram_find_term(const Grammar *g, const char *name) {
+	if (g->term_hash_size == 0) {
+		return -1;
+	}
+	return g->term_hash[gram_hash_slot(g, true, name)];
+}
+
+static inline int gram_intern(Grammar *g, bool term, const char *name) {
+	int found = term ? gram_find_term(g, name) : gram_find_nt(g, name);
+	if (found >= 0) {
+		return found;
+	}
+	int count = term ? g->term_count : g->nt_count;
+	if (count >= GRAM_MAX_SYMS || !gram_hash_reserve(g, term)) {
+		return -1;
+	}
+
+	int len = (int)strlen(name) + 1;
+	char *names = gram_grow(g->names, &g->names_cap, g->names_len + len, 1);
+	if (names == NULL) {
+		return -1;
+	}
+	g->names = names;
+	int *offs;
+	if (term) {
+		offs = gram_grow(g->term_name, &g->term_cap, count + 1, sizeof(int));
+		if (offs != NULL) {
+			g->term_name = offs;
+		}
+	} else {
+		offs = gram_grow(g->nt_name, &g->nt_cap, count + 1, sizeof(int));
+		if (offs != NULL) {
+			g->nt_name = offs;
+		}
+	}
+	if (offs == NULL) {
+		return -1;
+	}
+
+	memcpy(g->names + g->names_len, name, (size_t)len);
+	offs[count] = g->names_len;
+	g->names_len += len;
+	if (term) {
+		g->term_hash[gram_hash_slot(g, true, name)] = count;
+		g->term_count++;
+	} else {
+		g->nt_hash[gram_hash_slot(g, false, name)] = count;
+		g->nt_count++;
+	}
+	return count;
+}
+
+static inline Sym gram_nt(Grammar *g, const char *name) {
+	int i = gram_intern(g, false, name);
+	return i < 0 ? GRAM_NO_SYM : (Sym)i;
+}
+
+static inline Sym gram_term(Grammar *g, const char *name) {
+	int i = gram_intern(g, true, name);
+	return i < 0 ? GRAM_NO_SYM : gram_term_sym(i);
+}
+
+/* Append A -> rhs[0..len); returns the production index or -1 on failure. */
+static inline int gram_add_prod(Grammar *g, Sym lhs, const Sym *rhs, int len) {
+	if (lhs == GRAM_NO_SYM) {
+		return -1;
+	}
+	for (int i = 0; i < len; i++) {
+		if (rhs[i] == GRAM_NO_SYM) {
+			return -1;
+		}
+	}
+	int p = g->prod_count;
+	int start = p > 0 ? g->prod_off[p] : 0;
+	Sym *lhs_arr = gram_grow(g->prod_lhs, &g->lhs_cap, p + 1, sizeof(Sym));
+	if (lhs_arr == NULL) {
+		return -1;
+	}
+	g->prod_lhs = lhs_arr;
+	int *off = gram_grow(g->prod_off, &g->off_cap, p + 2, sizeof(int));
+	if (off == NULL) {
+		return -1;
+	}
+	g->prod_off = off;
+	Sym *rhs_arr = gram_grow(g->rhs, &g->rhs_cap, start + len, sizeof(Sym));
+	if (rhs_arr == NULL) {
+		return -1;
+	}
+	g->rhs = rhs_arr;
+
+	g->prod_lhs[p] = lhs;
+	g->prod_off[p] = start;
+	if (len > 0) {
+		memcpy(&g->rhs[start], rhs, sizeof(Sym) * (size_t)len);
+	}
+	g->prod_off[p + 1] = start + len;
+	g->prod_count++;
+	if (g->start == GRAM_NO_SYM) {
+		g->start = lhs;
+	}
+	return p;
+}
+
+/* Remove production p; later productions move down one index. Call gram_index afterwards. */
+static inline void gram_remove_prod(Grammar *g, int p) {
+	int start = g->prod_off[p];
+	int len = g->prod_off[p + 1] - start;
+	int total = g->prod_off[g->prod_count];
+	memmove(g->rhs + start, g->rhs + start + len, sizeof(Sym) * (size_t)(total - start - len));
+	for (int q = p; q + 1 < g->prod_count; q++) {
+		g->prod_lhs[q] = g->prod_lhs[q + 1];
+		g->prod_off[q + 1] = g->prod_off[q + 2] - len;
+	}
+	g->prod_count--;
+}
+
+/* Group production indices by left-hand side, keeping input order. */
+static inline bool gram_index(Grammar *g) {
+	int *first = gram_grow(g->nt_first, &g->first_cap, g->nt_count + 1, sizeof(int));
+	if (first == NULL) {
+		return false;
+	}
+	g->nt_first = first;
+	int *prods = gram_grow(g->nt_prods, &g->prods_cap, g->prod_count + 1, sizeof(int));
+	if (prods == NULL) {
+		return false;
+	}
+	g->nt_prods = prods;
+
+	/* Count each A into nt_first[A + 2]; after the prefix sum nt_first[A + 1] is A's start. */
+	for (int a = 0; a <= g->nt_count; a++) {
+		g->nt_first[a] = 0;
+	}
+	for (int p = 0; p < g->prod_count; p++) {
+		if (g->prod_lhs[p] + 2 <= g->nt_count) {
+			g->nt_first[g->prod_lhs[p] + 2]++;
+		}
+	}
+	for (int a = 1; a < g->nt_count; a++) {
+		g->nt_first[a + 1] += g->nt_first[a];
+	}
+	/* Use nt_first[A + 1] as A's fill cursor; it stops at A's end, the start of A + 1. */
+	for (int p = 0; p < g->prod_count; p++) {
+		g->nt_prods[g->nt_first[g->prod_lhs[p] + 1]++] = p;
+	}
+	return true;
+}
+
+static inline void gram_trim_spaces(char *s) {
+	char *p = s;
+	char *q = s;
+	while (*p) {
+		if (!isspace((unsigned char)*p)) {
+			*q++ = *p;
+		}
+		p++;
+	}
+	*q = '\0';
+}
+
+/*
+ * Length of the nonterminal name at text (X, <name>, either with primes),
+ * or 0. Reads at most len bytes, so text need not be NUL-terminated.
+ */
+static inline int gram_nt_token_len_n(const char *text, int len) {
+	int n = 0;
+	if (len > 0 && isupper((unsigned char)text[0])) {
+		n = 1;
+	} else if (len > 1 && text[0] == '<' && (isalpha((unsigned char)text[1]) || text[1] == '_')) {
+		n = 1;
+		while (n < len && (isalnum((unsigned char)text[n]) || text[n] == '_' || text[n] == '-')) {
+			n++;
+		}
+		if (n == len || text[n] != '>') {
+			return 0;
+		}
+		n++;
+	} else {
+		return 0;
+	}
+	while (n < len && text[n] == '\'') {
+		n++;
+	}
+	return n;
+}
+
+static inline int gram_nt_token_len(const char *text) {
+	return gram_nt_token_len_n(text, INT_MAX);
+}
+
+static inline void gram_copy_name(char *dst, const char *src, int len) {
+	if (len > GRAM_MAX_NAME - 1) {
+		len = GRAM_MAX_NAME - 1;
+	}
+	memcpy(dst, src, (size_t)len);
+	dst[len] = '\0';
+}
+
+/* Map input text to terminal indices using the same token rules; unknown tokens become -1. */
+static inline int gram_lex_input(const Grammar *g, const char *text, int *out, int max) {
+	int n = 0;
+	int i = 0;
+	while (text[i] != '\0' && n < max) {
+		char tok[GRAM_MAX_NAME];
+		unsigned char c = (unsigned char)text[i];
+		if (isspace(c)) {
+			i++;
+			continue;
+		}
+		if (g->mode == GRAM_TOK_WORD && (islower(c) || isdigit(c))) {
+			int k = 0;
+			while (islower((unsigned char)text[i + k]) || isdigit((unsigned char)text[i + k])) {
+				k++;
+			}
+			gram_copy_name(tok, text + i, k);
+			i += k;
+		} else {
+			tok[0] = text[i++];
+			tok[1] = '\0';
+		}
+		out[n++] = gram_find_term(g, tok);
+	}
+	return n;
+}
+
+static inline int gram_skip_space(const char *text, int len, int i) {
+	while (i < len && isspace((unsigned char)text[i])) {
+		i++;
+	}
+	return i;
+}
+
+static inline bool gram_fail(GramError *err, int col, const char *msg) {
+	err->col = col + 1;
+	err->msg = msg;
+	return false;
+}
+
+/*
+ * Symbols of the alternative text[0..len) into out (room for len); spaces
+ * between symbols are skipped and "eps" alone is the empty sequence.
+ */
+static inline int gram_scan_alt(Grammar *g, const char *text, int len, Sym *out) {
+	int i = gram_skip_space(text, len, 0);
+	int end = len;
+	while (end > i && isspace((unsigned char)text[end - 1])) {
+		end--;
+	}
+	if (end - i == 3 && memcmp(text + i, "eps", 3) == 0) {
+		return 0;
+	}
+
+	int n = 0;
+	char tok[GRAM_MAX_NAME];
+	while (i < end) {
+		unsigned char c = (unsigned char)text[i];
+		int nt_len = gram_nt_token_len_n(text + i, end - i);
+		if (isspace(c)) {
+			i++;
+		} else if (nt_len > 0) {
+			gram_copy_name(tok, text + i, nt_len);
+			i += nt_len;
+			out[n++] = gram_nt(g, tok);
+		} else if (g->mode == GRAM_TOK_WORD && (islower(c) || isdigit(c))) {
+			int k = 0;
+			while (i + k < end && (islower((unsigned char)text[i + k]) || isdigit((unsigned char)text[i + k]))) {
+				k++;
+			}
+			gram_copy_name(tok, text + i, k);
+			i += k;
+			out[n++] = gram_term(g, tok);
+		} else {
+			tok[0] = text[i++];
+			tok[1] = '\0';
+			out[n++] = gram_term(g, tok);
+		}
+	}
+	return n;
+}
+
+/*
+ * Parse one production "A->alpha|beta|..." from text[0..len) in a single
+ * pass, without copying or modifying the text. Empty alternatives are
+ * skipped; write eps for an empty right-hand side. On failure err gets
+ * the column and a message.
+ */
+static inline bool gram_parse_production(Grammar *g, const char *text, int len, GramError *err) {
+	int i = gram_skip_space(text, len, 0);
+	int lhs_len = gram_nt_token_len_n(text + i, len - i);
+	if (lhs_len == 0) {
+		return gram_fail(err, i, "expected a nonterminal such as A or <name>");
+	}
+	int arrow = gram_skip_space(text, len, i + lhs_len);
+	if (len - arrow < 2 || text[arrow] != '-' || text[arrow + 1] != '>') {
+		return gram_fail(err, arrow, "expected ->");
+	}
+	int rhs = gram_skip_space(text, len, arrow + 2);
+	if (rhs == len) {
+		return gram_fail(err, rhs, "expected a right-hand side (eps for an empty one)");
+	}
+	Sym *syms = gram_grow(g->scratch, &g->scratch_cap, len, sizeof(Sym));
+	if (syms == NULL) {
+		return gram_fail(err, i, "out of memory");
+	}
+	g->scratch = syms;
+
+	char name[GRAM_MAX_NAME];
+	gram_copy_name(name, text + i, lhs_len);
+	Sym lhs = gram_nt(g, name);
+	for (int alt = rhs; alt < len;) {
+		const char *bar = memchr(text + alt, '|', (size_t)(len - alt));
+		int alt_end = bar ? (int)(bar - text) : len;
+		if (gram_skip_space(text, alt_end, alt) < alt_end) {
+			int n = gram_scan_alt(g, text + alt, alt_end - alt, syms);
+			if (gram_add_prod(g, lhs, syms, n) < 0) {
+				return gram_fail(err, alt, "too many symbols");
+			}
+		}
+		alt = alt_end + 1;
+	}
+	return true;
+}
+
+/* Parse "A->alpha|beta|..." into productions. */
+static inline bool gram_parse_line(Grammar *g, const char *line) {
+	GramError err;
+	return gram_parse_production(g, line, (int)strlen(line), &err);
+}
+
+/* Right-hand side as text: symbol names run together, "eps" when empty. */
+static inline const char *gram_format_rhs(const Grammar *g, const Sym *rhs, int len,
+										  char *buf, size_t size) {
+	size_t used = 0;
+	buf[0] = '\0';
+	if (len == 0) {
+		snprintf(buf, size, "eps");
+		return buf;
+	}
+	for (int i = 0; i < len && used + 1 < size; i++) {
+		int w = snprintf(buf + used, size - used, "%s", gram_name(g, rhs[i]));
+		if (w < 0) {
+			break;
+		}
+		used += (size_t)w;
+	}
+	return buf;
+}
+
+static inline void gram_print_rhs(const Grammar *g, int p) {
+	int len = gram_rhs_len(g, p);
+	if (len == 0) {
+		printf("eps");
+	}
+	for (int i = 0; i < len; i++) {
+		printf("%s", gram_name(g, gram_rhs(g, p)[i]));
+	}
+}
+
+/* Print every nonterminal with productions as "A -> x | y"; needs gram_index. */
+static inline void gram_print(const Grammar *g, const char *title) {
+	printf("%s\n", title);
+	for (int a = 0; a < g->nt_count; a++) {
+		int first = g->nt_first[a];
+		int last = g->nt_first[a + 1];
+		if (first == last) {
+			continue;
+		}
+		printf("%s -> ", gram_nt_name(g, a));
+		for (int k = first; k < last; k++) {
+			if (k > first) {
+				printf(" | ");
+			}
+			gram_print_rhs(g, g->nt_prods[k]);
+		}
+		printf("\n");
+	}
+	printf("\n");
+}
+
+#endif
@@ -0,0 +1,491 @@
+#ifndef LLK_H
+#define LLK_H
+
+/*
+ * Strong LL(k) lookahead for small k (task6), used where the LL(1) table
+ * has conflicts.
+ *
+ * FIRST_k and FOLLOW_k are sets of terminal strings of length up to k,
+ * stored as tries in one shared node pool. A node is a bitset in the
+ * first_follow.h layout: bit 0 says a string ends here, bit t + 1 that a
+ * string continues with terminal t. Below depth k - 1, and after $, no
+ * child is kept, so strings are cut to k terminals as they are built. Only
+ * prefixes that occur get a node, instead of a bit for every possible
+ * k-tuple. Children are found through one hash of (node, terminal) edges.
+ *
+ * Decisions are rows of int16 cells, one column per terminal, as in the
+ * LL(1) table: a production, LLK_EMPTY, LLK_CONFLICT, or a reference to
+ * the row that looks at the next token. Only nonterminals with LL(1)
+ * conflicts get rows. Each one uses the smallest k that resolves it, and a
+ * cell that one token already decides stays a single lookup.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "grammar.h"
+#include "first_follow.h"
+
+#define LLK_MAX 3
+#define LLK_EMPTY (-1)
+#define LLK_CONFLICT (-2)
+/* Cell values at or below this refer to row LLK_ROW_REF - v. */
+#define LLK_ROW_REF (-3)
+
+typedef struct {
+	int k;
+	int words;
+	int dollar;
+	int count;
+	int cap;
+	uint64_t *bits;
+
+	/* Edge (node, t) is stored as (node << 16 | t) + 1; 0 marks a free slot. */
+	uint64_t *edge_key;
+	int *edge_child;
+	int edge_count;
+	int edge_cap;
+	bool failed;
+} LlkTrie;
+
+static inline void llk_trie_free(LlkTrie *tr) {
+	free(tr->bits);
+	free(tr->edge_key);
+	free(tr->edge_child);
+	memset(tr, 0, sizeof(*tr));
+}
+
+static inline void llk_trie_init(LlkTrie *tr, int k, int term_count, int dollar) {
+	memset(tr, 0, sizeof(*tr));
+	tr->k = k;
+	tr->words = (term_count + 1 + 63) / 64;
+	tr->dollar = dollar;
+}
+
+static inline uint64_t *llk_bits(const LlkTrie *tr, int node) {
+	return tr->bits + (size_t)node * (size_t)tr->words;
+}
+
+/* A new empty node, or -1 (and tr->failed) when out of memory. */
+static inline int llk_node(LlkTrie *tr) {
+	uint64_t *grown = gram_grow(tr->bits, &tr->cap, tr->count + 1, sizeof(uint64_t) * (size_t)tr->words);
+	if (!grown) {
+		tr->failed = true;
+		return -1;
+	}
+	tr->bits = grown;
+	memset(llk_bits(tr, tr->count), 0, sizeof(uint64_t) * (size_t)tr->words);
+	return tr->count++;
+}
+
+static inline size_t llk_edge_slot(const LlkTrie *tr, uint64_t key) {
+	uint64_t h = key * 0x9e3779b97f4a7c15ull;
+	size_t i = (size_t)(h >> 32) & (size_t)(tr->edge_cap - 1);
+	while (tr->edge_key[i] != 0 && tr->edge_key[i] != key) {
+		i = (i + 1) & (size_t)(tr->edge_cap - 1);
+	}
+	return i;
+}
+
+static inline int llk_child(const LlkTrie *tr, int node, int t) {
+	if (tr->edge_cap == 0) {
+		return -1;
+	}
+	size_t i = llk_edge_slot(tr, ((uint64_t)node << 16 | (uint64_t)t) + 1);
+	return tr->edge_key[i] != 0 ? tr->edge_child[i] : -1;
+}
+
+/* Double the edge hash, keeping it at most half full. */
+static inline bool llk_edges_grow(LlkTrie *tr) {
+	LlkTrie old = *tr;
+	tr->edge_cap = old.edge_cap > 0 ? old.edge_cap * 2 : 16;
+	tr->edge_key = calloc((size_t)tr->edge_cap, sizeof(uint64_t));
+	tr->edge_child = malloc(sizeof(int) * (size_t)tr->edge_cap);
+	if (!tr->edge_key || !tr->edge_child) {
+		free(tr->edge_key);
+		free(tr->edge_child);
+		tr->edge_key = old.edge_key;
+		tr->edge_child = old.edge_child;
+		tr->edge_cap = old.edge_cap;
+		return false;
+	}
+	for (int i = 0; i < old.edge_cap; i++) {
+		if (old.edge_key[i] != 0) {
+			size_t j = llk_edge_slot(tr, old.edge_key[i]);
+			tr->edge_key[j] = old.edge_key[i];
+			tr->edge_child[j] = old.edge_child[i];
+		}
+	}
+	free(old.edge_key);
+	free(old.edge_child);
+	return true;
+}
+
+/*
+ * Add terminal t under node, which sits at depth d. Returns the child for
+ * what follows t, or -1 where strings are cut (depth k, or t is $).
+ */
+static inline int llk_add_term(LlkTrie *tr, int node, int d, int t, bool *changed) {
+	*changed |= ff_add(llk_bits(tr, node), t + 1);
+	if (d + 1 >= tr->k || t == tr->dollar || tr->failed) {
+		return -1;
+	}
+	int child = llk_child(tr, node, t);
+	if (child >= 0) {
+		return child;
+	}
+	if (2 * (tr->edge_count + 1) > tr->edge_cap && !llk_edges_grow(tr)) {
+		tr->failed = true;
+		return -1;
+	}
+	child = llk_node(tr);
+	if (child < 0) {
+		return -1;
+	}
+	size_t i = llk_edge_slot(tr, ((uint64_t)node << 16 | (uint64_t)t) + 1);
+	tr->edge_key[i] = ((uint64_t)node << 16 | (uint64_t)t) + 1;
+	tr->edge_child[i] = child;
+	tr->edge_count++;
+	*changed = true;
+	return child;
+}
+
+/* Union the strings below src into dst (depth d); src < 0 is the empty string. */
+static inline bool llk_graft(LlkTrie *tr, int dst, int d, int src) {
+	bool changed = false;
+	if (src < 0 || ff_test(llk_bits(tr, src), FF_EPS)) {
+		changed |= ff_add(llk_bits(tr, dst), FF_EPS);
+	}
+	for (int w = 0; src >= 0 && w < tr->words; w++) {
+		uint64_t bits = llk_bits(tr, src)[w] & (w == 0 ? ~(uint64_t)1 : ~(uint64_t)0);
+		while (bits) {
+			int t = w * 64 + __builtin_ctzll(bits) - 1;
+			int child = llk_add_term(tr, dst, d, t, &changed);
+			int next = child >= 0 ? llk_child(tr, src, t) : -1;
+			if (next >= 0) {
+				changed |= llk_graft(tr, child, d + 1, next);
+			}
+			bits &= bits - 1;
+		}
+	}
+	return changed;
+}
+
+static inline bool llk_walk(LlkTrie *tr, const int *first, int f, int dst, int d, const Sym *seq, int len, int tail);
+
+/*
+ * Add FIRST_k(seq tail) into dst at depth d, where first[] holds the
+ * FIRST_k tries so far and tail is a trie (< 0 for the empty string).
+ */
+static inline bool llk_add_seq(LlkTrie *tr, const int *first, int dst, int d, const Sym *seq, int len, int tail) {
+	if (len == 0) {
+		return llk_graft(tr, dst, d, tail);
+	}
+	if (!gram_is_term(seq[0])) {
+		return llk_walk(tr, first, first[seq[0]], dst, d, seq + 1, len - 1, tail);
+	}
+	bool changed = false;
+	int child = llk_add_term(tr, dst, d, gram_term_index(seq[0]), &changed);
+	if (child >= 0) {
+		changed |= llk_add_seq(tr, first, child, d + 1, seq + 1, len - 1, tail);
+	}
+	return changed;
+}
+
+/* Copy the strings below f into dst; where one of them ends, continue with seq. */
+static inline bool llk_walk(LlkTrie *tr, const int *first, int f, int dst, int d, const Sym *seq, int len, int tail) {
+	bool changed = false;
+	if (ff_test(llk_bits(tr, f), FF_EPS)) {
+		changed |= llk_add_seq(tr, first, dst, d, seq, len, tail);
+	}
+	for (int w = 0; w < tr->words; w++) {
+		uint64_t bits = llk_bits(tr, f)[w] & (w == 0 ? ~(uint64_t)1 : ~(uint64_t)0);
+		while (bits) {
+			int t = w * 64 + __builtin_ctzll(bits) - 1;
+			int child = llk_add_term(tr, dst, d, t, &changed);
+			int next = child >= 0 ? llk_child(tr, f, t) : -1;
+			if (next >= 0) {
+				changed |= llk_walk(tr, first, next, child, d + 1, seq, len, tail);
+			}
+			bits &= bits - 1;
+		}
+	}
+	return changed;
+}
+
+/* FIRST_k and FOLLOW_k of every nonterminal, as roots in one trie pool. */
+typedef struct {
+	LlkTrie trie;
+	int nt_count;
+	int *first;
+	int *follow;
+} LlkSets;
+
+static inline void llk_sets_free(LlkSets *ls) {
+	llk_trie_free(&ls->trie);
+	free(ls->first);
+	free(ls->follow);
+	memset(ls, 0, sizeof(*ls));
+}
+
+/*
+ * Round-robin to a fixpoint, as the textbook equations: FIRST_k(A) takes
+ * FIRST_k of each right-hand side, FOLLOW_k(B) takes FIRST_k(beta
+ * FOLLOW_k(A)) for each A -> alpha B beta, and FOLLOW_k(start) holds $.
+ * Tries only grow, so this ends.
+ */
+static inline bool llk_compute_sets(LlkSets *ls, const Grammar *g, int k, int start, int dollar) {
+	memset(ls, 0, sizeof(*ls));
+	llk_trie_init(&ls->trie, k, g->term_count, dollar);
+	ls->nt_count = g->nt_count;
+	ls->first = malloc(sizeof(int) * (size_t)(g->nt_count > 0 ? g->nt_count : 1));
+	ls->follow = malloc(sizeof(int) * (size_t)(g->nt_count > 0 ? g->nt_count : 1));
+	if (!ls->first || !ls->follow) {
+		llk_sets_free(ls);
+		return false;
+	}
+	LlkTrie *tr = &ls->trie;
+	for (int A = 0; A < g->nt_count; A++) {
+		ls->first[A] = llk_node(tr);
+		ls->follow[A] = llk_node(tr);
+	}
+
+	bool changed = true;
+	while (changed && !tr->failed) {
+		changed = false;
+		for (int p = 0; p < g->prod_count; p++) {
+			changed |= llk_add_seq(tr, ls->first, ls->first[g->prod_lhs[p]], 0, gram_rhs(g, p), gram_rhs_len(g, p), -1);
+		}
+	}
+
+	if (!tr->failed) {
+		bool grew = false;
+		llk_add_term(tr, ls->follow[start], 0, dollar, &grew);
+	}
+	changed = true;
+	while (changed && !tr->failed) {
+		changed = false;
+		for (int p = 0; p < g->prod_count; p++) {
+			const Sym *rhs = gram_rhs(g, p);
+			int len = gram_rhs_len(g, p);
+			for (int i = 0; i < len; i++) {
+				if (!gram_is_term(rhs[i])) {
+					changed |= llk_add_seq(tr, ls->first, ls->follow[rhs[i]], 0, rhs + i + 1, len - i - 1,
+										   ls->follow[g->prod_lhs[p]]);
+				}
+			}
+		}
+	}
+	if (tr->failed) {
+		llk_sets_free(ls);
+		return false;
+	}
+	return true;
+}
+
+typedef struct {
+	int cols;
+	int rows;
+	int row_cap;
+	int16_t *next;
+
+	/* Per nonterminal: its first decision row (-1 if LL(1)) and the k it uses (0 if none up to max_k). */
+	int *root;
+	int *k;
+
+	int max_k;
+	int cells;
+	int resolved;
+
+	/* Trie pool for the deepest k tried, for comparison with flat bitsets of k-tuples. */
+	int trie_k;
+	int trie_nodes;
+	size_t trie_bytes;
+} LlkTable;
+
+static inline void llk_table_free(LlkTable *lt) {
+	free(lt->next);
+	free(lt->root);
+	free(lt->k);
+	memset(lt, 0, sizeof(*lt));
+}
+
+static inline int16_t *llk_row(const LlkTable *lt, int row) {
+	return lt->next + (size_t)row * (size_t)lt->cols;
+}
+
+/* Candidates for one cell: production prods[i], whose lookahead continues below trie node nodes[i]. */
+typedef struct {
+	int count;
+	int *prods;
+	int *nodes;
+} LlkCands;
+
+/*
+ * Append the decision row for cands at depth d and return its index, or
+ * -1 when out of memory. *unresolved counts the cells of the row at depth
+ * 0 that still have a conflict somewhere below them.
+ */
+static inline int llk_build_row(LlkTable *lt, const LlkTrie *tr, const LlkCands *cands, int d, int *unresolved) {
+	if (lt->rows - LLK_ROW_REF >= INT16_MAX) {
+		return -1;
+	}
+	int16_t *grown = gram_grow(lt->next, &lt->row_cap, lt->rows + 1, sizeof(int16_t) * (size_t)lt->cols);
+	LlkCands sub;
+	sub.prods = malloc(sizeof(int) * (size_t)cands->count);
+	sub.nodes = malloc(sizeof(int) * (size_t)cands->count);
+	if (!grown || !sub.prods || !sub.nodes) {
+		free(sub.prods);
+		free(sub.nodes);
+		return -1;
+	}
+	lt->next = grown;
+	int row = lt->rows++;
+
+	int ok = row;
+	for (int t = 0; t < lt->cols && ok >= 0; t++) {
+		sub.count = 0;
+		for (int i = 0; i < cands->count; i++) {
+			if (ff_has_term(llk_bits(tr, cands->nodes[i]), t)) {
+				sub.prods[sub.count] = cands->prods[i];
+				sub.nodes[sub.count++] = llk_child(tr, cands->nodes[i], t);
+			}
+		}
+		int v = sub.count == 0 ? LLK_EMPTY : sub.prods[0];
+		int leaves = 0;
+		if (sub.count > 1 && sub.nodes[0] >= 0) {
+			int child = llk_build_row(lt, tr, &sub, d + 1, &leaves);
+			v = child >= 0 ? LLK_ROW_REF - child : LLK_EMPTY;
+			ok = child;
+		} else if (sub.count > 1) {
+			v = LLK_CONFLICT;
+			leaves = 1;
+		}
+		*unresolved += d == 0 ? leaves > 0 : leaves;
+		llk_row(lt, row)[t] = (int16_t)v;
+	}
+	free(sub.prods);
+	free(sub.nodes);
+	return ok >= 0 ? row : -1;
+}
+
+/*
+ * Lookahead rows for nonterminal A from the k-sets: each production
+ * predicts FIRST_k(rhs FOLLOW_k(A)). Returns the number of cells still
+ * in conflict at depth k, or -1 when out of memory.
+ */
+static inline int llk_build_nt(LlkTable *lt, LlkSets *ls, const Grammar *g, int A) {
+	LlkCands cands;
+	int n = g->nt_first[A + 1] - g->nt_first[A];
+	cands.count = n;
+	cands.prods = malloc(sizeof(int) * (size_t)(n > 0 ? n : 1));
+	cands.nodes = malloc(sizeof(int) * (size_t)(n > 0 ? n : 1));
+	bool ok = cands.prods && cands.nodes;
+	for (int i = 0; i < n && ok; i++) {
+		int p = g->nt_prods[g->nt_first[A] + i];
+		cands.prods[i] = p;
+		cands.nodes[i] = llk_node(&ls->trie);
+		ok = cands.nodes[i] >= 0;
+		if (ok) {
+			llk_add_seq(&ls->trie, ls->first, cands.nodes[i], 0, gram_rhs(g, p), gram_rhs_len(g, p), ls->follow[A]);
+			ok = !ls->trie.failed;
+		}
+	}
+	int unresolved = 0;
+	if (ok) {
+		lt->root[A] = llk_build_row(lt, &ls->trie, &cands, 0, &unresolved);
+		ok = lt->root[A] >= 0;
+	}
+	free(cands.prods);
+	free(cands.nodes);
+	return ok ? unresolved : -1;
+}
+
+/*
+ * Decide every nonterminal whose row of the LL(1) table ll1 (row-major,
+ * LLK_CONFLICT in clashing cells) has a conflict, trying k = 2 up to max_k
+ * and keeping for each the first k that resolves all of its cells. Rows
+ * for a k that fell short are dropped before the next try. Needs gram_index.
+ */
+static inline bool llk_build(LlkTable *lt, const Grammar *g, const int16_t *ll1, int max_k, int start, int dollar) {
+	llk_table_free(lt);
+	lt->cols = g->term_count;
+	lt->max_k = max_k < LLK_MAX ? max_k : LLK_MAX;
+	lt->root = malloc(sizeof(int) * (size_t)(g->nt_count > 0 ? g->nt_count : 1));
+	lt->k = malloc(sizeof(int) * (size_t)(g->nt_count > 0 ? g->nt_count : 1));
+	if (!lt->root || !lt->k) {
+		llk_table_free(lt);
+		return false;
+	}
+	int pending = 0;
+	int unresolved_cells = 0;
+	for (int A = 0; A < g->nt_count; A++) {
+		int cells = 0;
+		for (int t = 0; t < g->term_count; t++) {
+			cells += ll1[(size_t)A * (size_t)g->term_count + (size_t)t] == LLK_CONFLICT;
+		}
+		lt->root[A] = -1;
+		lt->k[A] = cells > 0 ? 0 : 1;
+		lt->cells += cells;
+		pending += cells > 0;
+	}
+
+	for (int k = 2; k <= lt->max_k && pending > 0; k++) {
+		LlkSets ls;
+		if (!llk_compute_sets(&ls, g, k, start, dollar)) {
+			llk_table_free(lt);
+			return false;
+		}
+		for (int A = 0; A < g->nt_count; A++) {
+			if (lt->k[A] != 0) {
+				continue;
+			}
+			int rows = lt->rows;
+			int unresolved = llk_build_nt(lt, &ls, g, A);
+			if (unresolved < 0) {
+				llk_sets_free(&ls);
+				llk_table_free(lt);
+				return false;
+			}
+			if (unresolved == 0) {
+				lt->k[A] = k;
+				pending--;
+			} else if (k == lt->max_k) {
+				unresolved_cells += unresolved;
+			} else {
+				lt->rows = rows;
+				lt->root[A] = -1;
+			}
+		}
+		lt->trie_k = k;
+		lt->trie_nodes = ls.trie.count;
+		lt->trie_bytes = (size_t)ls.trie.count * (size_t)ls.trie.words * sizeof(uint64_t) +
+						 (size_t)ls.trie.edge_cap * (sizeof(uint64_t) + sizeof(int));
+		llk_sets_free(&ls);
+	}
+
+	lt->resolved = lt->max_k >= 2 ? lt->cells - unresolved_cells : 0;
+	return true;
+}
+
+/*
+ * Production for A with lookahead la[0..n), or LLK_EMPTY / LLK_CONFLICT.
+ * A must have rows (lt->root[A] >= 0).
+ */
+static inline int llk_predict(const LlkTable *lt, int A, const int *la, int n) {
+	int row = lt->root[A];
+	int v = LLK_EMPTY;
+	for (int i = 0; i < n && row >= 0; i++) {
+		if (la[i] < 0) {
+			return LLK_EMPTY;
+		}
+		v = llk_row(lt, row)[la[i]];
+		row = v <= LLK_ROW_REF ? LLK_ROW_REF - v : -1;
+	}
+	return row >= 0 ? LLK_EMPTY : v;
+}
+
+#endif
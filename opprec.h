@@ -0,0 +1,550 @@
+#ifndef OPPREC_H
+#define OPPREC_H
+
+/*
+ * Operator-precedence analysis and parsing (task7, task8).
+ *
+ * LEADING(A) holds the terminals that can be the first terminal of a
+ * string derived from A, TRAILING(A) the last. Both are bitset rows solved
+ * with the first_follow.h constraint solver. From them every pair of
+ * terminals (with $ as one of them) gets one of the relations <., =.
+ * and .>, stored as one byte per pair. When the relation graph has no
+ * cycle the matrix is also compressed into precedence functions f and g,
+ * one integer per terminal each: a <. b iff f(a) < g(b), a =. b iff
+ * f(a) == g(b), a .> b iff f(a) > g(b). Functions cannot represent blank
+ * cells, so a parser using them reports some errors later, when no
+ * production matches the handle.
+ *
+ * The parser is the usual shift-reduce driver: shift while the topmost
+ * terminal on the stack <. or =. the lookahead, otherwise pop the handle
+ * back to the last <. and reduce it by the production whose right-hand
+ * side has the same terminals, with nonterminals as wildcards.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "grammar.h"
+#include "first_follow.h"
+
+enum {
+	OP_NONE,
+	OP_LT,
+	OP_EQ,
+	OP_GT
+};
+
+/* Rows of word-packed bitsets in the first_follow.h layout: terminal t is bit t + 1. */
+typedef struct {
+	int nt_count;
+	int term_count;
+	int words;
+	uint64_t *leading;
+	uint64_t *trailing;
+} OpSets;
+
+/* Relations between terminals, rel[a * n + b] for a on the stack and b ahead. */
+typedef struct {
+	int n;
+	int dollar;
+	uint8_t *rel;
+	int conflicts;
+	bool operator_grammar;
+	bool has_funcs;
+	int *f;
+	int *g;
+
+	/* Handle skeleton -> production, open addressing, -1 marks an empty slot. */
+	int *handle_hash;
+	int handle_hash_size;
+	int handle_clashes;
+} OpTable;
+
+typedef struct {
+	Sym *stack;
+	int cap;
+	int depth;
+	int error_pos;
+} OpParser;
+
+#define OP_SHIFT (-1)
+#define OP_ACCEPT (-2)
+#define OP_REJECT (-3)
+
+/*
+ * Called after each action (OP_SHIFT, OP_ACCEPT, OP_REJECT or the
+ * production reduced) with the stack as it left it and ip still at the
+ * token it looked at.
+ */
+typedef void (*OpStepFn)(void *ctx, const OpParser *ps, int ip, int action);
+
+static inline uint64_t *op_row(const OpSets *s, uint64_t *set, int A) {
+	return set + (size_t)A * (size_t)s->words;
+}
+
+static inline void op_sets_free(OpSets *s) {
+	free(s->leading);
+	free(s->trailing);
+	memset(s, 0, sizeof(*s));
+}
+
+/*
+ * Seeds and "starts with" edges for one side: LEADING(A) gets the first
+ * terminal of each right-hand side, or the second when the first symbol
+ * is a nonterminal B, plus an edge A -> B meaning LEADING(A) includes
+ * LEADING(B). TRAILING is the mirror image from the right.
+ */
+static inline bool op_sets_graph(const Grammar *g, const OpSets *s, uint64_t *set, bool from_left, FfGraph *gr) {
+	for (int p = 0; p < g->prod_count; p++) {
+		int A = g->prod_lhs[p];
+		const Sym *rhs = gram_rhs(g, p);
+		int len = gram_rhs_len(g, p);
+		if (len == 0) {
+			continue;
+		}
+		Sym x = from_left ? rhs[0] : rhs[len - 1];
+		Sym y = from_left ? rhs[len > 1 ? 1 : 0] : rhs[len > 1 ? len - 2 : 0];
+		if (gram_is_term(x)) {
+			ff_add(op_row(s, set, A), gram_term_index(x) + 1);
+			continue;
+		}
+		if (x != A && !ff_graph_edge(gr, A, x)) {
+			return false;
+		}
+		if (len > 1 && gram_is_term(y)) {
+			ff_add(op_row(s, set, A), gram_term_index(y) + 1);
+		}
+	}
+	return true;
+}
+
+/*
+ * LEADING and TRAILING as the closure of the "starts with" ("ends with")
+ * graph: one pass over the productions for seeds and edges, then
+ * ff_solve unions whole rows once per member and edge of each component.
+ */
+static inline bool op_compute_sets(const Grammar *g, OpSets *s) {
+	size_t rows = (size_t)(g->nt_count > 0 ? g->nt_count : 1);
+	op_sets_free(s);
+	s->nt_count = g->nt_count;
+	s->term_count = g->term_count;
+	s->words = (g->term_count + 1 + 63) / 64;
+	s->leading = calloc(rows * (size_t)s->words, sizeof(uint64_t));
+	s->trailing = calloc(rows * (size_t)s->words, sizeof(uint64_t));
+	if (!s->leading || !s->trailing) {
+		op_sets_free(s);
+		return false;
+	}
+	bool ok = true;
+	for (int side = 0; ok && side < 2; side++) {
+		uint64_t *set = side == 0 ? s->leading : s->trailing;
+		FfGraph gr;
+		if (!ff_graph_init(&gr, g->nt_count)) {
+			ok = false;
+			break;
+		}
+		ok = op_sets_graph(g, s, set, side == 0, &gr) && ff_graph_finish(&gr) && ff_solve(&gr, set, s->words);
+		ff_graph_free(&gr);
+	}
+	if (!ok) {
+		op_sets_free(s);
+	}
+	return ok;
+}
+
+/* Every terminal in row A of set, as a terminal index in *t; iterate while it returns true. */
+static inline bool op_next_term(const OpSets *s, uint64_t *set, int A, int *t) {
+	const uint64_t *row = op_row(s, set, A);
+	for (int bit = *t + 2; bit < s->words * 64; bit = (bit | 63) + 1) {
+		uint64_t w = row[bit >> 6] >> (bit & 63);
+		if (w != 0) {
+			*t = bit + __builtin_ctzll(w) - 1;
+			return true;
+		}
+	}
+	return false;
+}
+
+static inline void op_table_free(OpTable *t) {
+	free(t->rel);
+	free(t->f);
+	free(t->g);
+	free(t->handle_hash);
+	memset(t, 0, sizeof(*t));
+}
+
+static inline void op_set_rel(OpTable *t, int a, int b, uint8_t r) {
+	uint8_t *cell = &t->rel[(size_t)a * (size_t)t->n + (size_t)b];
+	if (*cell == OP_NONE) {
+		*cell = r;
+	} else if (*cell != r) {
+		t->conflicts++;
+	}
+}
+
+static inline uint8_t op_rel(const OpTable *t, int a, int b) {
+	if (t->has_funcs) {
+		return t->f[a] < t->g[b] ? OP_LT : t->f[a] == t->g[b] ? OP_EQ : OP_GT;
+	}
+	return t->rel[(size_t)a * (size_t)t->n + (size_t)b];
+}
+
+static inline int op_find(int *parent, int x) {
+	while (parent[x] != x) {
+		parent[x] = parent[parent[x]];
+		x = parent[x];
+	}
+	return x;
+}
+
+/*
+ * Precedence functions by longest paths: f(a) and g(b) share a node when
+ * a =. b, a .> b is an edge f(a) -> g(b) and a <. b an edge g(b) -> f(a).
+ * Fails (has_funcs stays false) when the graph has a cycle.
+ */
+static inline bool op_build_funcs(OpTable *t) {
+	int n = t->n;
+	int nodes = 2 * n;
+	int *parent = malloc(sizeof(int) * (size_t)nodes);
+	int *off = calloc((size_t)nodes + 1, sizeof(int));
+	int *indeg = calloc((size_t)nodes, sizeof(int));
+	int *order = malloc(sizeof(int) * (size_t)nodes);
+	int *val = calloc((size_t)nodes, sizeof(int));
+	int *to = NULL;
+	bool ok = parent && off && indeg && order && val;
+	for (int x = 0; ok && x < nodes; x++) {
+		parent[x] = x;
+	}
+	for (int a = 0; ok && a < n; a++) {
+		for (int b = 0; b < n; b++) {
+			if (t->rel[(size_t)a * (size_t)n + (size_t)b] == OP_EQ) {
+				parent[op_find(parent, a)] = op_find(parent, n + b);
+			}
+		}
+	}
+
+	/* Edges between representatives in CSR form: count, then place. */
+	int edges = 0;
+	for (int pass = 0; ok && pass < 2; pass++) {
+		for (int a = 0; a < n; a++) {
+			for (int b = 0; b < n; b++) {
+				uint8_t r = t->rel[(size_t)a * (size_t)n + (size_t)b];
+				if (r != OP_LT && r != OP_GT) {
+					continue;
+				}
+				int u = op_find(parent, r == OP_GT ? a : n + b);
+				int v = op_find(parent, r == OP_GT ? n + b : a);
+				if (pass == 0) {
+					off[u + 1]++;
+					edges++;
+				} else {
+					to[indeg[u]++] = v;
+				}
+			}
+		}
+		if (pass == 0) {
+			for (int x = 0; x < nodes; x++) {
+				off[x + 1] += off[x];
+			}
+			to = malloc(sizeof(int) * (size_t)(edges > 0 ? edges : 1));
+			ok = to != NULL;
+			for (int x = 0; ok && x < nodes; x++) {
+				indeg[x] = off[x];
+			}
+		}
+	}
+
+	/* Kahn's order over the representatives; a leftover node means a cycle. */
+	int count = 0;
+	int reps = 0;
+	if (ok) {
+		memset(indeg, 0, sizeof(int) * (size_t)nodes);
+		for (int e = 0; e < edges; e++) {
+			indeg[to[e]]++;
+		}
+		for (int x = 0; x < nodes; x++) {
+			if (op_find(parent, x) == x) {
+				reps++;
+				if (indeg[x] == 0) {
+					order[count++] = x;
+				}
+			}
+		}
+		for (int i = 0; i < count; i++) {
+			int u = order[i];
+			for (int e = off[u]; e < off[u + 1]; e++) {
+				if (--indeg[to[e]] == 0) {
+					order[count++] = to[e];
+				}
+			}
+		}
+	}
+	if (ok && count == reps) {
+		for (int i = count - 1; i >= 0; i--) {
+			int u = order[i];
+			for (int e = off[u]; e < off[u + 1]; e++) {
+				if (val[to[e]] + 1 > val[u]) {
+					val[u] = val[to[e]] + 1;
+				}
+			}
+		}
+		t->f = malloc(sizeof(int) * (size_t)n);
+		t->g = malloc(sizeof(int) * (size_t)n);
+		ok = t->f && t->g;
+		for (int a = 0; ok && a < n; a++) {
+			t->f[a] = val[op_find(parent, a)];
+			t->g[a] = val[op_find(parent, n + a)];
+		}
+		t->has_funcs = ok;
+	}
+	free(parent);
+	free(off);
+	free(indeg);
+	free(order);
+	free(val);
+	free(to);
+	return ok;
+}
+
+/* Hash of a handle: its length and terminals, with every nonterminal as one wildcard. */
+static inline uint32_t op_skeleton_hash(const Sym *syms, int len) {
+	uint32_t h = 2166136261u ^ (uint32_t)len;
+	for (int i = 0; i < len; i++) {
+		h = (h ^ (gram_is_term(syms[i]) ? syms[i] : 0u)) * 16777619u;
+	}
+	return h;
+}
+
+static inline bool op_same_skeleton(const Sym *a, const Sym *b, int len) {
+	for (int i = 0; i < len; i++) {
+		if (gram_is_term(a[i]) != gram_is_term(b[i]) || (gram_is_term(a[i]) && a[i] != b[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static inline int op_handle_slot(const OpTable *t, const Grammar *g, const Sym *syms, int len) {
+	int mask = t->handle_hash_size - 1;
+	int slot = (int)(op_skeleton_hash(syms, len) & (uint32_t)mask);
+	while (t->handle_hash[slot] >= 0) {
+		int p = t->handle_hash[slot];
+		if (gram_rhs_len(g, p) == len && op_same_skeleton(gram_rhs(g, p), syms, len)) {
+			break;
+		}
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+/*
+ * Index every production that can be a handle. Unit productions (A -> B)
+ * are never reduced by an operator-precedence parser and are skipped;
+ * productions whose skeletons coincide keep the first one.
+ */
+static inline bool op_build_handles(OpTable *t, const Grammar *g) {
+	int size = 16;
+	while (size < 2 * g->prod_count) {
+		size *= 2;
+	}
+	t->handle_hash = malloc(sizeof(int) * (size_t)size);
+	if (t->handle_hash == NULL) {
+		return false;
+	}
+	t->handle_hash_size = size;
+	for (int i = 0; i < size; i++) {
+		t->handle_hash[i] = -1;
+	}
+	for (int p = 0; p < g->prod_count; p++) {
+		int len = gram_rhs_len(g, p);
+		if (len == 0 || (len == 1 && !gram_is_term(gram_rhs(g, p)[0]))) {
+			continue;
+		}
+		int slot = op_handle_slot(t, g, gram_rhs(g, p), len);
+		if (t->handle_hash[slot] < 0) {
+			t->handle_hash[slot] = p;
+		} else {
+			t->handle_clashes++;
+		}
+	}
+	return true;
+}
+
+/* Production whose right-hand side matches the handle syms[0..len), or -1. */
+static inline int op_match_handle(const OpTable *t, const Grammar *g, const Sym *syms, int len) {
+	return t->handle_hash[op_handle_slot(t, g, syms, len)];
+}
+
+/*
+ * Relations, precedence functions (when they exist) and the handle index
+ * for g, whose start symbol is g->start and whose end-marker is
+ * terminal dollar. Returns false only when out of memory.
+ */
+static inline bool op_build_table(OpTable *t, const Grammar *g, const OpSets *s, int dollar) {
+	op_table_free(t);
+	t->n = g->term_count;
+	t->dollar = dollar;
+	t->operator_grammar = true;
+	t->rel = calloc((size_t)t->n * (size_t)t->n + 1, 1);
+	if (t->rel == NULL) {
+		return false;
+	}
+	for (int p = 0; p < g->prod_count; p++) {
+		const Sym *rhs = gram_rhs(g, p);
+		int len = gram_rhs_len(g, p);
+		if (len == 0) {
+			t->operator_grammar = false;
+		}
+		for (int i = 0; i + 1 < len; i++) {
+			Sym x = rhs[i];
+			Sym y = rhs[i + 1];
+			if (gram_is_term(x) && gram_is_term(y)) {
+				op_set_rel(t, gram_term_index(x), gram_term_index(y), OP_EQ);
+			} else if (gram_is_term(x)) {
+				for (int b = -1; op_next_term(s, s->leading, y, &b);) {
+					op_set_rel(t, gram_term_index(x), b, OP_LT);
+				}
+				if (i + 2 < len && gram_is_term(rhs[i + 2])) {
+					op_set_rel(t, gram_term_index(x), gram_term_index(rhs[i + 2]), OP_EQ);
+				}
+			} else if (gram_is_term(y)) {
+				for (int a = -1; op_next_term(s, s->trailing, x, &a);) {
+					op_set_rel(t, a, gram_term_index(y), OP_GT);
+				}
+			} else {
+				t->operator_grammar = false;
+			}
+		}
+	}
+	if (g->start != GRAM_NO_SYM) {
+		int start = g->start;
+		for (int b = -1; op_next_term(s, s->leading, start, &b);) {
+			op_set_rel(t, dollar, b, OP_LT);
+		}
+		for (int a = -1; op_next_term(s, s->trailing, start, &a);) {
+			op_set_rel(t, a, dollar, OP_GT);
+		}
+	}
+	if (t->conflicts == 0 && !op_build_funcs(t)) {
+		return false;
+	}
+	return op_build_handles(t, g);
+}
+
+static inline void op_parser_init(OpParser *ps) {
+	memset(ps, 0, sizeof(*ps));
+}
+
+static inline void op_parser_free(OpParser *ps) {
+	free(ps->stack);
+	memset(ps, 0, sizeof(*ps));
+}
+
+static inline bool op_push(OpParser *ps, Sym s) {
+	Sym *grown = gram_grow(ps->stack, &ps->cap, ps->depth + 1, sizeof(Sym));
+	if (grown == NULL) {
+		return false;
+	}
+	ps->stack = grown;
+	ps->stack[ps->depth++] = s;
+	return true;
+}
+
+/* Index of the topmost terminal on the stack; stack[0] is always $. */
+static inline int op_top_terminal(const OpParser *ps) {
+	int i = ps->depth - 1;
+	while (!gram_is_term(ps->stack[i])) {
+		i--;
+	}
+	return i;
+}
+
+/*
+ * Parse tokens[0..n), terminal indices ending with dollar. Returns the
+ * number of reductions on acceptance, or -1 with error_pos set to the
+ * offending token. step, when not NULL, sees every action. $ is only
+ * ever accepted, never shifted. With has_funcs, blank matrix cells read
+ * as ordinary relations, so some errors surface later or not at all;
+ * pass a table without functions when errors must be exact.
+ */
+static inline long op_parse(OpParser *ps, const OpTable *t, const Grammar *g, const int *tokens, int n,
+							OpStepFn step, void *ctx) {
+	long reductions = 0;
+	int ip = 0;
+	ps->depth = 0;
+	ps->error_pos = 0;
+	if (!op_push(ps, gram_term_sym(t->dollar))) {
+		return -1;
+	}
+	while (ip < n) {
+		int a = tokens[ip];
+		int top = op_top_terminal(ps);
+		int b = gram_term_index(ps->stack[top]);
+		if (a < 0 || a >= t->n) {
+			break;
+		}
+		if (a == t->dollar && b == t->dollar) {
+			if (ps->depth == 2 && ip == n - 1) {
+				if (step) {
+					step(ctx, ps, ip, OP_ACCEPT);
+				}
+				return reductions;
+			}
+			break;
+		}
+		uint8_t r = op_rel(t, b, a);
+		if ((r == OP_LT || r == OP_EQ) && a != t->dollar) {
+			if (!op_push(ps, gram_term_sym(a))) {
+				return -1;
+			}
+			if (step) {
+				step(ctx, ps, ip, OP_SHIFT);
+			}
+			ip++;
+			continue;
+		}
+		if (r != OP_GT) {
+			break;
+		}
+
+		/* Pop terminals until the one below relates to the last popped by <. */
+		int start = top;
+		for (;;) {
+			int below = start - 1;
+			while (below >= 0 && !gram_is_term(ps->stack[below])) {
+				below--;
+			}
+			if (below < 0) {
+				break;
+			}
+			int c = gram_term_index(ps->stack[start]);
+			if (op_rel(t, gram_term_index(ps->stack[below]), c) == OP_LT) {
+				/* A nonterminal just above the <. terminal belongs to the handle. */
+				start = below + 1;
+				break;
+			}
+			start = below;
+		}
+		int len = ps->depth - start;
+		int p = start > 0 ? op_match_handle(t, g, &ps->stack[start], len) : -1;
+		if (p < 0) {
+			break;
+		}
+		ps->depth = start;
+		ps->stack[ps->depth++] = g->prod_lhs[p];
+		reductions++;
+		if (step) {
+			step(ctx, ps, ip, p);
+		}
+	}
+	ps->error_pos = ip;
+	if (step) {
+		step(ctx, ps, ip, OP_REJECT);
+	}
+	return -1;
+}
+
+#endif
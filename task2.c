@@ -1,29 +1,159 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
 
 #define MAX_REGEX 512
 #define MAX_POSTFIX 1024
 #define MAX_STATES 1024
 #define MAX_TRANS 4096
+#define MAX_BP_STATES 256
+#define BP_WORDS (MAX_BP_STATES / 64)
+#define BP_CHUNKS (MAX_BP_STATES / 8)
+#define NFA_WORDS (MAX_STATES / 64)
+#define BENCH_MAX_DFA 4096
+#define BENCH_INPUT_BYTES (4u << 20)
+#define BENCH_COUNTED_BYTES (256u << 10)
+#define MAX_COUNTERS 8
+#define MAX_REPEAT 100000
+#define MAX_GROUPS 9
+#define MAX_TAGS (2 * (MAX_GROUPS + 1))
+#define MAX_TDFA_STATES 1024
+#define MAX_TDFA_REGS 8192
+#define TAG_UNSET (-1)
+#define TAG_NOW (-2)
+
+/*
+ * Operations carried by epsilon transitions: counters for x{n,m}, and
+ * OP_TAG to record the current input position in tag `counter`.
+ */
+enum { OP_NONE, OP_ENTER, OP_REPEAT, OP_EXIT, OP_TAG };
+
+/* Why build_bit_parallel did or did not build a matcher. */
+enum { BP_BUILT, BP_TOO_MANY_POSITIONS, BP_COUNTED, BP_MALFORMED };
 
 typedef struct {
     int from;
     int to;
     char symbol; /* 0 means epsilon */
+    char op;     /* OP_* for counted repetition, OP_NONE otherwise */
+    int counter;
 } Transition;
 
+typedef struct {
+    int min;
+    int max; /* -1 means unbounded */
+} Counter;
+
+/* NFA configuration: a state plus the value of every repetition counter. */
+typedef struct {
+    int state;
+    int cnt[MAX_COUNTERS];
+} Config;
+
+/*
+ * Configurations reachable at one input position. Both the list and its
+ * hash grow as needed; failed is set when memory runs out, and the set is
+ * then incomplete.
+ */
+typedef struct {
+    Config *items;
+    int count;
+    int cap;
+    bool has_accept;
+    bool failed;
+    int gen;
+    int *slot_gen;
+    int *slot_idx;
+    int hash_size;
+} ConfigSet;
+
+/* Register operation on a TDFA transition: regs[dst] = regs[src] or pos. */
+typedef struct {
+    int dst;
+    int src; /* register, or TAG_NOW for the current input position */
+} RegOp;
+
+/*
+ * A tagged-DFA state is an ordered list of NFA states (highest priority
+ * first), each with the register that holds every tag for that thread.
+ */
+typedef struct {
+    int item_off;
+    int item_count;
+    int final_item; /* first item in the final NFA state, or -1 */
+    uint32_t hash;
+} TdfaState;
+
+typedef struct {
+    int n_tags;
+    int n_classes; /* pattern symbols plus one class for any other byte */
+    int class_of[256];
+    int state_count;
+    int reg_count;
+    bool overflow;
+    int *items;     /* NFA state per item */
+    int *item_regs; /* n_tags registers per item */
+    int items_used;
+    int items_cap;
+    int regs_cap;
+    int *trans;     /* [state * n_classes + class] -> state */
+    int *op_off;    /* [state * n_classes + class] -> first op */
+    int *op_count;
+    RegOp *ops;
+    int ops_used;
+    int ops_cap;
+    int init_op_off;
+    int init_op_count;
+    TdfaState states[MAX_TDFA_STATES]; /* last, so build_tdfa can clear the rest cheaply */
+} Tdfa;
+
 typedef struct {
     int start;
     int accept;
 } Fragment;
 
+/* Position set of a Glushkov automaton; bit 0 is the initial state. */
+typedef struct {
+    uint64_t w[BP_WORDS];
+} BitVec;
+
+typedef struct {
+    BitVec first;
+    BitVec last;
+    bool nullable;
+} GlushkovFrag;
+
+/*
+ * Bit-parallel (Shift-And) form of a pattern. follow_tab[k][b] is the union
+ * of the follow sets of the positions 8k..8k+7 selected by byte b, so a
+ * whole step costs one lookup per 8 active positions plus an AND.
+ */
+typedef struct {
+    int positions; /* states including the initial one */
+    int words;     /* 64-bit words in use: 1, 2 or 4 */
+    bool linear;   /* plain concatenation: D = (D << 1) & mask[c] */
+    BitVec mask[256];
+    BitVec final;
+    BitVec follow_tab[BP_CHUNKS][256];
+} BitParallel;
+
 static Transition transitions[MAX_TRANS];
 static int trans_count = 0;
 
 static int next_state = 0;
 
+static Counter counters[MAX_COUNTERS];
+static int counter_count = 0;
+
+static int group_count = 0;
+
 static bool is_operator(char c) {
     return c == '|' || c == '.' || c == '*' || c == '+' || c == '?';
 }
@@ -38,15 +168,21 @@ static int precedence(char c) {
     return 0;
 }
 
-static void add_transition(int from, int to, char symbol) {
+static void add_counter_transition(int from, int to, char symbol, char op, int counter) {
     if (trans_count < MAX_TRANS) {
         transitions[trans_count].from = from;
         transitions[trans_count].to = to;
         transitions[trans_count].symbol = symbol;
+        transitions[trans_count].op = op;
+        transitions[trans_count].counter = counter;
         trans_count++;
     }
 }
 
+static void add_transition(int from, int to, char symbol) {
+    add_counter_transition(from, to, symbol, OP_NONE, 0);
+}
+
 static char *insert_concat(const char *regex, char *out) {
     int j = 0;
     for (int i = 0; regex[i] != '\0'; i++) {
@@ -54,6 +190,19 @@ static char *insert_concat(const char *regex, char *out) {
         if (isspace((unsigned char)c1)) {
             continue;
         }
+        if (c1 == '{') {
+            /* Copy a counted repetition {n}, {n,} or {n,m} verbatim. */
+            while (regex[i] != '\0' && regex[i] != '}') {
+                if (!isspace((unsigned char)regex[i])) {
+                    out[j++] = regex[i];
+                }
+                i++;
+            }
+            if (regex[i] == '\0') {
+                break;
+            }
+            c1 = '}';
+        }
         out[j++] = c1;
 
         char c2 = regex[i + 1];
@@ -64,7 +213,7 @@ static char *insert_concat(const char *regex, char *out) {
             continue;
         }
 
-        if ((is_operand(c1) || c1 == ')' || c1 == '*' || c1 == '+' || c1 == '?') &&
+        if ((is_operand(c1) || c1 == ')' || c1 == '*' || c1 == '+' || c1 == '?' || c1 == '}') &&
             (is_operand(c2) || c2 == '(')) {
             out[j++] = '.';
         }
@@ -73,23 +222,47 @@ static char *insert_concat(const char *regex, char *out) {
     return out;
 }
 
+/*
+ * Capture groups are numbered by their '(' from left to right. A closed
+ * group k (1..MAX_GROUPS) appears in the postfix as ')' followed by the
+ * byte k; later groups are left uncaptured.
+ */
 static char *to_postfix(const char *regex, char *postfix) {
     char stack[MAX_POSTFIX];
+    int groups[MAX_POSTFIX];
     int top = -1;
+    int gtop = -1;
     int j = 0;
 
+    group_count = 0;
+
     for (int i = 0; regex[i] != '\0'; i++) {
         char c = regex[i];
-        if (is_operand(c)) {
+        if (c == '{') {
+            while (regex[i] != '\0' && regex[i] != '}') {
+                postfix[j++] = regex[i++];
+            }
+            if (regex[i] == '}') {
+                postfix[j++] = '}';
+            } else {
+                break;
+            }
+        } else if (is_operand(c)) {
             postfix[j++] = c;
         } else if (c == '(') {
             stack[++top] = c;
+            groups[++gtop] = group_count < MAX_GROUPS ? ++group_count : 0;
         } else if (c == ')') {
             while (top >= 0 && stack[top] != '(') {
                 postfix[j++] = stack[top--];
             }
             if (top >= 0 && stack[top] == '(') {
                 top--;
+                int g = groups[gtop--];
+                if (g > 0) {
+                    postfix[j++] = ')';
+                    postfix[j++] = (char)g;
+                }
             }
         } else if (c == '*' || c == '+' || c == '?') {
             postfix[j++] = c;
@@ -109,6 +282,58 @@ static char *to_postfix(const char *regex, char *postfix) {
     return postfix;
 }
 
+/*
+ * Decimal repeat bound at s[*i], advancing *i past its digits. Returns -1
+ * when there are none and -2 above MAX_REPEAT; digits past the limit are
+ * skipped rather than accumulated.
+ */
+static int parse_bound(const char *s, int *i) {
+    if (!isdigit((unsigned char)s[*i])) {
+        return -1;
+    }
+    int v = 0;
+    while (isdigit((unsigned char)s[*i])) {
+        if (v <= MAX_REPEAT) {
+            v = v * 10 + (s[*i] - '0');
+        }
+        (*i)++;
+    }
+    return v > MAX_REPEAT ? -2 : v;
+}
+
+/*
+ * Every counted repetition in the output of insert_concat must be {n},
+ * {n,} or {n,m} with n <= m <= MAX_REPEAT, after something to repeat.
+ * Returns NULL, or what is wrong with the first one that is not.
+ */
+static const char *check_repeats(const char *regex) {
+    for (int i = 0; regex[i] != '\0'; i++) {
+        if (regex[i] != '{') {
+            continue;
+        }
+        if (i == 0 || regex[i - 1] == '(' || regex[i - 1] == '|') {
+            return "{ has nothing to repeat";
+        }
+        i++;
+        int lo = parse_bound(regex, &i);
+        int hi = lo;
+        if (regex[i] == ',') {
+            i++;
+            hi = regex[i] == '}' ? MAX_REPEAT : parse_bound(regex, &i);
+        }
+        if (lo == -1 || hi == -1 || regex[i] != '}') {
+            return "expected {n}, {n,} or {n,m}";
+        }
+        if (lo == -2 || hi == -2) {
+            return "repetition bound above the limit";
+        }
+        if (hi < lo) {
+            return "{n,m} with m < n";
+        }
+    }
+    return NULL;
+}
+
 static Fragment build_nfa(const char *postfix) {
     Fragment stack[MAX_POSTFIX];
     int top = -1;
@@ -161,13 +386,1278 @@ static Fragment build_nfa(const char *postfix) {
             add_transition(s, e, 0);
             add_transition(a.accept, e, 0);
             stack[++top] = (Fragment){s, e};
+        } else if (c == ')') {
+            /* Capture group k: tag 2k on entry, tag 2k+1 on exit. */
+            int g = postfix[++i];
+            if (top < 0 || g == 0) {
+                continue;
+            }
+            Fragment a = stack[top--];
+            int s = next_state++;
+            int e = next_state++;
+            add_counter_transition(s, a.start, 0, OP_TAG, 2 * g);
+            add_counter_transition(a.accept, e, 0, OP_TAG, 2 * g + 1);
+            stack[++top] = (Fragment){s, e};
+        } else if (c == '{') {
+            /*
+             * x{n,m} keeps a single copy of x. A counter is reset on entry,
+             * bumped on every loop back and tested on exit, so the NFA size
+             * does not depend on n or m. check_repeats has vetted the
+             * bounds; max -1 is unbounded.
+             */
+            i++;
+            int min = parse_bound(postfix, &i);
+            int max = min;
+            if (postfix[i] == ',') {
+                i++;
+                max = isdigit((unsigned char)postfix[i]) ? parse_bound(postfix, &i) : -1;
+            }
+
+            Fragment a = stack[top--];
+            int s = next_state++;
+            int e = next_state++;
+            if (min == 0) {
+                add_transition(s, e, 0);
+            }
+            if (max != 0 && counter_count < MAX_COUNTERS) {
+                int k = counter_count++;
+                counters[k] = (Counter){min, max};
+                add_counter_transition(s, a.start, 0, OP_ENTER, k);
+                if (max != 1) {
+                    add_counter_transition(a.accept, a.start, 0, OP_REPEAT, k);
+                }
+                add_counter_transition(a.accept, e, 0, OP_EXIT, k);
+            }
+            stack[++top] = (Fragment){s, e};
         }
     }
 
     return stack[top];
 }
 
-int main(void) {
+static void bv_set(BitVec *v, int i) {
+    v->w[i >> 6] |= 1ULL << (i & 63);
+}
+
+static bool bv_test(const BitVec *v, int i) {
+    return (v->w[i >> 6] >> (i & 63)) & 1ULL;
+}
+
+static void bv_or(BitVec *dst, const BitVec *src) {
+    for (int w = 0; w < BP_WORDS; w++) {
+        dst->w[w] |= src->w[w];
+    }
+}
+
+static bool bv_equal(const BitVec *a, const BitVec *b) {
+    return memcmp(a, b, sizeof(BitVec)) == 0;
+}
+
+/*
+ * Glushkov construction over the same postfix form build_nfa consumes.
+ * Returns BP_BUILT, or why not: too many positions or a counted repetition,
+ * where the caller falls back to the Thompson NFA, or a malformed pattern.
+ */
+static int build_bit_parallel(const char *postfix, BitParallel *bp) {
+    static BitVec follow[MAX_BP_STATES];
+    static GlushkovFrag stack[MAX_POSTFIX];
+    unsigned char sym[MAX_BP_STATES];
+    bool counted = false;
+    int top = -1;
+    int m = 0;
+
+    for (int i = 0; postfix[i] != '\0'; i++) {
+        if (is_operand(postfix[i])) {
+            m++;
+        }
+    }
+    if (m + 1 > MAX_BP_STATES) {
+        return BP_TOO_MANY_POSITIONS;
+    }
+
+    memset(bp, 0, sizeof(*bp));
+    memset(follow, 0, sizeof(follow));
+    m = 0;
+
+    for (int i = 0; postfix[i] != '\0'; i++) {
+        char c = postfix[i];
+
+        if (c == '{') {
+            /* Counted repetition needs counters, not positions. */
+            if (top < 0) {
+                return BP_MALFORMED;
+            }
+            counted = true;
+            i += (int)strcspn(postfix + i, "}");
+        } else if (c == ')') {
+            i++; /* capture groups do not change the language */
+        } else if (is_operand(c)) {
+            GlushkovFrag f = {0};
+            m++;
+            sym[m] = (unsigned char)c;
+            bv_set(&f.first, m);
+            bv_set(&f.last, m);
+            stack[++top] = f;
+        } else if (c == '.' || c == '|') {
+            if (top < 1) {
+                return BP_MALFORMED;
+            }
+            GlushkovFrag b = stack[top--];
+            GlushkovFrag a = stack[top--];
+            GlushkovFrag f = {0};
+            if (c == '.') {
+                for (int p = 1; p <= m; p++) {
+                    if (bv_test(&a.last, p)) {
+                        bv_or(&follow[p], &b.first);
+                    }
+                }
+                f.first = a.first;
+                if (a.nullable) {
+                    bv_or(&f.first, &b.first);
+                }
+                f.last = b.last;
+                if (b.nullable) {
+                    bv_or(&f.last, &a.last);
+                }
+                f.nullable = a.nullable && b.nullable;
+            } else {
+                f.first = a.first;
+                bv_or(&f.first, &b.first);
+                f.last = a.last;
+                bv_or(&f.last, &b.last);
+                f.nullable = a.nullable || b.nullable;
+            }
+            stack[++top] = f;
+        } else if (c == '*' || c == '+' || c == '?') {
+            if (top < 0) {
+                return BP_MALFORMED;
+            }
+            GlushkovFrag *a = &stack[top];
+            if (c != '?') {
+                for (int p = 1; p <= m; p++) {
+                    if (bv_test(&a->last, p)) {
+                        bv_or(&follow[p], &a->first);
+                    }
+                }
+            }
+            if (c != '+') {
+                a->nullable = true;
+            }
+        }
+    }
+
+    if (top != 0) {
+        return BP_MALFORMED;
+    }
+    if (counted) {
+        return BP_COUNTED;
+    }
+
+    follow[0] = stack[0].first;
+    bp->final = stack[0].last;
+    if (stack[0].nullable) {
+        bv_set(&bp->final, 0);
+    }
+    bp->positions = m + 1;
+    bp->words = bp->positions <= 64 ? 1 : (bp->positions <= 128 ? 2 : 4);
+
+    for (int p = 1; p <= m; p++) {
+        bv_set(&bp->mask[sym[p]], p);
+    }
+
+    bp->linear = bp->positions <= 64;
+    for (int p = 0; p <= m && bp->linear; p++) {
+        BitVec next = {0};
+        if (p < m) {
+            bv_set(&next, p + 1);
+        }
+        bp->linear = bv_equal(&follow[p], &next);
+    }
+
+    for (int k = 0; k < (bp->positions + 7) / 8; k++) {
+        for (int b = 1; b < 256; b++) {
+            int low = b & -b;
+            int p = 8 * k + __builtin_ctz((unsigned)low);
+            bp->follow_tab[k][b] = bp->follow_tab[k][b ^ low];
+            if (p < bp->positions) {
+                bv_or(&bp->follow_tab[k][b], &follow[p]);
+            }
+        }
+    }
+    return BP_BUILT;
+}
+
+static bool bp_match_64(const BitParallel *bp, const char *s) {
+    uint64_t d = 1ULL;
+
+    if (bp->linear) {
+        for (; *s != '\0' && d != 0ULL; s++) {
+            d = (d << 1) & bp->mask[(unsigned char)*s].w[0];
+        }
+    } else {
+        for (; *s != '\0' && d != 0ULL; s++) {
+            uint64_t next = 0ULL;
+            for (int k = 0; k < 8; k++) {
+                next |= bp->follow_tab[k][(d >> (8 * k)) & 0xFF].w[0];
+            }
+            d = next & bp->mask[(unsigned char)*s].w[0];
+        }
+    }
+    return (d & bp->final.w[0]) != 0ULL;
+}
+
+/* 128/256-position variant; the fixed-width word loops vectorize. */
+static bool bp_match_wide(const BitParallel *bp, const char *s) {
+    BitVec d = {0};
+    int chunks = (bp->positions + 7) / 8;
+    bv_set(&d, 0);
+
+    for (; *s != '\0'; s++) {
+        BitVec next = {0};
+        for (int k = 0; k < chunks; k++) {
+            int byte = (int)((d.w[k >> 3] >> (8 * (k & 7))) & 0xFF);
+            if (byte != 0) {
+                bv_or(&next, &bp->follow_tab[k][byte]);
+            }
+        }
+        uint64_t any = 0ULL;
+        for (int w = 0; w < BP_WORDS; w++) {
+            d.w[w] = next.w[w] & bp->mask[(unsigned char)*s].w[w];
+            any |= d.w[w];
+        }
+        if (any == 0ULL) {
+            return false;
+        }
+    }
+
+    for (int w = 0; w < BP_WORDS; w++) {
+        if (d.w[w] & bp->final.w[w]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool bp_match(const BitParallel *bp, const char *s) {
+    if (bp->words == 1) {
+        return bp_match_64(bp, s);
+    }
+    return bp_match_wide(bp, s);
+}
+
+static int eps_off[MAX_STATES + 1];
+static int eps_tr[MAX_TRANS];
+static int sym_off[MAX_STATES + 1];
+static int sym_to[MAX_TRANS];
+static char sym_of[MAX_TRANS];
+
+/* Index the transition list by source state; call after build_nfa. */
+static void build_adjacency(void) {
+    memset(eps_off, 0, sizeof(eps_off));
+    memset(sym_off, 0, sizeof(sym_off));
+    for (int i = 0; i < trans_count; i++) {
+        if (transitions[i].symbol == 0) {
+            eps_off[transitions[i].from + 1]++;
+        } else {
+            sym_off[transitions[i].from + 1]++;
+        }
+    }
+    for (int s = 0; s < next_state; s++) {
+        eps_off[s + 1] += eps_off[s];
+        sym_off[s + 1] += sym_off[s];
+    }
+    int eps_fill[MAX_STATES];
+    int sym_fill[MAX_STATES];
+    memcpy(eps_fill, eps_off, sizeof(int) * (size_t)next_state);
+    memcpy(sym_fill, sym_off, sizeof(int) * (size_t)next_state);
+    for (int i = 0; i < trans_count; i++) {
+        int from = transitions[i].from;
+        if (transitions[i].symbol == 0) {
+            eps_tr[eps_fill[from]++] = i;
+        } else {
+            sym_to[sym_fill[from]] = transitions[i].to;
+            sym_of[sym_fill[from]++] = transitions[i].symbol;
+        }
+    }
+}
+
+/* Apply a counter operation; false when its guard blocks the move. */
+static bool apply_counter_op(const Transition *t, int *cnt) {
+    if (t->op == OP_NONE || t->op == OP_TAG) {
+        return true; /* t->counter is a tag number here, not a counter */
+    }
+    const Counter *c = &counters[t->counter];
+    int *v = &cnt[t->counter];
+
+    switch (t->op) {
+    case OP_ENTER:
+        *v = 0;
+        return true;
+    case OP_REPEAT:
+        if (c->max >= 0) {
+            if (*v + 1 >= c->max) {
+                return false;
+            }
+            (*v)++;
+        } else if (*v + 1 < c->min) {
+            (*v)++; /* unbounded: saturate once the lower bound is met */
+        }
+        return true;
+    case OP_EXIT:
+        if (*v + 1 < c->min) {
+            return false;
+        }
+        *v = 0;
+        return true;
+    default:
+        return true;
+    }
+}
+
+static void *grow(void *ptr, int *cap, int need, size_t elem) {
+    if (need <= *cap) {
+        return ptr;
+    }
+    int cap2 = *cap > 0 ? *cap : 256;
+    while (cap2 < need) {
+        cap2 *= 2;
+    }
+    void *p = realloc(ptr, (size_t)cap2 * elem);
+    if (p == NULL) {
+        return NULL;
+    }
+    *cap = cap2;
+    return p;
+}
+
+static void config_clear(ConfigSet *set) {
+    set->count = 0;
+    set->has_accept = false;
+    set->failed = false;
+    set->gen++;
+}
+
+/* Hash slot of (state, cnt): the slot holding it, or the free slot where it would go. */
+static uint32_t config_slot(const ConfigSet *set, int state, const int *cnt) {
+    uint32_t h = 2166136261u ^ (uint32_t)state;
+    for (int k = 0; k < counter_count; k++) {
+        h = (h ^ (uint32_t)cnt[k]) * 16777619u;
+    }
+    h = (h * 16777619u) & (uint32_t)(set->hash_size - 1);
+
+    while (set->slot_gen[h] == set->gen) {
+        const Config *c = &set->items[set->slot_idx[h]];
+        if (c->state == state &&
+            memcmp(c->cnt, cnt, sizeof(int) * (size_t)counter_count) == 0) {
+            break;
+        }
+        h = (h + 1) & (uint32_t)(set->hash_size - 1);
+    }
+    return h;
+}
+
+/* Double the hash and re-enter the configurations already in the set. */
+static bool config_rehash(ConfigSet *set) {
+    int size = set->hash_size > 0 ? set->hash_size * 2 : 1024;
+    int *slot_gen = calloc((size_t)size, sizeof(int));
+    int *slot_idx = malloc(sizeof(int) * (size_t)size);
+    if (slot_gen == NULL || slot_idx == NULL) {
+        free(slot_gen);
+        free(slot_idx);
+        return false;
+    }
+    free(set->slot_gen);
+    free(set->slot_idx);
+    set->slot_gen = slot_gen;
+    set->slot_idx = slot_idx;
+    set->hash_size = size;
+    for (int i = 0; i < set->count; i++) {
+        uint32_t h = config_slot(set, set->items[i].state, set->items[i].cnt);
+        set->slot_gen[h] = set->gen;
+        set->slot_idx[h] = i;
+    }
+    return true;
+}
+
+/* Add (state, cnt) to the set; false when it was already there or memory ran out. */
+static bool config_insert(ConfigSet *set, int state, const int *cnt, int accept) {
+    if (2 * (set->count + 1) > set->hash_size && !config_rehash(set)) {
+        set->failed = true;
+        return false;
+    }
+    uint32_t h = config_slot(set, state, cnt);
+    if (set->slot_gen[h] == set->gen) {
+        return false;
+    }
+    Config *items = grow(set->items, &set->cap, set->count + 1, sizeof(Config));
+    if (items == NULL) {
+        set->failed = true;
+        return false;
+    }
+    set->items = items;
+    set->slot_gen[h] = set->gen;
+    set->slot_idx[h] = set->count;
+    set->items[set->count].state = state;
+    memcpy(set->items[set->count].cnt, cnt, sizeof(int) * (size_t)counter_count);
+    set->count++;
+    if (state == accept) {
+        set->has_accept = true;
+    }
+    return true;
+}
+
+/* Add a configuration and everything reachable from it by epsilon moves. */
+static void config_add(ConfigSet *set, int state, const int *cnt, int accept) {
+    static Config *stack;
+    static int stack_cap = 0;
+    int top = 0;
+
+    if (!config_insert(set, state, cnt, accept)) {
+        return;
+    }
+    Config *grown = grow(stack, &stack_cap, top + 1, sizeof(Config));
+    if (grown == NULL) {
+        set->failed = true;
+        return;
+    }
+    stack = grown;
+    stack[top].state = state;
+    memcpy(stack[top].cnt, cnt, sizeof(int) * (size_t)counter_count);
+    top++;
+
+    while (top > 0) {
+        Config cur = stack[--top];
+        for (int e = eps_off[cur.state]; e < eps_off[cur.state + 1]; e++) {
+            const Transition *t = &transitions[eps_tr[e]];
+            Config next = cur;
+            next.state = t->to;
+            if (!apply_counter_op(t, next.cnt)) {
+                continue;
+            }
+            if (!config_insert(set, next.state, next.cnt, accept)) {
+                continue;
+            }
+            grown = grow(stack, &stack_cap, top + 1, sizeof(Config));
+            if (grown == NULL) {
+                set->failed = true;
+                return;
+            }
+            stack = grown;
+            stack[top++] = next;
+        }
+    }
+}
+
+/*
+ * Fallback matcher: simulate the Thompson NFA over configurations. With
+ * search set, a match may start anywhere and *hits counts match ends.
+ * Returns 1 on a match, 0 without one, and -1 when memory ran out.
+ */
+static int nfa_simulate(Fragment nfa, const unsigned char *s, size_t n, bool search, long *hits) {
+    static ConfigSet sets[2];
+    ConfigSet *cur = &sets[0];
+    ConfigSet *next = &sets[1];
+    int zero[MAX_COUNTERS] = {0};
+
+    config_clear(cur);
+    config_add(cur, nfa.start, zero, nfa.accept);
+
+    for (size_t i = 0; i < n; i++) {
+        if (cur->failed) {
+            return -1;
+        }
+        config_clear(next);
+        for (int c = 0; c < cur->count; c++) {
+            const Config *cfg = &cur->items[c];
+            for (int e = sym_off[cfg->state]; e < sym_off[cfg->state + 1]; e++) {
+                if (sym_of[e] == (char)s[i]) {
+                    config_add(next, sym_to[e], cfg->cnt, nfa.accept);
+                }
+            }
+        }
+        if (hits != NULL && next->has_accept) {
+            (*hits)++;
+        }
+        if (search) {
+            config_add(next, nfa.start, zero, nfa.accept);
+        }
+        ConfigSet *tmp = cur;
+        cur = next;
+        next = tmp;
+        if (cur->count == 0) {
+            break;
+        }
+    }
+    if (cur->failed) {
+        return -1;
+    }
+    return cur->has_accept;
+}
+
+static int nfa_match(Fragment nfa, const char *s) {
+    return nfa_simulate(nfa, (const unsigned char *)s, strlen(s), false, NULL);
+}
+
+static int tdfa_mark[MAX_STATES];
+static int tdfa_stamp = 0;
+static int tdfa_final = -1;
+static int *tdfa_tmp_items;
+static int *tdfa_tmp_src;
+static int tdfa_tmp_count;
+
+/*
+ * Priority-ordered epsilon closure: transitions are followed in creation
+ * order (left alternative first, loop before exit), and the first thread
+ * to reach an NFA state owns it. Only states with symbol moves, and the
+ * final state, become items.
+ */
+static void tdfa_closure(Tdfa *d, int q, int *src) {
+    static int items_cap = 0;
+    static int src_cap = 0;
+
+    if (tdfa_mark[q] == tdfa_stamp) {
+        return;
+    }
+    tdfa_mark[q] = tdfa_stamp;
+
+    if (sym_off[q + 1] > sym_off[q] || q == tdfa_final) {
+        int *items = grow(tdfa_tmp_items, &items_cap, tdfa_tmp_count + 1, sizeof(int));
+        int *srcs = items ? grow(tdfa_tmp_src, &src_cap, (tdfa_tmp_count + 1) * d->n_tags, sizeof(int)) : NULL;
+        if (srcs == NULL) {
+            d->overflow = true;
+            return;
+        }
+        tdfa_tmp_items = items;
+        tdfa_tmp_src = srcs;
+        tdfa_tmp_items[tdfa_tmp_count] = q;
+        memcpy(&tdfa_tmp_src[tdfa_tmp_count * d->n_tags], src, sizeof(int) * (size_t)d->n_tags);
+        tdfa_tmp_count++;
+    }
+
+    for (int e = eps_off[q]; e < eps_off[q + 1]; e++) {
+        const Transition *t = &transitions[eps_tr[e]];
+        if (t->op == OP_TAG) {
+            int saved = src[t->counter];
+            src[t->counter] = TAG_NOW;
+            tdfa_closure(d, t->to, src);
+            src[t->counter] = saved;
+        } else {
+            tdfa_closure(d, t->to, src);
+        }
+    }
+}
+
+static uint32_t tdfa_hash_items(const int *items, int count) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < count; i++) {
+        h = (h ^ (uint32_t)items[i]) * 16777619u;
+    }
+    return h;
+}
+
+static int tdfa_add_op(Tdfa *d, int dst, int src) {
+    RegOp *ops = grow(d->ops, &d->ops_cap, d->ops_used + 1, sizeof(RegOp));
+    if (ops == NULL) {
+        d->overflow = true;
+        return -1;
+    }
+    d->ops = ops;
+    d->ops[d->ops_used].dst = dst;
+    d->ops[d->ops_used].src = src;
+    return d->ops_used++;
+}
+
+/*
+ * Map the closure just computed onto a state. An existing state with the
+ * same item list is reused when each of its registers can be filled from a
+ * single source; otherwise a new state gets fresh registers. Either way
+ * the register copies are appended to d->ops.
+ */
+static int tdfa_resolve(Tdfa *d, int *op_first, int *op_n) {
+    static int reg_src[MAX_TDFA_REGS];
+    static int reg_stamp[MAX_TDFA_REGS];
+    static int stamp = 0;
+    int n_tags = d->n_tags;
+    uint32_t h = tdfa_hash_items(tdfa_tmp_items, tdfa_tmp_count);
+
+    *op_first = d->ops_used;
+    for (int y = 0; y < d->state_count; y++) {
+        TdfaState *st = &d->states[y];
+        if (st->hash != h || st->item_count != tdfa_tmp_count ||
+            memcmp(&d->items[st->item_off], tdfa_tmp_items, sizeof(int) * (size_t)tdfa_tmp_count) != 0) {
+            continue;
+        }
+        stamp++;
+        bool ok = true;
+        for (int k = 0; k < tdfa_tmp_count * n_tags && ok; k++) {
+            int src = tdfa_tmp_src[k];
+            int reg = d->item_regs[st->item_off * n_tags + k];
+            if ((src == TAG_UNSET) != (reg == TAG_UNSET)) {
+                ok = false;
+            } else if (reg != TAG_UNSET) {
+                if (reg_stamp[reg] != stamp) {
+                    reg_stamp[reg] = stamp;
+                    reg_src[reg] = src;
+                } else if (reg_src[reg] != src) {
+                    ok = false;
+                }
+            }
+        }
+        if (!ok) {
+            continue;
+        }
+        for (int k = 0; k < tdfa_tmp_count * n_tags; k++) {
+            int reg = d->item_regs[st->item_off * n_tags + k];
+            if (reg != TAG_UNSET && reg_stamp[reg] == stamp) {
+                if (reg_src[reg] != reg) {
+                    tdfa_add_op(d, reg, reg_src[reg]);
+                }
+                reg_stamp[reg] = 0;
+            }
+        }
+        *op_n = d->ops_used - *op_first;
+        return y;
+    }
+
+    if (d->state_count >= MAX_TDFA_STATES) {
+        d->overflow = true;
+        return -1;
+    }
+    int need = d->items_used + tdfa_tmp_count;
+    int *items = grow(d->items, &d->items_cap, need, sizeof(int));
+    if (items == NULL) {
+        d->overflow = true;
+        return -1;
+    }
+    d->items = items;
+    int *regs = grow(d->item_regs, &d->regs_cap, need * n_tags, sizeof(int));
+    if (regs == NULL) {
+        d->overflow = true;
+        return -1;
+    }
+    d->item_regs = regs;
+
+    /* One fresh register per distinct source value. */
+    TdfaState *st = &d->states[d->state_count];
+    st->item_off = d->items_used;
+    st->item_count = tdfa_tmp_count;
+    st->hash = h;
+    st->final_item = -1;
+    memcpy(&d->items[st->item_off], tdfa_tmp_items, sizeof(int) * (size_t)tdfa_tmp_count);
+    for (int k = 0; k < tdfa_tmp_count * n_tags; k++) {
+        int src = tdfa_tmp_src[k];
+        int reg = TAG_UNSET;
+        if (src != TAG_UNSET) {
+            for (int o = *op_first; o < d->ops_used; o++) {
+                if (d->ops[o].src == src) {
+                    reg = d->ops[o].dst;
+                    break;
+                }
+            }
+            if (reg == TAG_UNSET) {
+                if (d->reg_count >= MAX_TDFA_REGS) {
+                    d->overflow = true;
+                    return -1;
+                }
+                reg = d->reg_count++;
+                tdfa_add_op(d, reg, src);
+            }
+        }
+        d->item_regs[st->item_off * n_tags + k] = reg;
+    }
+    for (int i = 0; i < tdfa_tmp_count; i++) {
+        if (tdfa_tmp_items[i] == tdfa_final) {
+            st->final_item = i;
+            break;
+        }
+    }
+    d->items_used = need;
+    *op_n = d->ops_used - *op_first;
+    return d->state_count++;
+}
+
+/*
+ * Determinize the tagged NFA (Laurikari-style) for unanchored search.
+ * Tags 0 and 1 wrap the whole pattern; group k uses tags 2k and 2k+1.
+ * A new match attempt is implicitly started at every position with the
+ * lowest priority, so threads that started earlier always win ties.
+ */
+static bool build_tdfa(Tdfa *d, Fragment nfa, const char *postfix) {
+    memset(d, 0, offsetof(Tdfa, states));
+    d->n_tags = 2 * (group_count + 1);
+
+    for (int c = 0; c < 256; c++) {
+        d->class_of[c] = -1;
+    }
+    for (int i = 0; postfix[i] != '\0'; i++) {
+        unsigned char c = (unsigned char)postfix[i];
+        if (c == ')') {
+            i++;
+        } else if (is_operand((char)c) && d->class_of[c] < 0) {
+            d->class_of[c] = d->n_classes++;
+        }
+    }
+    int other = d->n_classes++;
+    for (int c = 0; c < 256; c++) {
+        if (d->class_of[c] < 0) {
+            d->class_of[c] = other;
+        }
+    }
+
+    int q0 = next_state++;
+    int qf = next_state++;
+    add_counter_transition(q0, nfa.start, 0, OP_TAG, 0);
+    add_counter_transition(nfa.accept, qf, 0, OP_TAG, 1);
+    build_adjacency();
+    tdfa_final = qf;
+
+    d->trans = malloc(sizeof(int) * MAX_TDFA_STATES * (size_t)d->n_classes);
+    d->op_off = malloc(sizeof(int) * MAX_TDFA_STATES * (size_t)d->n_classes);
+    d->op_count = malloc(sizeof(int) * MAX_TDFA_STATES * (size_t)d->n_classes);
+    if (!d->trans || !d->op_off || !d->op_count) {
+        return false;
+    }
+
+    int unset[MAX_TAGS];
+    int src[MAX_TAGS];
+    for (int t = 0; t < MAX_TAGS; t++) {
+        unset[t] = TAG_UNSET;
+    }
+
+    tdfa_stamp++;
+    tdfa_tmp_count = 0;
+    memcpy(src, unset, sizeof(src));
+    tdfa_closure(d, q0, src);
+    tdfa_resolve(d, &d->init_op_off, &d->init_op_count);
+
+    for (int x = 0; x < d->state_count && !d->overflow; x++) {
+        for (int a = 0; a < d->n_classes && !d->overflow; a++) {
+            tdfa_stamp++;
+            tdfa_tmp_count = 0;
+            TdfaState *st = &d->states[x];
+            for (int i = 0; i < st->item_count; i++) {
+                int q = d->items[st->item_off + i];
+                for (int e = sym_off[q]; e < sym_off[q + 1]; e++) {
+                    if (d->class_of[(unsigned char)sym_of[e]] == a) {
+                        memcpy(src, &d->item_regs[(st->item_off + i) * d->n_tags],
+                               sizeof(int) * (size_t)d->n_tags);
+                        tdfa_closure(d, sym_to[e], src);
+                    }
+                }
+            }
+            memcpy(src, unset, sizeof(src));
+            tdfa_closure(d, q0, src);
+
+            int idx = x * d->n_classes + a;
+            d->trans[idx] = tdfa_resolve(d, &d->op_off[idx], &d->op_count[idx]);
+        }
+    }
+    return !d->overflow;
+}
+
+static void tdfa_run_ops(const Tdfa *d, int *regs, int first, int count, int pos) {
+    int vals[MAX_TDFA_REGS];
+    for (int o = 0; o < count; o++) {
+        int src = d->ops[first + o].src;
+        vals[o] = src == TAG_NOW ? pos : regs[src];
+    }
+    for (int o = 0; o < count; o++) {
+        regs[d->ops[first + o].dst] = vals[o];
+    }
+}
+
+/*
+ * One linear pass over s with a fixed register file. Fills out[] with the
+ * tag positions of the leftmost-longest match (tags 0/1 are the whole
+ * match, 2k/2k+1 group k; -1 for a group that did not participate).
+ */
+static bool tdfa_search(const Tdfa *d, const unsigned char *s, size_t n, int *out) {
+    static int regs[MAX_TDFA_REGS];
+    int best_start = -1;
+    int state = 0;
+
+    for (int r = 0; r < d->reg_count; r++) {
+        regs[r] = -1;
+    }
+    tdfa_run_ops(d, regs, d->init_op_off, d->init_op_count, 0);
+
+    for (size_t i = 0;; i++) {
+        const TdfaState *st = &d->states[state];
+        if (st->final_item >= 0) {
+            const int *fr = &d->item_regs[(st->item_off + st->final_item) * d->n_tags];
+            int start = regs[fr[0]];
+            if (best_start < 0 || start <= best_start) {
+                best_start = start;
+                for (int t = 0; t < d->n_tags; t++) {
+                    out[t] = fr[t] == TAG_UNSET ? -1 : regs[fr[t]];
+                }
+            }
+        }
+        if (i == n) {
+            break;
+        }
+        int idx = state * d->n_classes + d->class_of[s[i]];
+        tdfa_run_ops(d, regs, d->op_off[idx], d->op_count[idx], (int)i + 1);
+        state = d->trans[idx];
+    }
+    return best_start >= 0;
+}
+
+/* Number of input positions where a match of bp ends (unanchored search). */
+static long bp_count_matches(const BitParallel *bp, const unsigned char *s, size_t n) {
+    long hits = 0;
+    if (bp->words == 1) {
+        uint64_t d = 0ULL;
+        for (size_t i = 0; i < n; i++) {
+            if (bp->linear) {
+                d = ((d << 1) | 2ULL) & bp->mask[s[i]].w[0];
+            } else {
+                uint64_t next = bp->follow_tab[0][1].w[0];
+                for (int k = 0; k < 8; k++) {
+                    next |= bp->follow_tab[k][(d >> (8 * k)) & 0xFF].w[0];
+                }
+                d = next & bp->mask[s[i]].w[0];
+            }
+            hits += (d & bp->final.w[0]) != 0ULL;
+        }
+        return hits;
+    }
+
+    BitVec d = {0};
+    int chunks = (bp->positions + 7) / 8;
+    for (size_t i = 0; i < n; i++) {
+        BitVec next = bp->follow_tab[0][1];
+        for (int k = 0; k < chunks; k++) {
+            int byte = (int)((d.w[k >> 3] >> (8 * (k & 7))) & 0xFF);
+            if (byte != 0) {
+                bv_or(&next, &bp->follow_tab[k][byte]);
+            }
+        }
+        uint64_t any = 0ULL;
+        for (int w = 0; w < BP_WORDS; w++) {
+            d.w[w] = next.w[w] & bp->mask[s[i]].w[w];
+            any |= d.w[w] & bp->final.w[w];
+        }
+        hits += any != 0ULL;
+    }
+    return hits;
+}
+
+typedef struct {
+    uint64_t w[NFA_WORDS];
+} StateSet;
+
+/* Subset-construction output for the benchmark; sets are kept for hashing. */
+typedef struct {
+    int count;
+    bool capped;
+    int n_symbols;
+    StateSet *sets;
+    int *trans;
+    bool *accepting;
+    int *hash;
+    int hash_size;
+} BenchDfa;
+
+static void set_closure(StateSet *set) {
+    int stack[MAX_STATES];
+    int top = 0;
+    for (int s = 0; s < next_state; s++) {
+        if ((set->w[s >> 6] >> (s & 63)) & 1ULL) {
+            stack[top++] = s;
+        }
+    }
+    while (top > 0) {
+        int s = stack[--top];
+        for (int e = eps_off[s]; e < eps_off[s + 1]; e++) {
+            int t = transitions[eps_tr[e]].to;
+            if (!((set->w[t >> 6] >> (t & 63)) & 1ULL)) {
+                set->w[t >> 6] |= 1ULL << (t & 63);
+                stack[top++] = t;
+            }
+        }
+    }
+}
+
+static uint64_t set_hash(const StateSet *set) {
+    uint64_t h = 1469598103934665603ULL;
+    for (int w = 0; w < NFA_WORDS; w++) {
+        h = (h ^ set->w[w]) * 1099511628211ULL;
+    }
+    return h ^ (h >> 29);
+}
+
+static int dfa_intern(BenchDfa *dfa, const StateSet *set, int accept) {
+    uint64_t mask = (uint64_t)dfa->hash_size - 1;
+    uint64_t h = set_hash(set) & mask;
+    while (dfa->hash[h] != -1) {
+        if (memcmp(&dfa->sets[dfa->hash[h]], set, sizeof(StateSet)) == 0) {
+            return dfa->hash[h];
+        }
+        h = (h + 1) & mask;
+    }
+    if (dfa->count >= BENCH_MAX_DFA) {
+        dfa->capped = true;
+        return -1;
+    }
+    int id = dfa->count++;
+    dfa->sets[id] = *set;
+    dfa->accepting[id] = (set->w[accept >> 6] >> (accept & 63)) & 1ULL;
+    dfa->hash[h] = id;
+    return id;
+}
+
+static void subset_construct(BenchDfa *dfa, Fragment nfa, const char *alphabet, int n_symbols) {
+    dfa->count = 0;
+    dfa->capped = false;
+    dfa->n_symbols = n_symbols;
+    memset(dfa->hash, -1, sizeof(int) * (size_t)dfa->hash_size);
+
+    StateSet start = {0};
+    start.w[nfa.start >> 6] |= 1ULL << (nfa.start & 63);
+    set_closure(&start);
+    dfa_intern(dfa, &start, nfa.accept);
+
+    for (int idx = 0; idx < dfa->count; idx++) {
+        for (int a = 0; a < n_symbols; a++) {
+            StateSet next = {0};
+            for (int w = 0; w < NFA_WORDS; w++) {
+                uint64_t bits = dfa->sets[idx].w[w];
+                while (bits != 0ULL) {
+                    int s = w * 64 + __builtin_ctzll(bits);
+                    bits &= bits - 1;
+                    for (int e = sym_off[s]; e < sym_off[s + 1]; e++) {
+                        if (sym_of[e] == alphabet[a]) {
+                            next.w[sym_to[e] >> 6] |= 1ULL << (sym_to[e] & 63);
+                        }
+                    }
+                }
+            }
+            set_closure(&next);
+            int id = dfa_intern(dfa, &next, nfa.accept);
+            if (id == -1) {
+                return;
+            }
+            dfa->trans[idx * n_symbols + a] = id;
+        }
+    }
+}
+
+static long dfa_count_matches(const BenchDfa *dfa, const signed char *sym_class,
+                              const unsigned char *s, size_t n) {
+    long hits = 0;
+    int state = 0;
+    for (size_t i = 0; i < n; i++) {
+        state = dfa->trans[state * dfa->n_symbols + sym_class[s[i]]];
+        hits += dfa->accepting[state];
+    }
+    return hits;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void repeat_str(char *out, const char *piece, int n) {
+    out[0] = '\0';
+    for (int i = 0; i < n; i++) {
+        strcat(out, piece);
+    }
+}
+
+/*
+ * Rewrite every x{n}, x{n,} and x{n,m} as plain copies of x, so a{2,4}
+ * becomes aa(a(a)?)?. x is the operand or group just before the '{'.
+ * Returns false when the result would not fit in cap bytes.
+ */
+static bool expand_counted(const char *regex, char *out, size_t cap) {
+    char atom[MAX_REGEX];
+    size_t j = 0;
+
+    for (int i = 0; regex[i] != '\0'; i++) {
+        if (regex[i] != '{') {
+            if (j + 1 >= cap) {
+                return false;
+            }
+            out[j++] = regex[i];
+            continue;
+        }
+        size_t a = j;
+        if (a > 0 && out[a - 1] == ')') {
+            int depth = 0;
+            do {
+                a--;
+                depth += (out[a] == ')') - (out[a] == '(');
+            } while (depth > 0 && a > 0);
+            if (depth != 0) {
+                return false;
+            }
+        } else if (a > 0 && is_operand(out[a - 1])) {
+            a--;
+        } else {
+            return false;
+        }
+        size_t len = j - a;
+        memcpy(atom, out + a, len);
+        j = a;
+
+        char *end;
+        long lo = strtol(regex + i + 1, &end, 10);
+        long hi = lo;
+        if (*end == ',') {
+            end++;
+            hi = *end == '}' ? -1 : strtol(end, &end, 10);
+        }
+        if (*end != '}' || hi == 0 || (hi > 0 && hi < lo) || lo > MAX_REPEAT || hi > MAX_REPEAT) {
+            return false;
+        }
+        i = (int)(end - regex);
+
+        size_t extra = hi < 0 ? 1 : (size_t)(hi - lo);
+        if (j + (size_t)lo * len + extra * (len + 3) >= cap) {
+            return false;
+        }
+        for (long k = 0; k < lo; k++) {
+            memcpy(out + j, atom, len);
+            j += len;
+        }
+        if (hi < 0) {
+            out[j++] = '(';
+            memcpy(out + j, atom, len);
+            j += len;
+            out[j++] = ')';
+            out[j++] = '*';
+        }
+        for (long k = lo; k < hi; k++) {
+            out[j++] = '(';
+            memcpy(out + j, atom, len);
+            j += len;
+        }
+        for (long k = lo; k < hi; k++) {
+            out[j++] = ')';
+            out[j++] = '?';
+        }
+    }
+    out[j] = '\0';
+    return true;
+}
+
+/* Unanchored search: a fresh start state that loops on every symbol. */
+static Fragment add_search_state(Fragment nfa, const char *alphabet, int n_symbols) {
+    int search = next_state++;
+    for (int a = 0; a < n_symbols; a++) {
+        add_transition(search, search, alphabet[a]);
+    }
+    add_transition(search, nfa.start, 0);
+    return (Fragment){ search, nfa.accept };
+}
+
+/* Build, determinize and scan with one pattern; prints one JSON line. */
+static void bench_pattern(const char *family, int n, const char *regex,
+                          BenchDfa *dfa, unsigned char *input) {
+    static BitParallel bp;
+    char with_concat[MAX_POSTFIX];
+    char postfix[MAX_POSTFIX];
+    Fragment nfa = {0};
+
+    const int reps = 200;
+    double t0 = now_seconds();
+    for (int r = 0; r < reps; r++) {
+        trans_count = 0;
+        next_state = 0;
+        counter_count = 0;
+        insert_concat(regex, with_concat);
+        to_postfix(with_concat, postfix);
+        nfa = build_nfa(postfix);
+    }
+    double build_us = (now_seconds() - t0) * 1e6 / reps;
+
+    char alphabet[64];
+    int n_symbols = 0;
+    signed char sym_class[256];
+    memset(sym_class, -1, sizeof(sym_class));
+    for (int i = 0; postfix[i] != '\0'; i++) {
+        unsigned char c = (unsigned char)postfix[i];
+        if (c == '{') {
+            i += (int)strcspn(&postfix[i], "}");
+        } else if (c == ')') {
+            i++;
+        } else if (is_operand((char)c) && sym_class[c] < 0) {
+            sym_class[c] = (signed char)n_symbols;
+            alphabet[n_symbols++] = (char)c;
+        }
+    }
+
+    Fragment searcher = add_search_state(nfa, alphabet, n_symbols);
+    build_adjacency();
+    size_t nfa_bytes = sizeof(Transition) * (size_t)trans_count +
+                       sizeof(int) * 2 * (size_t)(next_state + 1) +
+                       sizeof(int) * (size_t)eps_off[next_state] +
+                       (sizeof(int) + sizeof(char)) * (size_t)sym_off[next_state];
+
+    srand(7);
+    for (size_t i = 0; i < BENCH_INPUT_BYTES; i++) {
+        input[i] = (unsigned char)alphabet[rand() % n_symbols];
+    }
+
+    printf("{\"bench\":\"regex\",\"family\":\"%s\",\"n\":%d,\"regex_len\":%zu,"
+           "\"build_us\":%.2f,\"nfa_states\":%d,\"nfa_transitions\":%d,\"counters\":%d,"
+           "\"nfa_bytes\":%zu",
+           family, n, strlen(regex), build_us, next_state - 1, trans_count - n_symbols - 1,
+           counter_count, nfa_bytes);
+
+    long hits = -1;
+    if (counter_count > 0) {
+        /* Counted repetition is matched on NFA configurations only. */
+        double mb = BENCH_COUNTED_BYTES / (1024.0 * 1024.0);
+        hits = 0;
+        t0 = now_seconds();
+        int ok = nfa_simulate(searcher, input, BENCH_COUNTED_BYTES, true, &hits);
+        printf(",\"dfa_states\":null,\"dfa_capped\":null,\"subset_ms\":null,\"dfa_bytes\":null,"
+               "\"dfa_mbps\":null,\"bp_positions\":null,\"bp_mbps\":null,\"nfa_mbps\":%.2f",
+               mb / (now_seconds() - t0));
+        if (ok < 0) {
+            printf(",\"error\":\"out of memory\"");
+            hits = -1;
+        }
+
+        /* Cross-check against the counter-free NFA where the expansion fits. */
+        char expanded[MAX_REGEX];
+        if (hits >= 0 && expand_counted(regex, expanded, sizeof(expanded))) {
+            trans_count = 0;
+            next_state = 0;
+            counter_count = 0;
+            insert_concat(expanded, with_concat);
+            to_postfix(with_concat, postfix);
+            Fragment plain = add_search_state(build_nfa(postfix), alphabet, n_symbols);
+            build_adjacency();
+            long plain_hits = 0;
+            nfa_simulate(plain, input, BENCH_COUNTED_BYTES, true, &plain_hits);
+            printf(",\"expanded_matches\":%ld", plain_hits);
+            if (plain_hits != hits) {
+                printf(",\"error\":\"matchers disagree\"");
+            }
+        } else {
+            printf(",\"expanded_matches\":null");
+        }
+    } else {
+        t0 = now_seconds();
+        subset_construct(dfa, searcher, alphabet, n_symbols);
+        double subset_ms = (now_seconds() - t0) * 1e3;
+        size_t dfa_bytes = (size_t)dfa->count *
+                           (sizeof(StateSet) + sizeof(int) * (size_t)n_symbols + sizeof(bool));
+        double mb = BENCH_INPUT_BYTES / (1024.0 * 1024.0);
+
+        printf(",\"dfa_states\":%d,\"dfa_capped\":%s,\"subset_ms\":%.3f,\"dfa_bytes\":%zu",
+               dfa->count, dfa->capped ? "true" : "false", subset_ms, dfa_bytes);
+
+        if (!dfa->capped) {
+            t0 = now_seconds();
+            hits = dfa_count_matches(dfa, sym_class, input, BENCH_INPUT_BYTES);
+            printf(",\"dfa_mbps\":%.1f", mb / (now_seconds() - t0));
+        } else {
+            printf(",\"dfa_mbps\":null");
+        }
+
+        if (build_bit_parallel(postfix, &bp) == BP_BUILT) {
+            t0 = now_seconds();
+            long bp_hits = bp_count_matches(&bp, input, BENCH_INPUT_BYTES);
+            printf(",\"bp_positions\":%d,\"bp_mbps\":%.1f", bp.positions, mb / (now_seconds() - t0));
+            if (hits >= 0 && bp_hits != hits) {
+                printf(",\"error\":\"matchers disagree\"");
+            }
+            hits = bp_hits;
+        } else {
+            printf(",\"bp_positions\":null,\"bp_mbps\":null");
+        }
+        printf(",\"nfa_mbps\":null,\"expanded_matches\":null");
+    }
+
+    printf(",\"matches\":%ld}\n", hits);
+    fflush(stdout);
+}
+
+/*
+ * Stress benchmark over pathological and realistic pattern families.
+ * Output is one JSON object per line so runs can be diffed across commits.
+ */
+static int run_benchmark(void) {
+    static char regex[MAX_REGEX];
+    static char piece[MAX_REGEX];
+    BenchDfa dfa;
+    dfa.hash_size = 2 * BENCH_MAX_DFA;
+    dfa.sets = malloc(sizeof(StateSet) * BENCH_MAX_DFA);
+    dfa.trans = malloc(sizeof(int) * BENCH_MAX_DFA * 64);
+    dfa.accepting = malloc(sizeof(bool) * BENCH_MAX_DFA);
+    dfa.hash = malloc(sizeof(int) * (size_t)dfa.hash_size);
+    unsigned char *input = malloc(BENCH_INPUT_BYTES);
+    if (!dfa.sets || !dfa.trans || !dfa.accepting || !dfa.hash || !input) {
+        return 1;
+    }
+
+    /* (a|b)*a(a|b)^n: DFA needs 2^(n+1) states. */
+    for (int n = 2; n <= 14; n += 4) {
+        repeat_str(piece, "(a|b)", n);
+        snprintf(regex, sizeof(regex), "(a|b)*a%s", piece);
+        bench_pattern("kth_from_end", n, regex, &dfa, input);
+    }
+    /* ((a|aa)*)^n b: heavy epsilon structure, tiny DFA. */
+    for (int n = 1; n <= 16; n *= 4) {
+        repeat_str(piece, "(a|aa)*", n);
+        snprintf(regex, sizeof(regex), "%sb", piece);
+        bench_pattern("alt_star", n, regex, &dfa, input);
+    }
+    /* Nested stars (((a*)*)*)b. */
+    for (int n = 1; n <= 16; n *= 4) {
+        regex[0] = '\0';
+        for (int i = 0; i < n; i++) {
+            strcat(regex, "(");
+        }
+        strcat(regex, "a");
+        for (int i = 0; i < n; i++) {
+            strcat(regex, ")*");
+        }
+        strcat(regex, "b");
+        bench_pattern("nested_star", n, regex, &dfa, input);
+    }
+    /* Literal strings of growing length. */
+    for (int n = 8; n <= 200; n = n * 5) {
+        repeat_str(piece, "abcdefgh", n / 8);
+        bench_pattern("literal", n, piece, &dfa, input);
+    }
+    /* Realistic token patterns. */
+    bench_pattern("keywords", 5, "(if|else|while|for|return)", &dfa, input);
+    bench_pattern("identifier", 1,
+                  "(a|b|c|d|e|f|g|h|i|j|k|l|m|n|o|p|q|r|s|t|u|v|w|x|y|z|_)"
+                  "(a|b|c|d|e|f|g|h|i|j|k|l|m|n|o|p|q|r|s|t|u|v|w|x|y|z|_|0|1|2|3|4|5|6|7|8|9)*",
+                  &dfa, input);
+    bench_pattern("number", 1, "(0|1|2|3|4|5|6|7|8|9)+(_(0|1|2|3|4|5|6|7|8|9)+)?", &dfa, input);
+    /* Counted repetition: NFA size must stay flat as the bound grows. */
+    for (int n = 10; n <= 10000; n *= 10) {
+        snprintf(regex, sizeof(regex), "(ab|ba){%d}a{1,%d}b", n, n);
+        bench_pattern("counted", n, regex, &dfa, input);
+    }
+    /* kth_from_end with a counter: n live counter values per position. */
+    for (int n = 2; n <= 14; n += 4) {
+        snprintf(regex, sizeof(regex), "(a|b)*a(a|b){%d}", n);
+        bench_pattern("counted_kth", n, regex, &dfa, input);
+    }
+
+    free(dfa.sets);
+    free(dfa.trans);
+    free(dfa.accepting);
+    free(dfa.hash);
+    free(input);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        return run_benchmark();
+    }
+
     char input[MAX_REGEX];
     char with_concat[MAX_POSTFIX];
     char postfix[MAX_POSTFIX];
@@ -178,10 +1668,33 @@ int main(void) {
     }
     input[strcspn(input, "\r\n")] = '\0';
 
+    int braces = 0;
+    for (int i = 0; input[i] != '\0'; i++) {
+        braces += input[i] == '{';
+    }
+    if (braces > MAX_COUNTERS) {
+        printf("At most %d counted repetitions are supported.\n", MAX_COUNTERS);
+        return 1;
+    }
+
     insert_concat(input, with_concat);
+    const char *err = check_repeats(with_concat);
+    if (err != NULL) {
+        printf("Syntax error: %s.\n", err);
+        return 1;
+    }
     to_postfix(with_concat, postfix);
 
+    /* build_nfa trusts its input, so a malformed pattern stops here. */
+    static BitParallel bp;
+    int bp_status = build_bit_parallel(postfix, &bp);
+    if (bp_status == BP_MALFORMED) {
+        printf("Syntax error: malformed regular expression.\n");
+        return 1;
+    }
+
     Fragment nfa = build_nfa(postfix);
+    build_adjacency();
 
     printf("\nStart state: %d\n", nfa.start);
     printf("Accept state: %d\n\n", nfa.accept);
@@ -191,12 +1704,86 @@ int main(void) {
     printf("------------------------\n");
     for (int i = 0; i < trans_count; i++) {
         if (transitions[i].symbol == 0) {
-            printf("%-8d %-8s %-8d\n", transitions[i].from, "eps", transitions[i].to);
+            printf("%-8d %-8s %-8d", transitions[i].from, "eps", transitions[i].to);
         } else {
             char sym[2] = { transitions[i].symbol, '\0' };
-            printf("%-8d %-8s %-8d\n", transitions[i].from, sym, transitions[i].to);
+            printf("%-8d %-8s %-8d", transitions[i].from, sym, transitions[i].to);
+        }
+        int k = transitions[i].counter;
+        if (transitions[i].op == OP_ENTER) {
+            printf(" c%d = 0", k);
+        } else if (transitions[i].op == OP_REPEAT && counters[k].max < 0) {
+            printf(" c%d++ (saturates at %d)", k, counters[k].min > 0 ? counters[k].min - 1 : 0);
+        } else if (transitions[i].op == OP_REPEAT) {
+            printf(" c%d++ if c%d+1 < %d", k, k, counters[k].max);
+        } else if (transitions[i].op == OP_EXIT) {
+            printf(" if c%d+1 >= %d", k, counters[k].min);
+        } else if (transitions[i].op == OP_TAG) {
+            printf(" tag t%d (group %d %s)", k, k / 2, k % 2 == 0 ? "open" : "close");
+        }
+        printf("\n");
+    }
+
+    bool use_bp = bp_status == BP_BUILT;
+    if (use_bp) {
+        printf("\nMatcher: bit-parallel Shift-And (%d positions, %d-bit%s)\n",
+               bp.positions, bp.words * 64, bp.linear ? ", linear" : "");
+    } else if (bp_status == BP_COUNTED) {
+        printf("\nMatcher: Thompson NFA simulation (counted repetition, %d counter(s))\n",
+               counter_count);
+    } else {
+        printf("\nMatcher: Thompson NFA simulation (pattern exceeds %d positions)\n",
+               MAX_BP_STATES);
+    }
+
+    /* The text may be far longer than the pattern, e.g. a{n} against n a's. */
+    char *text = NULL;
+    size_t text_cap = 0;
+    printf("Enter string to match: ");
+    if (getline(&text, &text_cap, stdin) < 0) {
+        free(text);
+        return 0;
+    }
+    text[strcspn(text, "\r\n")] = '\0';
+
+    int ok = use_bp ? bp_match(&bp, text) : nfa_match(nfa, text);
+    if (ok < 0) {
+        printf("Out of memory while simulating the NFA.\n");
+        free(text);
+        return 1;
+    }
+    printf("%s\n", ok ? "Accepted" : "Rejected");
+
+    /* Submatches: leftmost-longest search with the tagged DFA. */
+    if (counter_count > 0) {
+        printf("Capture groups are not extracted for counted repetition.\n");
+        free(text);
+        return 0;
+    }
+    static Tdfa tdfa;
+    if (!build_tdfa(&tdfa, nfa, postfix)) {
+        printf("Capture groups: tagged DFA exceeds %d states or %d registers.\n",
+               MAX_TDFA_STATES, MAX_TDFA_REGS);
+        free(text);
+        return 0;
+    }
+    int tags[MAX_TAGS];
+    printf("\nTagged DFA: %d states, %d registers\n", tdfa.state_count, tdfa.reg_count);
+    if (!tdfa_search(&tdfa, (const unsigned char *)text, strlen(text), tags)) {
+        printf("No match found in the input.\n");
+        free(text);
+        return 0;
+    }
+    for (int g = 0; g <= group_count; g++) {
+        int so = tags[2 * g];
+        int eo = tags[2 * g + 1];
+        if (so < 0 || eo < 0) {
+            printf("Group %d: unmatched\n", g);
+        } else {
+            printf("Group %d: [%d, %d) \"%.*s\"\n", g, so, eo, eo - so, text + so);
         }
     }
 
+    free(text);
     return 0;
 }
\ No newline at end of file
@@ -1,9 +1,15 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
+#include <time.h>
 
 #define MAX_STATES 8
 #define MAX_SYMBOLS 2
 #define MAX_DFA_STATES 32
+#define BENCH_BYTES (32u << 20)
+#define STRIDE2_BUDGET (256u << 10)
+#define BENCH_MIN_CLOCKS (CLOCKS_PER_SEC / 5)
 
 typedef unsigned long long Bitset;
 
@@ -100,7 +106,298 @@ static void load_sample_nfa(int *n_states, int *n_symbols, int *start_state, Bit
 	nfa_trans[2][1] |= set_bit(0); /* 2 -b-> 0 */
 }
 
-int main(void) {
+/*
+ * Flat scan tables. Class n_symbols stands for any byte outside the DFA's
+ * alphabet and restarts the scan at D0; -1 means the DFA has no move and
+ * the scan stops. The stride-2 table consumes a pair of classes per load:
+ * each entry is (next_state << 2) | accepting states passed in the pair.
+ */
+typedef struct {
+	int n_classes;
+	signed char class_of[256];
+	int t1[MAX_DFA_STATES * (MAX_SYMBOLS + 1)];
+	bool accepting[MAX_DFA_STATES];
+	int *t2;
+	size_t t1_bytes;
+	size_t t2_bytes;
+} ScanTables;
+
+static int step1(int dfa_trans[][MAX_SYMBOLS], int state, int a, int n_symbols) {
+	if (state < 0) {
+		return -1;
+	}
+	return a == n_symbols ? 0 : dfa_trans[state][a];
+}
+
+static void build_scan_tables(ScanTables *st, int dfa_trans[][MAX_SYMBOLS], const bool *accepting,
+							  int dfa_count, int n_symbols) {
+	int nc = n_symbols + 1;
+	st->n_classes = nc;
+	memset(st->class_of, n_symbols, sizeof(st->class_of));
+	for (int a = 0; a < n_symbols; a++) {
+		st->class_of[(unsigned char)symbols[a]] = (signed char)a;
+	}
+	for (int i = 0; i < dfa_count; i++) {
+		st->accepting[i] = accepting[i];
+		for (int a = 0; a < nc; a++) {
+			st->t1[i * nc + a] = step1(dfa_trans, i, a, n_symbols);
+		}
+	}
+	st->t1_bytes = sizeof(int) * (size_t)(dfa_count * nc);
+
+	/* Only build the pair table when it stays cache-sized. */
+	st->t2 = NULL;
+	st->t2_bytes = sizeof(int) * (size_t)(dfa_count * nc * nc);
+	if (st->t2_bytes > STRIDE2_BUDGET || (st->t2 = malloc(st->t2_bytes)) == NULL) {
+		return;
+	}
+	for (int i = 0; i < dfa_count; i++) {
+		for (int a = 0; a < nc; a++) {
+			int mid = step1(dfa_trans, i, a, n_symbols);
+			for (int b = 0; b < nc; b++) {
+				int end = step1(dfa_trans, mid, b, n_symbols);
+				int e = -1;
+				if (end >= 0) {
+					e = (end << 2) | (accepting[mid] + accepting[end]);
+				}
+				st->t2[(i * nc + a) * nc + b] = e;
+			}
+		}
+	}
+}
+
+/* Number of accepting prefixes, one byte per step, from *state onwards. */
+static long scan_stride1(const ScanTables *st, int *state, const unsigned char *s, size_t n) {
+	long hits = 0;
+	int cur = *state;
+	for (size_t i = 0; i < n; i++) {
+		cur = st->t1[cur * st->n_classes + st->class_of[s[i]]];
+		if (cur < 0) {
+			break;
+		}
+		hits += st->accepting[cur];
+	}
+	*state = cur;
+	return hits;
+}
+
+static long scan_stride2(const ScanTables *st, const unsigned char *s, size_t n) {
+	int nc = st->n_classes;
+	int state = 0;
+	long hits = 0;
+	size_t i = 0;
+	for (; i + 1 < n; i += 2) {
+		int e = st->t2[(state * nc + st->class_of[s[i]]) * nc + st->class_of[s[i + 1]]];
+		if (e < 0) {
+			/* The DFA stops inside this pair; let stride 1 find where. */
+			return hits + scan_stride1(st, &state, s + i, 2);
+		}
+		hits += e & 3;
+		state = e >> 2;
+	}
+	if (i < n) {
+		hits += scan_stride1(st, &state, s + i, n - i);
+	}
+	return hits;
+}
+
+static long dfa_scan(const ScanTables *st, const unsigned char *s, size_t n) {
+	int state = 0;
+	if (st->t2 != NULL) {
+		return scan_stride2(st, s, n);
+	}
+	return scan_stride1(st, &state, s, n);
+}
+
+static void emit_goto(FILE *out, int target, const bool *accepting) {
+	if (accepting[target]) {
+		fprintf(out, "hits++; ");
+	}
+	fprintf(out, "goto D%d;\n", target);
+}
+
+/*
+ * Emit the DFA as a C function with one label per state. Self-loops become
+ * tight inner loops; the other moves are a switch on the input byte. Scan
+ * semantics match dfa_scan: other bytes restart at D0, no move stops.
+ */
+static void emit_dfa_c(FILE *out, int dfa_trans[][MAX_SYMBOLS], const bool *accepting,
+					   int dfa_count, int n_symbols) {
+	fprintf(out, "/* Generated by task3.c: direct-threaded DFA. Do not edit. */\n");
+	fprintf(out, "#include <stddef.h>\n\n");
+	fprintf(out, "static long dfa_gen_count(const unsigned char *s, size_t n) {\n");
+	fprintf(out, "\tconst unsigned char *end = s + n;\n");
+	fprintf(out, "\tlong hits = 0;\n");
+	fprintf(out, "\tgoto D0;\n");
+
+	for (int i = 0; i < dfa_count; i++) {
+		fprintf(out, "D%d:\n", i);
+
+		bool has_loop = false;
+		for (int a = 0; a < n_symbols; a++) {
+			if (dfa_trans[i][a] == i) {
+				has_loop = true;
+			}
+		}
+		if (has_loop) {
+			fprintf(out, "\twhile (s < end && (");
+			bool first = true;
+			for (int a = 0; a < n_symbols; a++) {
+				if (dfa_trans[i][a] == i) {
+					fprintf(out, "%s*s == '%c'", first ? "" : " || ", symbols[a]);
+					first = false;
+				}
+			}
+			fprintf(out, ")) {\n\t\ts++;\n%s\t}\n", accepting[i] ? "\t\thits++;\n" : "");
+		}
+
+		fprintf(out, "\tif (s == end) return hits;\n");
+		fprintf(out, "\tswitch (*s++) {\n");
+		for (int a = 0; a < n_symbols; a++) {
+			int t = dfa_trans[i][a];
+			if (t == i) {
+				continue;
+			}
+			fprintf(out, "\tcase '%c': ", symbols[a]);
+			if (t == -1) {
+				fprintf(out, "return hits;\n");
+			} else {
+				emit_goto(out, t, accepting);
+			}
+		}
+		fprintf(out, "\tdefault: ");
+		emit_goto(out, 0, accepting);
+		fprintf(out, "\t}\n");
+	}
+	fprintf(out, "}\n");
+}
+
+#ifdef TASK3_GENERATED
+#include "task3_dfa_gen.c"
+#endif
+
+enum { MATCH_STRIDE1, MATCH_STRIDE2, MATCH_GENERATED };
+
+static const char *matcher_names[] = { "stride 1", "stride 2", "generated code" };
+
+static long run_matcher(const ScanTables *st, int matcher, const unsigned char *s, size_t n) {
+	int state = 0;
+	switch (matcher) {
+	case MATCH_STRIDE2:
+		return scan_stride2(st, s, n);
+#ifdef TASK3_GENERATED
+	case MATCH_GENERATED:
+		return dfa_gen_count(s, n);
+#endif
+	default:
+		return scan_stride1(st, &state, s, n);
+	}
+}
+
+/* Every round's count lands here, so the compiler cannot hoist a scan out of the timing loop. */
+static volatile long bench_sink;
+
+/*
+ * Scan s in doubling batches until BENCH_MIN_CLOCKS have passed, so a
+ * short input is not timed by a clock that never ticked.
+ */
+static void bench_row(const char *input, const ScanTables *st, int matcher, const unsigned char *s, size_t n) {
+	long hits = 0;
+	long rounds = 0;
+	long batch = 1;
+	clock_t t0 = clock();
+	clock_t t1;
+	do {
+		for (long r = 0; r < batch; r++) {
+			hits = run_matcher(st, matcher, s, n);
+			bench_sink += hits;
+		}
+		rounds += batch;
+		batch *= 2;
+		t1 = clock();
+	} while (t1 - t0 < BENCH_MIN_CLOCKS);
+	double mb = (double)n * rounds / (1024.0 * 1024.0);
+	double secs = (double)(t1 - t0) / CLOCKS_PER_SEC;
+	printf("%-14s %-16s %12ld %12.1f\n", input, matcher_names[matcher], hits, mb / secs);
+}
+
+static void run_benchmark(const ScanTables *st, const char *corpus_path, int n_symbols) {
+	size_t size = BENCH_BYTES;
+	FILE *corpus = NULL;
+	if (corpus_path != NULL) {
+		corpus = fopen(corpus_path, "rb");
+		if (corpus == NULL) {
+			perror("fopen");
+			return;
+		}
+		fseek(corpus, 0, SEEK_END);
+		long len = ftell(corpus);
+		rewind(corpus);
+		if (len > (long)size) {
+			size = (size_t)len;
+		}
+	}
+
+	unsigned char *buf = malloc(size);
+	if (buf == NULL) {
+		return;
+	}
+
+	printf("\nStride-1 table %zu bytes, stride-2 table %zu bytes (%s)\n", st->t1_bytes, st->t2_bytes,
+		   st->t2 != NULL ? "stride 2 selected" : "over budget, stride 1 selected");
+
+	/* Uniform input defeats branch prediction; skewed input has long self-loop runs. */
+	const char *inputs[] = { "uniform", "skewed 1:15", "corpus" };
+	int n_inputs = corpus != NULL ? 3 : 2;
+	printf("%-14s %-16s %12s %12s\n", "Input", "Matcher", "Accepts", "MB/s");
+
+	for (int in = 0; in < n_inputs; in++) {
+		size_t n = BENCH_BYTES;
+		if (in == 2) {
+			n = fread(buf, 1, size, corpus);
+		} else {
+			srand(1);
+			for (size_t i = 0; i < n; i++) {
+				int a = in == 0 ? rand() % n_symbols : (rand() % 16 == 0 ? 0 : n_symbols - 1);
+				buf[i] = (unsigned char)symbols[a];
+			}
+		}
+		if (in == 2) {
+			/*
+			 * Bytes outside the sample alphabet restart at D0. On real text
+			 * that is most of them, and the row then times restarts rather
+			 * than DFA moves, so it is labelled as such.
+			 */
+			size_t restarts = 0;
+			for (size_t i = 0; i < n; i++) {
+				restarts += st->class_of[buf[i]] == n_symbols;
+			}
+			printf("Corpus: %.1f%% of bytes are outside the DFA alphabet and restart the scan\n",
+				   n > 0 ? 100.0 * (double)restarts / (double)n : 0.0);
+			if (2 * restarts > n) {
+				inputs[in] = "corpus/restart";
+			}
+		}
+
+		bench_row(inputs[in], st, MATCH_STRIDE1, buf, n);
+		if (st->t2 != NULL) {
+			bench_row(inputs[in], st, MATCH_STRIDE2, buf, n);
+		}
+#ifdef TASK3_GENERATED
+		bench_row(inputs[in], st, MATCH_GENERATED, buf, n);
+#endif
+	}
+
+#ifndef TASK3_GENERATED
+	printf("Rebuild with -DTASK3_GENERATED after --emit task3_dfa_gen.c to compare generated code.\n");
+#endif
+	if (corpus != NULL) {
+		fclose(corpus);
+	}
+	free(buf);
+}
+
+int main(int argc, char **argv) {
 	int n_states = 0;
 	int n_symbols = 0;
 	int start_state = 0;
@@ -181,5 +478,40 @@ int main(void) {
 	}
 
 	printf("\nNote: *Dk means accepting DFA state.\n");
+
+	bool accepting[MAX_DFA_STATES];
+	for (int i = 0; i < dfa_count; i++) {
+		accepting[i] = (dfa_states[i] & final_mask) != 0ULL;
+	}
+
+	static ScanTables scan;
+	build_scan_tables(&scan, dfa_trans, accepting, dfa_count, n_symbols);
+
+	const char *corpus = NULL;
+	for (int i = 1; i + 1 < argc; i++) {
+		if (strcmp(argv[i], "--corpus") == 0) {
+			corpus = argv[i + 1];
+		}
+	}
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--emit") == 0 && i + 1 < argc) {
+			FILE *out = fopen(argv[++i], "w");
+			if (out == NULL) {
+				perror("fopen");
+				return 1;
+			}
+			emit_dfa_c(out, dfa_trans, accepting, dfa_count, n_symbols);
+			fclose(out);
+			printf("Generated C matcher written to %s\n", argv[i]);
+		} else if (strcmp(argv[i], "--bench") == 0) {
+			run_benchmark(&scan, corpus, n_symbols);
+		} else if (strcmp(argv[i], "--scan") == 0 && i + 1 < argc) {
+			const char *text = argv[++i];
+			printf("Accepting prefixes of \"%s\": %ld\n", text,
+				   dfa_scan(&scan, (const unsigned char *)text, strlen(text)));
+		}
+	}
+	free(scan.t2);
 	return 0;
 }
@@ -1,222 +1,452 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include <stdbool.h>
+#include <time.h>
 
-#define MAX_PROD 26
-#define MAX_ALTS 32
-#define MAX_LEN 64
+#include "grammar.h"
+#include "first_follow.h"
+#include "gram_file.h"
 
-typedef struct {
-	char lhs;
-	int alt_count;
-	char alts[MAX_ALTS][MAX_LEN];
-} Production;
+static Grammar gram;
+static Grammar next_gram;
+
+/* Scratch right-hand side for building rewritten productions. */
+static Sym *scratch;
+static int scratch_cap;
+
+#define MAX_LINE 4096
 
-static Production prods[MAX_PROD];
-static int prod_count = 0;
-static bool used_nt[26];
+#define MAX_PRIMES 3
 
-static void trim_spaces(char *s) {
-	char *p = s;
-	char *q = s;
-	while (*p) {
-		if (!isspace((unsigned char)*p)) {
-			*q++ = *p;
+/*
+ * Fresh nonterminal named after base: E', E'', E''' while those are free,
+ * then numbered names such as <E_4> so large rewrites never run out.
+ */
+static Sym next_nonterminal(Grammar *g, Sym base) {
+	char name[GRAM_MAX_NAME];
+	const char *base_name = gram_nt_name(g, base);
+	int len = snprintf(name, sizeof(name), "%s", base_name);
+	for (int primes = 0; primes < MAX_PRIMES && len + 1 < (int)sizeof(name); primes++) {
+		name[len++] = '\'';
+		name[len] = '\0';
+		if (gram_find_nt(g, name) < 0) {
+			return gram_nt(g, name);
 		}
-		p++;
 	}
-	*q = '\0';
-}
 
-static int find_prod(char lhs) {
-	for (int i = 0; i < prod_count; i++) {
-		if (prods[i].lhs == lhs) {
-			return i;
+	/* Core of the name without brackets or primes. */
+	char core[GRAM_MAX_NAME];
+	int core_len = 0;
+	const char *c = base_name[0] == '<' ? base_name + 1 : base_name;
+	while (*c != '\0' && *c != '>' && *c != '\'' && core_len < 40) {
+		core[core_len++] = *c++;
+	}
+	core[core_len] = '\0';
+	for (int k = 1; k > 0; k++) {
+		snprintf(name, sizeof(name), "<%.40s_%d>", core, k);
+		if (gram_find_nt(g, name) < 0) {
+			return gram_nt(g, name);
 		}
 	}
-	return -1;
+	return GRAM_NO_SYM;
 }
 
-static char next_nonterminal(void) {
-	for (int i = 0; i < 26; i++) {
-		if (!used_nt[i]) {
-			used_nt[i] = true;
-			return (char)('A' + i);
-		}
+static Sym *scratch_rhs(int need) {
+	Sym *p = gram_grow(scratch, &scratch_cap, need, sizeof(Sym));
+	if (p != NULL) {
+		scratch = p;
 	}
-	return '?';
+	return p;
 }
 
-static void add_production(char lhs, const char *alt) {
-	int idx = find_prod(lhs);
-	if (idx == -1) {
-		if (prod_count >= MAX_PROD) {
-			return;
-		}
-		idx = prod_count++;
-		prods[idx].lhs = lhs;
-		prods[idx].alt_count = 0;
-		used_nt[lhs - 'A'] = true;
-	}
-	if (prods[idx].alt_count < MAX_ALTS) {
-		strncpy(prods[idx].alts[prods[idx].alt_count], alt, MAX_LEN - 1);
-		prods[idx].alts[prods[idx].alt_count][MAX_LEN - 1] = '\0';
-		prods[idx].alt_count++;
+/* Replace gram by next_gram, which gives up its storage. */
+static void commit_grammar(void) {
+	gram_free(&gram);
+	gram = next_gram;
+	gram_init(&next_gram, gram.mode);
+	gram_index(&gram);
+}
+
+/*
+ * Alternatives during left-recursion elimination are spans of one shared
+ * arena. Untouched alternatives keep their span, and a substitution only
+ * appends when neither half can be reused as is.
+ */
+typedef struct {
+	int off;
+	int len;
+} Span;
+
+typedef struct {
+	Span *items;
+	int count;
+	int cap;
+} SpanList;
+
+static Sym *arena;
+static int arena_len;
+static int arena_cap;
+
+/* Substitutions stop once the alternatives outgrow the input this many times. */
+#define MAX_GROWTH 64
+
+static bool span_push(SpanList *list, int off, int len) {
+	Span *grown = gram_grow(list->items, &list->cap, list->count + 1, sizeof(Span));
+	if (grown == NULL) {
+		return false;
 	}
+	list->items = grown;
+	list->items[list->count].off = off;
+	list->items[list->count].len = len;
+	list->count++;
+	return true;
 }
 
-static void parse_line(char *line) {
-	trim_spaces(line);
-	if (strlen(line) < 4) {
-		return;
+/* Append a[..] followed by b[..] (both already in the arena) as a new span. */
+static bool arena_concat(SpanList *list, Span a, Span b) {
+	if (a.len == 0) {
+		return span_push(list, b.off, b.len);
 	}
-	char lhs = line[0];
-	if (!isupper((unsigned char)lhs)) {
-		return;
+	if (b.len == 0) {
+		return span_push(list, a.off, a.len);
 	}
-	char *arrow = strstr(line, "->");
-	if (!arrow) {
-		return;
+	Sym *grown = gram_grow(arena, &arena_cap, arena_len + a.len + b.len, sizeof(Sym));
+	if (grown == NULL) {
+		return false;
+	}
+	arena = grown;
+	int off = arena_len;
+	memcpy(arena + arena_len, arena + a.off, sizeof(Sym) * (size_t)a.len);
+	arena_len += a.len;
+	memcpy(arena + arena_len, arena + b.off, sizeof(Sym) * (size_t)b.len);
+	arena_len += b.len;
+	return span_push(list, off, a.len + b.len);
+}
+
+/* Left-corner graph: A -> B when some alternative of A starts with B. */
+static int left_corner_components(int *comp) {
+	FfGraph gr;
+	if (!ff_graph_init(&gr, gram.nt_count)) {
+		return -1;
 	}
-	char *rhs = arrow + 2;
-	char *token = strtok(rhs, "|");
-	while (token) {
-		add_production(lhs, token);
-		token = strtok(NULL, "|");
+	bool ok = true;
+	for (int p = 0; p < gram.prod_count && ok; p++) {
+		const Sym *rhs = gram_rhs(&gram, p);
+		if (gram_rhs_len(&gram, p) > 0 && !gram_is_term(rhs[0])) {
+			ok = ff_graph_edge(&gr, gram.prod_lhs[p], rhs[0]);
+		}
 	}
+	int count = ok && ff_graph_finish(&gr) ? ff_graph_scc(&gr, comp) : -1;
+	ff_graph_free(&gr);
+	return count;
 }
 
-static void print_grammar(const char *title) {
-	printf("%s\n", title);
-	for (int i = 0; i < prod_count; i++) {
-		printf("%c -> ", prods[i].lhs);
-		for (int j = 0; j < prods[i].alt_count; j++) {
-			printf("%s", prods[i].alts[j]);
-			if (j + 1 < prods[i].alt_count) {
-				printf(" | ");
-			}
+/* A -> A alpha | beta  becomes  A -> beta A', A' -> alpha A' | eps */
+static bool remove_immediate(SpanList *alts, Sym a, SpanList *out, Sym *new_nt) {
+	bool recursive = false;
+	for (int k = 0; k < alts[a].count; k++) {
+		Span s = alts[a].items[k];
+		recursive = recursive || (s.len > 0 && arena[s.off] == a);
+	}
+	*new_nt = GRAM_NO_SYM;
+	if (!recursive) {
+		return true;
+	}
+	*new_nt = next_nonterminal(&next_gram, a);
+	if (*new_nt == GRAM_NO_SYM) {
+		return false;
+	}
+
+	Sym *tail = gram_grow(arena, &arena_cap, arena_len + 1, sizeof(Sym));
+	if (tail == NULL) {
+		return false;
+	}
+	arena = tail;
+	Span prime = { arena_len, 1 };
+	arena[arena_len++] = *new_nt;
+
+	SpanList kept = { 0 };
+	bool ok = true;
+	for (int k = 0; k < alts[a].count && ok; k++) {
+		Span s = alts[a].items[k];
+		if (s.len > 0 && arena[s.off] == a) {
+			/* A -> A on its own derives nothing new and is dropped. */
+			Span alpha = { s.off + 1, s.len - 1 };
+			ok = alpha.len == 0 || arena_concat(out, alpha, prime);
+		} else {
+			ok = arena_concat(&kept, s, prime);
 		}
-		printf("\n");
 	}
-	printf("\n");
+	ok = ok && span_push(out, 0, 0);
+	free(alts[a].items);
+	alts[a] = kept;
+	return ok;
 }
 
+/*
+ * Ordered substitution for indirect left recursion. Nonterminals are taken
+ * in index order; before A_i loses its immediate recursion, every
+ * alternative A_i -> A_j gamma with j < i has A_j's current alternatives
+ * substituted in. Only A_j in the same left-corner component as A_i can
+ * lead back to A_i, so the others are left alone, which keeps the growth
+ * down; past MAX_GROWTH times the input size substitution stops and the
+ * remaining indirect recursion is reported.
+ */
 static void eliminate_left_recursion(void) {
-	int original_count = prod_count;
-	for (int i = 0; i < original_count; i++) {
-		Production *p = &prods[i];
-		char alpha[MAX_ALTS][MAX_LEN];
-		char beta[MAX_ALTS][MAX_LEN];
-		int alpha_count = 0;
-		int beta_count = 0;
-
-		for (int j = 0; j < p->alt_count; j++) {
-			char *alt = p->alts[j];
-			if (alt[0] == p->lhs) {
-				strncpy(alpha[alpha_count], alt + 1, MAX_LEN - 1);
-				alpha[alpha_count][MAX_LEN - 1] = '\0';
-				alpha_count++;
-			} else {
-				strncpy(beta[beta_count], alt, MAX_LEN - 1);
-				beta[beta_count][MAX_LEN - 1] = '\0';
-				beta_count++;
+	int original_count = gram.nt_count;
+	int original_prods = gram.prod_count;
+	clock_t t0 = clock();
+	long substitutions = 0;
+	int skipped = 0;
+
+	int *comp = malloc(sizeof(int) * (size_t)(original_count > 0 ? original_count : 1));
+	SpanList *alts = calloc((size_t)original_count + 1, sizeof(SpanList));
+	SpanList *primes = calloc((size_t)original_count + 1, sizeof(SpanList));
+	Sym *prime_of = malloc(sizeof(Sym) * (size_t)(original_count > 0 ? original_count : 1));
+	arena_len = 0;
+	Sym *copy = gram_grow(arena, &arena_cap, gram.prod_off[gram.prod_count], sizeof(Sym));
+	if (!comp || !alts || !primes || !prime_of || !copy || left_corner_components(comp) < 0) {
+		free(comp);
+		free(alts);
+		free(primes);
+		free(prime_of);
+		return;
+	}
+	arena = copy;
+	memcpy(arena, gram.rhs, sizeof(Sym) * (size_t)gram.prod_off[gram.prod_count]);
+	arena_len = gram.prod_off[gram.prod_count];
+
+	bool ok = true;
+	long total = original_prods;
+	for (int p = 0; p < gram.prod_count && ok; p++) {
+		ok = span_push(&alts[gram.prod_lhs[p]], gram.prod_off[p], gram_rhs_len(&gram, p));
+	}
+	gram_copy_symbols(&next_gram, &gram);
+
+	for (int i = 0; i < original_count && ok; i++) {
+		bool substituted = true;
+		while (substituted && ok) {
+			substituted = false;
+			SpanList next = { 0 };
+			for (int k = 0; k < alts[i].count && ok; k++) {
+				Span s = alts[i].items[k];
+				Sym j = s.len > 0 ? arena[s.off] : GRAM_NO_SYM;
+				bool expand = j != GRAM_NO_SYM && !gram_is_term(j) && j < i && comp[j] == comp[i];
+				if (expand && total + alts[j].count > (long)original_prods * MAX_GROWTH) {
+					skipped++;
+					expand = false;
+				}
+				if (!expand) {
+					ok = span_push(&next, s.off, s.len);
+					continue;
+				}
+				Span gamma = { s.off + 1, s.len - 1 };
+				for (int d = 0; d < alts[j].count && ok; d++) {
+					ok = arena_concat(&next, alts[j].items[d], gamma);
+				}
+				total += alts[j].count - 1;
+				substitutions++;
+				substituted = true;
 			}
+			free(alts[i].items);
+			alts[i] = next;
 		}
-
-		if (alpha_count == 0) {
-			continue;
+		ok = ok && remove_immediate(alts, (Sym)i, &primes[i], &prime_of[i]);
+		if (prime_of[i] != GRAM_NO_SYM) {
+			total += 1;
 		}
+	}
 
-		char new_nt = next_nonterminal();
-		p->alt_count = 0;
-		for (int j = 0; j < beta_count; j++) {
-			char buf[MAX_LEN];
-			snprintf(buf, sizeof(buf), "%s%c", beta[j], new_nt);
-			add_production(p->lhs, buf);
+	for (int a = 0; a < original_count && ok; a++) {
+		for (int k = 0; k < alts[a].count; k++) {
+			gram_add_prod(&next_gram, (Sym)a, arena + alts[a].items[k].off, alts[a].items[k].len);
 		}
-
-		for (int j = 0; j < alpha_count; j++) {
-			char buf[MAX_LEN];
-			snprintf(buf, sizeof(buf), "%s%c", alpha[j], new_nt);
-			add_production(new_nt, buf);
+		for (int k = 0; k < primes[a].count; k++) {
+			gram_add_prod(&next_gram, prime_of[a], arena + primes[a].items[k].off, primes[a].items[k].len);
 		}
-		add_production(new_nt, "eps");
+	}
+	for (int a = 0; a < original_count; a++) {
+		free(alts[a].items);
+		free(primes[a].items);
+	}
+	free(comp);
+	free(alts);
+	free(primes);
+	free(prime_of);
+	if (!ok) {
+		gram_free(&next_gram);
+		gram_init(&next_gram, gram.mode);
+		return;
+	}
+	commit_grammar();
+
+	printf("Left recursion: %d -> %d productions, %ld substitutions, %.3f ms\n", original_prods,
+		   gram.prod_count, substitutions, (double)(clock() - t0) * 1000.0 / CLOCKS_PER_SEC);
+	if (skipped > 0) {
+		printf("Substitution limit reached; %d indirect left corners were left in place.\n", skipped);
 	}
 }
 
-static int common_prefix_len(const char *a, const char *b) {
-	int i = 0;
-	while (a[i] && b[i] && a[i] == b[i]) {
-		i++;
+/*
+ * Symbol trie over one nonterminal's alternatives; node 0 is the root.
+ * Children are kept in insertion order for output and found through a
+ * hash on (parent, symbol), so building the trie is linear in the total
+ * length of the alternatives.
+ */
+typedef struct {
+	int parent;
+	Sym sym;
+	bool ends;
+	int children;
+	int first_child;
+	int last_child;
+	int next_sibling;
+} TrieNode;
+
+static TrieNode *trie;
+static int trie_count;
+static int trie_cap;
+static int *trie_hash;
+static int trie_hash_cap;
+static int trie_hash_size;
+
+static unsigned trie_slot(int parent, Sym sym) {
+	unsigned h = ((unsigned)parent * 2654435761u) ^ ((unsigned)sym * 40503u);
+	unsigned mask = (unsigned)trie_hash_size - 1;
+	h &= mask;
+	while (trie_hash[h] != -1 && (trie[trie_hash[h]].parent != parent || trie[trie_hash[h]].sym != sym)) {
+		h = (h + 1) & mask;
 	}
-	return i;
+	return h;
 }
 
-static bool left_factor_one(Production *p) {
-	int best_len = 0;
-	char best_prefix[MAX_LEN] = {0};
-
-	for (int i = 0; i < p->alt_count; i++) {
-		for (int j = i + 1; j < p->alt_count; j++) {
-			int len = common_prefix_len(p->alts[i], p->alts[j]);
-			if (len > best_len) {
-				best_len = len;
-				strncpy(best_prefix, p->alts[i], len);
-				best_prefix[len] = '\0';
-			}
+static int trie_new_node(int parent, Sym sym) {
+	TrieNode *grown = gram_grow(trie, &trie_cap, trie_count + 1, sizeof(TrieNode));
+	if (grown == NULL) {
+		return -1;
+	}
+	trie = grown;
+	TrieNode *n = &trie[trie_count];
+	n->parent = parent;
+	n->sym = sym;
+	n->ends = false;
+	n->children = 0;
+	n->first_child = -1;
+	n->last_child = -1;
+	n->next_sibling = -1;
+	if (parent >= 0) {
+		TrieNode *up = &trie[parent];
+		if (up->last_child < 0) {
+			up->first_child = trie_count;
+		} else {
+			trie[up->last_child].next_sibling = trie_count;
 		}
+		up->last_child = trie_count;
+		up->children++;
 	}
+	return trie_count++;
+}
 
-	if (best_len == 0) {
-		return false;
+/* Build the trie for lhs; returns the longest alternative, or -1 on failure. */
+static int build_trie(Sym lhs) {
+	int first = gram.nt_first[lhs];
+	int last = gram.nt_first[lhs + 1];
+	int total = 1;
+	int longest = 0;
+	for (int k = first; k < last; k++) {
+		int len = gram_rhs_len(&gram, gram.nt_prods[k]);
+		total += len;
+		longest = len > longest ? len : longest;
 	}
 
-	char new_nt = next_nonterminal();
-	char new_alts[MAX_ALTS][MAX_LEN];
-	int new_alt_count = 0;
-	char factored_suffixes[MAX_ALTS][MAX_LEN];
-	int suffix_count = 0;
+	/* At most total nodes, so a power of two above twice that stays half empty. */
+	int size = 16;
+	while (size < 2 * total) {
+		size *= 2;
+	}
+	int *table = gram_grow(trie_hash, &trie_hash_cap, size, sizeof(int));
+	if (table == NULL) {
+		return -1;
+	}
+	trie_hash = table;
+	trie_hash_size = size;
+	memset(trie_hash, -1, sizeof(int) * (size_t)size);
+	trie_count = 0;
+	if (trie_new_node(-1, GRAM_NO_SYM) < 0) {
+		return -1;
+	}
 
-	for (int i = 0; i < p->alt_count; i++) {
-		if (strncmp(p->alts[i], best_prefix, best_len) == 0) {
-			const char *suffix = p->alts[i] + best_len;
-			if (*suffix == '\0') {
-				strncpy(factored_suffixes[suffix_count++], "eps", MAX_LEN - 1);
-			} else {
-				strncpy(factored_suffixes[suffix_count++], suffix, MAX_LEN - 1);
+	for (int k = first; k < last; k++) {
+		int p = gram.nt_prods[k];
+		const Sym *rhs = gram_rhs(&gram, p);
+		int node = 0;
+		for (int i = 0; i < gram_rhs_len(&gram, p); i++) {
+			unsigned h = trie_slot(node, rhs[i]);
+			if (trie_hash[h] == -1) {
+				int child = trie_new_node(node, rhs[i]);
+				if (child < 0) {
+					return -1;
+				}
+				trie_hash[h] = child;
 			}
-		} else {
-			strncpy(new_alts[new_alt_count++], p->alts[i], MAX_LEN - 1);
+			node = trie_hash[h];
 		}
+		trie[node].ends = true;
 	}
+	return longest;
+}
 
-	char factored[MAX_LEN];
-	snprintf(factored, sizeof(factored), "%s%c", best_prefix, new_nt);
-	strncpy(new_alts[new_alt_count++], factored, MAX_LEN - 1);
-
-	p->alt_count = 0;
-	for (int i = 0; i < new_alt_count; i++) {
-		add_production(p->lhs, new_alts[i]);
+/*
+ * Emit lhs's alternatives below node. Chains without a branch are copied
+ * into one right-hand side; a node where alternatives split (two children,
+ * or a child plus an alternative ending there) gets a fresh nonterminal.
+ */
+static void factor_node(int node, Sym lhs) {
+	for (int c = trie[node].first_child; c != -1; c = trie[c].next_sibling) {
+		int len = 0;
+		int n = c;
+		scratch[len++] = trie[n].sym;
+		while (!trie[n].ends && trie[n].children == 1) {
+			n = trie[n].first_child;
+			scratch[len++] = trie[n].sym;
+		}
+		if (trie[n].children == 0) {
+			gram_add_prod(&next_gram, lhs, scratch, len);
+			continue;
+		}
+		Sym new_nt = next_nonterminal(&next_gram, lhs);
+		scratch[len++] = new_nt;
+		gram_add_prod(&next_gram, lhs, scratch, len);
+		factor_node(n, new_nt);
 	}
-
-	for (int i = 0; i < suffix_count; i++) {
-		add_production(new_nt, factored_suffixes[i]);
+	if (trie[node].ends) {
+		gram_add_prod(&next_gram, lhs, NULL, 0);
 	}
-
-	return true;
 }
 
+/* Factor every shared prefix of every nonterminal in one pass over its trie. */
 static void left_factoring(void) {
-	for (int i = 0; i < prod_count; i++) {
-		while (left_factor_one(&prods[i])) {
+	gram_copy_symbols(&next_gram, &gram);
+	for (int a = 0; a < gram.nt_count; a++) {
+		int longest = build_trie((Sym)a);
+		if (longest < 0 || scratch_rhs(longest + 1) == NULL) {
+			return;
 		}
+		factor_node(0, (Sym)a);
 	}
+	commit_grammar();
 }
 
-int main(void) {
+int main(int argc, char **argv) {
 	int n = 0;
-	char line[256];
+	static char line[MAX_LINE];
+	const char *grammar_path = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+			grammar_path = argv[++i];
+		}
+	}
 
 	printf("Ambiguity Example (Expression Grammar)\n");
 	printf("Ambiguous: E -> E+E | E*E | (E) | id\n");
@@ -227,25 +457,34 @@ int main(void) {
 	printf("T' -> * F T' | eps\n");
 	printf("F -> (E) | id\n\n");
 
-	printf("Enter number of productions: ");
-	if (scanf("%d", &n) != 1 || n <= 0 || n > MAX_PROD) {
-		return 1;
-	}
-	fgets(line, sizeof(line), stdin);
-
-	for (int i = 0; i < n; i++) {
-		printf("Enter production %d (e.g., A->Aa|b): ", i + 1);
-		if (!fgets(line, sizeof(line), stdin)) {
+	gram_init(&gram, GRAM_TOK_CHAR);
+	if (grammar_path != NULL) {
+		GramError err;
+		if (!gram_load_file(&gram, grammar_path, &err)) {
+			gram_print_error(grammar_path, &err);
+			return 1;
+		}
+	} else {
+		printf("Enter number of productions: ");
+		if (scanf("%d", &n) != 1 || n <= 0) {
 			return 1;
 		}
-		parse_line(line);
+		fgets(line, sizeof(line), stdin);
+		for (int i = 0; i < n; i++) {
+			printf("Enter production %d (e.g., A->Aa|b): ", i + 1);
+			if (!fgets(line, sizeof(line), stdin)) {
+				return 1;
+			}
+			gram_parse_line(&gram, line);
+		}
 	}
+	gram_index(&gram);
 
-	print_grammar("Input Grammar");
+	gram_print(&gram, "Input Grammar");
 	eliminate_left_recursion();
-	print_grammar("After Left Recursion Elimination");
+	gram_print(&gram, "After Left Recursion Elimination");
 	left_factoring();
-	print_grammar("After Left Factoring");
+	gram_print(&gram, "After Left Factoring");
 
 	return 0;
 }
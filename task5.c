@@ -1,374 +1,260 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include <stdbool.h>
-
-#define MAX_PROD 26
-#define MAX_ALTS 32
-#define MAX_TOKENS 32
-#define MAX_TOKEN_LEN 16
-#define MAX_TERMS 64
-
-typedef struct {
-	int token_count;
-	char tokens[MAX_TOKENS][MAX_TOKEN_LEN];
-} Alternative;
-
-typedef struct {
-	char lhs;
-	int alt_count;
-	Alternative alts[MAX_ALTS];
-} Production;
-
-static Production prods[MAX_PROD];
-static int prod_count = 0;
-
-static char nt_list[MAX_PROD];
-static int nt_count = 0;
-
-static char term_list[MAX_TERMS][MAX_TOKEN_LEN];
-static int term_count = 0;
-
-static bool first_set[MAX_PROD][MAX_TERMS];
-static bool first_eps[MAX_PROD];
-static bool follow_set[MAX_PROD][MAX_TERMS];
-
-static void trim_spaces(char *s) {
-	char *p = s;
-	char *q = s;
-	while (*p) {
-		if (!isspace((unsigned char)*p)) {
-			*q++ = *p;
+#include <time.h>
+
+#include "grammar.h"
+#include "first_follow.h"
+#include "gram_file.h"
+
+#define MAX_LINE 4096
+#define BENCH_ROUNDS 10
+#define BENCH_MAX_THREADS 16
+
+static Grammar gram;
+static FirstFollow ff;
+
+/*
+ * Print order, as the sets were printed before the shared grammar IR:
+ * nonterminals in the order they first appear on a left-hand side, then
+ * undefined ones; terminals in the order they appear in those
+ * nonterminals' productions, then the rest (such as $).
+ */
+static int *nt_order;
+static int nt_order_count;
+static int *term_order;
+
+static bool build_print_order(void) {
+	nt_order = malloc(sizeof(int) * (size_t)(gram.nt_count > 0 ? gram.nt_count : 1));
+	term_order = malloc(sizeof(int) * (size_t)(gram.term_count > 0 ? gram.term_count : 1));
+	bool *seen_nt = calloc((size_t)gram.nt_count + 1, sizeof(bool));
+	bool *seen_term = calloc((size_t)gram.term_count + 1, sizeof(bool));
+	bool ok = nt_order && term_order && seen_nt && seen_term && gram_index(&gram);
+	int terms = 0;
+	nt_order_count = 0;
+	for (int p = 0; ok && p < gram.prod_count; p++) {
+		int a = gram.prod_lhs[p];
+		if (!seen_nt[a]) {
+			seen_nt[a] = true;
+			nt_order[nt_order_count++] = a;
 		}
-		p++;
 	}
-	*q = '\0';
-}
-
-static int nt_index(char nt) {
-	for (int i = 0; i < nt_count; i++) {
-		if (nt_list[i] == nt) {
-			return i;
+	for (int i = 0; ok && i < nt_order_count; i++) {
+		int a = nt_order[i];
+		for (int k = gram.nt_first[a]; k < gram.nt_first[a + 1]; k++) {
+			int p = gram.nt_prods[k];
+			for (int j = 0; j < gram_rhs_len(&gram, p); j++) {
+				Sym s = gram_rhs(&gram, p)[j];
+				if (!gram_is_term(s) && !seen_nt[s]) {
+					seen_nt[s] = true;
+					nt_order[nt_order_count++] = s;
+				} else if (gram_is_term(s) && !seen_term[gram_term_index(s)]) {
+					seen_term[gram_term_index(s)] = true;
+					term_order[terms++] = gram_term_index(s);
+				}
+			}
 		}
 	}
-	if (nt_count < MAX_PROD) {
-		nt_list[nt_count] = nt;
-		return nt_count++;
-	}
-	return -1;
-}
-
-static int term_index(const char *t) {
-	for (int i = 0; i < term_count; i++) {
-		if (strcmp(term_list[i], t) == 0) {
-			return i;
+	for (int t = 0; ok && t < gram.term_count; t++) {
+		if (!seen_term[t]) {
+			term_order[terms++] = t;
 		}
 	}
-	if (term_count < MAX_TERMS) {
-		strncpy(term_list[term_count], t, MAX_TOKEN_LEN - 1);
-		term_list[term_count][MAX_TOKEN_LEN - 1] = '\0';
-		return term_count++;
-	}
-	return -1;
+	free(seen_nt);
+	free(seen_term);
+	return ok;
 }
 
-static int find_prod(char lhs) {
-	for (int i = 0; i < prod_count; i++) {
-		if (prods[i].lhs == lhs) {
-			return i;
+static void print_sets(const char *title, const uint64_t *sets, bool show_eps) {
+	printf("%s\n", title);
+	for (int i = 0; i < nt_order_count; i++) {
+		const uint64_t *set = sets + (size_t)nt_order[i] * (size_t)ff.words;
+		printf("%s: { ", gram_nt_name(&gram, nt_order[i]));
+		bool first = true;
+		for (int k = 0; k < gram.term_count; k++) {
+			int t = term_order[k];
+			if (ff_has_term(set, t)) {
+				if (!first) {
+					printf(", ");
+				}
+				printf("%s", gram_term_name(&gram, t));
+				first = false;
+			}
+		}
+		if (show_eps && ff_test(set, FF_EPS)) {
+			if (!first) {
+				printf(", ");
+			}
+			printf("eps");
 		}
+		printf(" }\n");
 	}
-	return -1;
+	printf("\n");
 }
 
-static void add_token(Alternative *alt, const char *tok) {
-	if (alt->token_count < MAX_TOKENS) {
-		strncpy(alt->tokens[alt->token_count], tok, MAX_TOKEN_LEN - 1);
-		alt->tokens[alt->token_count][MAX_TOKEN_LEN - 1] = '\0';
-		alt->token_count++;
-	}
+static double bench_ms(clock_t t0) {
+	return (double)(clock() - t0) * 1000.0 / CLOCKS_PER_SEC;
 }
 
-static void tokenize_rhs(const char *rhs, Alternative *alt) {
-	alt->token_count = 0;
-	if (strcmp(rhs, "eps") == 0) {
-		add_token(alt, "eps");
-		return;
-	}
-
-	int i = 0;
-	while (rhs[i] != '\0') {
-		if (isupper((unsigned char)rhs[i])) {
-			char tok[2] = { rhs[i], '\0' };
-			add_token(alt, tok);
-			i++;
-		} else if (islower((unsigned char)rhs[i]) || isdigit((unsigned char)rhs[i])) {
-			char tok[MAX_TOKEN_LEN];
-			int k = 0;
-			while ((islower((unsigned char)rhs[i]) || isdigit((unsigned char)rhs[i])) && k < MAX_TOKEN_LEN - 1) {
-				tok[k++] = rhs[i++];
-			}
-			tok[k] = '\0';
-			add_token(alt, tok);
-		} else {
-			char tok[2] = { rhs[i], '\0' };
-			add_token(alt, tok);
-			i++;
-		}
-	}
+static double wall_ms(const struct timespec *t0) {
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (double)(t1.tv_sec - t0->tv_sec) * 1000.0 + (double)(t1.tv_nsec - t0->tv_nsec) / 1e6;
 }
 
-static void parse_line(char *line) {
-	trim_spaces(line);
-	if (strlen(line) < 4) {
-		return;
-	}
-	char lhs = line[0];
-	if (!isupper((unsigned char)lhs)) {
+/* Components and levels of the FIRST graph: how much work each level offers the threads. */
+static void print_levels(void) {
+	FfGraph gr;
+	FfComponents cs;
+	if (!ff_graph_init(&gr, gram.nt_count)) {
 		return;
 	}
-	char *arrow = strstr(line, "->");
-	if (!arrow) {
-		return;
+	bool ok = true;
+	for (int p = 0; ok && p < gram.prod_count; p++) {
+		ok = ff_first_production(&gram, &ff, &gr, p, false);
 	}
-	int pidx = find_prod(lhs);
-	if (pidx == -1) {
-		pidx = prod_count++;
-		prods[pidx].lhs = lhs;
-		prods[pidx].alt_count = 0;
-		nt_index(lhs);
-	}
-
-	char *rhs = arrow + 2;
-	char *token = strtok(rhs, "|");
-	while (token) {
-		if (prods[pidx].alt_count < MAX_ALTS) {
-			tokenize_rhs(token, &prods[pidx].alts[prods[pidx].alt_count]);
-			prods[pidx].alt_count++;
+	int *level = malloc(sizeof(int) * (size_t)(gram.nt_count > 0 ? gram.nt_count : 1));
+	if (ok && level && ff_graph_finish(&gr) && ff_components(&gr, &cs)) {
+		int levels = ff_component_levels(&gr, &cs, level);
+		int *width = calloc((size_t)levels + 1, sizeof(int));
+		int widest = 0;
+		int largest = 0;
+		for (int c = 0; width && c < cs.count; c++) {
+			width[level[c]]++;
+			widest = width[level[c]] > widest ? width[level[c]] : widest;
+			int size = cs.first[c + 1] - cs.first[c];
+			largest = size > largest ? size : largest;
 		}
-		token = strtok(NULL, "|");
+		printf("FIRST graph: %d components (largest %d), %d levels, widest level %d\n", cs.count, largest, levels,
+			   widest);
+		free(width);
+		ff_components_free(&cs);
 	}
+	free(level);
+	ff_graph_free(&gr);
 }
 
-static bool is_nonterminal(const char *tok) {
-	return strlen(tok) == 1 && isupper((unsigned char)tok[0]);
-}
-
-static bool is_epsilon(const char *tok) {
-	return strcmp(tok, "eps") == 0;
-}
-
-static void collect_terminals(void) {
-	for (int i = 0; i < prod_count; i++) {
-		for (int j = 0; j < prods[i].alt_count; j++) {
-			Alternative *alt = &prods[i].alts[j];
-			for (int k = 0; k < alt->token_count; k++) {
-				if (is_nonterminal(alt->tokens[k]) || is_epsilon(alt->tokens[k])) {
-					continue;
-				}
-				term_index(alt->tokens[k]);
-			}
-		}
-	}
-	term_index("$");
-}
-
-static bool add_first(int A, int t) {
-	if (!first_set[A][t]) {
-		first_set[A][t] = true;
-		return true;
-	}
-	return false;
-}
-
-static bool add_follow(int A, int t) {
-	if (!follow_set[A][t]) {
-		follow_set[A][t] = true;
-		return true;
+/*
+ * Best-of-N FIRST+FOLLOW time, sequential and (with FF_PARALLEL) on 1 to
+ * 16 threads, each threaded result checked against the sequential one.
+ */
+static int run_benchmark(int dollar) {
+	printf("%d nonterminals, %d terminals, %d productions\n", gram.nt_count, gram.term_count, gram.prod_count);
+	ff.threads = 1;
+	if (!ff_compute(&gram, &ff, dollar)) {
+		return 1;
 	}
-	return false;
-}
-
-static bool compute_first(void) {
-	bool changed = false;
-	for (int i = 0; i < prod_count; i++) {
-		int A = nt_index(prods[i].lhs);
-		for (int j = 0; j < prods[i].alt_count; j++) {
-			Alternative *alt = &prods[i].alts[j];
-			bool all_eps = true;
-
-			for (int k = 0; k < alt->token_count; k++) {
-				const char *tok = alt->tokens[k];
-				if (is_epsilon(tok)) {
-					if (!first_eps[A]) {
-						first_eps[A] = true;
-						changed = true;
-					}
-					all_eps = false;
-					break;
-				} else if (!is_nonterminal(tok)) {
-					int t = term_index(tok);
-					if (add_first(A, t)) {
-						changed = true;
-					}
-					all_eps = false;
-					break;
-				} else {
-					int B = nt_index(tok[0]);
-					for (int t = 0; t < term_count; t++) {
-						if (first_set[B][t] && add_first(A, t)) {
-							changed = true;
-						}
-					}
-					if (!first_eps[B]) {
-						all_eps = false;
-						break;
-					}
-				}
-			}
-
-			if (all_eps) {
-				if (!first_eps[A]) {
-					first_eps[A] = true;
-					changed = true;
-				}
-			}
-		}
+	print_levels();
+	size_t set_bytes = sizeof(uint64_t) * (size_t)ff.words * (size_t)gram.nt_count;
+	uint64_t *first = malloc(set_bytes > 0 ? set_bytes : 1);
+	uint64_t *follow = malloc(set_bytes > 0 ? set_bytes : 1);
+	if (!first || !follow) {
+		return 1;
 	}
-	return changed;
-}
-
-static void first_of_sequence(Alternative *alt, int start, bool *out_first, bool *out_eps) {
-	bool all_eps = true;
-	for (int k = start; k < alt->token_count; k++) {
-		const char *tok = alt->tokens[k];
-		if (is_epsilon(tok)) {
-			*out_eps = true;
-			all_eps = false;
-			break;
-		} else if (!is_nonterminal(tok)) {
-			int t = term_index(tok);
-			out_first[t] = true;
-			all_eps = false;
+	memcpy(first, ff.first, set_bytes);
+	memcpy(follow, ff.follow, set_bytes);
+
+	printf("%-12s %12s %12s %10s\n", "Solver", "wall ms", "cpu ms", "speedup");
+	double base = 0;
+	for (int threads = 0; threads <= BENCH_MAX_THREADS; threads = threads == 0 ? 1 : threads * 2) {
+#ifndef FF_PARALLEL
+		if (threads > 0) {
+			printf("Rebuild with -DFF_PARALLEL -pthread to time the threaded solver.\n");
 			break;
-		} else {
-			int B = nt_index(tok[0]);
-			for (int t = 0; t < term_count; t++) {
-				if (first_set[B][t]) {
-					out_first[t] = true;
-				}
+		}
+#endif
+		ff.threads = threads;
+		double best = 1e30;
+		double cpu = 0;
+		for (int r = 0; r < BENCH_ROUNDS; r++) {
+			struct timespec t0;
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			clock_t c0 = clock();
+			if (!ff_compute(&gram, &ff, dollar)) {
+				return 1;
 			}
-			if (!first_eps[B]) {
-				all_eps = false;
-				break;
+			double ms = wall_ms(&t0);
+			if (ms < best) {
+				best = ms;
+				cpu = bench_ms(c0);
 			}
 		}
+		if (memcmp(first, ff.first, set_bytes) != 0 || memcmp(follow, ff.follow, set_bytes) != 0) {
+			printf("%d threads: sets differ from the sequential solve\n", threads);
+			return 1;
+		}
+		base = threads == 0 ? best : base;
+		char name[32];
+		snprintf(name, sizeof(name), threads == 0 ? "sequential" : threads == 1 ? "1 thread" : "%d threads", threads);
+		printf("%-12s %12.3f %12.3f %9.2fx\n", name, best, cpu, best > 0 ? base / best : 0.0);
 	}
-	if (all_eps) {
-		*out_eps = true;
-	}
+	free(first);
+	free(follow);
+	return 0;
 }
 
-static bool compute_follow(void) {
-	bool changed = false;
-	int dollar = term_index("$");
-	int start_nt = nt_index(prods[0].lhs);
-	if (add_follow(start_nt, dollar)) {
-		changed = true;
-	}
-
-	for (int i = 0; i < prod_count; i++) {
-		int A = nt_index(prods[i].lhs);
-		for (int j = 0; j < prods[i].alt_count; j++) {
-			Alternative *alt = &prods[i].alts[j];
-			for (int k = 0; k < alt->token_count; k++) {
-				const char *tok = alt->tokens[k];
-				if (!is_nonterminal(tok)) {
-					continue;
-				}
-
-				int B = nt_index(tok[0]);
-				bool seq_first[MAX_TERMS] = {0};
-				bool seq_eps = false;
-				first_of_sequence(alt, k + 1, seq_first, &seq_eps);
-
-				for (int t = 0; t < term_count; t++) {
-					if (seq_first[t] && t != dollar) {
-						if (add_follow(B, t)) {
-							changed = true;
-						}
-					}
-				}
-				if (seq_eps || k == alt->token_count - 1) {
-					for (int t = 0; t < term_count; t++) {
-						if (follow_set[A][t] && add_follow(B, t)) {
-							changed = true;
-						}
-					}
-				}
-			}
+int main(int argc, char **argv) {
+	int n = 0;
+	static char line[MAX_LINE];
+	bool bench = false;
+	const char *grammar_path = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--bench") == 0) {
+			bench = true;
+		} else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			ff.threads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+			grammar_path = argv[++i];
 		}
 	}
-	return changed;
-}
 
-static void print_sets(const char *title, bool set[MAX_PROD][MAX_TERMS], bool show_eps) {
-	printf("%s\n", title);
-	for (int i = 0; i < nt_count; i++) {
-		printf("%c: { ", nt_list[i]);
-		bool first = true;
-		for (int t = 0; t < term_count; t++) {
-			if (set[i][t]) {
-				if (!first) {
-					printf(", ");
-				}
-				printf("%s", term_list[t]);
-				first = false;
-			}
+	gram_init(&gram, GRAM_TOK_WORD);
+	if (grammar_path != NULL) {
+		GramError err;
+		struct timespec t0;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		if (!gram_load_file(&gram, grammar_path, &err)) {
+			gram_print_error(grammar_path, &err);
+			return 1;
 		}
-		if (show_eps && first_eps[i]) {
-			if (!first) {
-				printf(", ");
+		if (bench) {
+			printf("Loaded %s: %.3f ms\n", grammar_path, wall_ms(&t0));
+		}
+	} else {
+		if (!bench) {
+			printf("Enter number of productions: ");
+		}
+		if (scanf("%d", &n) != 1 || n <= 0) {
+			return 1;
+		}
+		fgets(line, sizeof(line), stdin);
+		for (int i = 0; i < n; i++) {
+			if (!bench) {
+				printf("Enter production %d (e.g., S->AB|a): ", i + 1);
 			}
-			printf("eps");
+			if (!fgets(line, sizeof(line), stdin)) {
+				return 1;
+			}
+			gram_parse_line(&gram, line);
 		}
-		printf(" }\n");
 	}
-	printf("\n");
-}
-
-int main(void) {
-	int n = 0;
-	char line[256];
-
-	printf("Enter number of productions: ");
-	if (scanf("%d", &n) != 1 || n <= 0 || n > MAX_PROD) {
+	if (gram.prod_count == 0) {
 		return 1;
 	}
-	fgets(line, sizeof(line), stdin);
+	int dollar = gram_term_index(gram_term(&gram, "$"));
 
-	for (int i = 0; i < n; i++) {
-		printf("Enter production %d (e.g., S->AB|a): ", i + 1);
-		if (!fgets(line, sizeof(line), stdin)) {
-			return 1;
-		}
-		parse_line(line);
+	if (bench) {
+		return run_benchmark(dollar);
 	}
-
-	collect_terminals();
-
-	bool changed = true;
-	while (changed) {
-		changed = compute_first();
-	}
-
-	changed = true;
-	while (changed) {
-		changed = compute_follow();
+	if (!ff_compute(&gram, &ff, dollar) || !build_print_order()) {
+		return 1;
 	}
 
-	print_sets("FIRST sets", first_set, true);
-	print_sets("FOLLOW sets", follow_set, false);
+	print_sets("FIRST sets", ff.first, true);
+	print_sets("FOLLOW sets", ff.follow, false);
 
 	return 0;
 }
@@ -1,429 +1,1551 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include <stdbool.h>
+#include <time.h>
 
-#define MAX_PROD 26
-#define MAX_ALTS 32
-#define MAX_TOKENS 32
-#define MAX_TOKEN_LEN 16
-#define MAX_TERMS 64
-#define MAX_CELL 64
+#include "grammar.h"
+#include "first_follow.h"
+#include "gram_cache.h"
+#include "llk.h"
+#include "earley.h"
 
-typedef struct {
-	int token_count;
-	char tokens[MAX_TOKENS][MAX_TOKEN_LEN];
-	char rhs_text[MAX_CELL];
-} Alternative;
+#define MAX_LINE 4096
+#define BENCH_ROUNDS 20
+#define PARSE_BENCH_TOKENS (1 << 20)
+#define PARSE_SENTENCE_BUDGET 4096
+#define PARSE_BENCH_ROUNDS 5
+#define MAX_EVENTS 65536
+#define EDIT_BENCH_ROUNDS 200
+
+static Grammar gram;
+static FirstFollow ff;
+
+#define LL_EMPTY LLK_EMPTY
+#define LL_CONFLICT LLK_CONFLICT
 
+/* One production that landed in a cell already claimed by another. */
 typedef struct {
-	char lhs;
-	int alt_count;
-	Alternative alts[MAX_ALTS];
-} Production;
+	int nt;
+	int term;
+	int prod;
+} Conflict;
 
-static Production prods[MAX_PROD];
-static int prod_count = 0;
+/* Production index per cell, row-major by nonterminal; table_rows x table_cols are allocated. */
+static int16_t *table;
+static int table_rows = 0;
+static int table_cols = 0;
+static Conflict *conflicts;
+static int conflict_count = 0;
+static int conflict_cap = 0;
+static int conflict_cells = 0;
+static bool has_conflict = false;
 
-static char nt_list[MAX_PROD];
-static int nt_count = 0;
+/*
+ * Row-displaced copy of the table. Each row keeps its most frequent
+ * production as a default; only the other entries are packed into the
+ * shared next/check arrays, with rows overlapping wherever their columns
+ * do not collide. Error cells also fall back to the default, so a bad
+ * token is reported one expansion later, when a terminal fails to match.
+ */
+typedef struct {
+	int rows;
+	int cols;
+	int size;
+	int *base;
+	int16_t *deflt;
+	int16_t *next;
+	int16_t *check;
+} PackedTable;
 
-static char term_list[MAX_TERMS][MAX_TOKEN_LEN];
-static int term_count = 0;
+static PackedTable packed;
 
-static bool first_set[MAX_PROD][MAX_TERMS];
-static bool first_eps[MAX_PROD];
-static bool follow_set[MAX_PROD][MAX_TERMS];
+/* Deeper lookahead for the nonterminals with conflicting cells; -k 1 turns it off. */
+static LlkTable llk;
+static int max_k = LLK_MAX;
 
-static char table[MAX_PROD][MAX_TERMS][MAX_CELL];
-static bool has_conflict = false;
+static int16_t *table_cell(int A, int t) {
+	return &table[(size_t)A * (size_t)gram.term_count + (size_t)t];
+}
 
-static void trim_spaces(char *s) {
-	char *p = s;
-	char *q = s;
-	while (*p) {
-		if (!isspace((unsigned char)*p)) {
-			*q++ = *p;
+static bool add_conflict(int A, int t, int p) {
+	Conflict *grown = gram_grow(conflicts, &conflict_cap, conflict_count + 1, sizeof(Conflict));
+	if (!grown) {
+		return false;
+	}
+	conflicts = grown;
+	conflicts[conflict_count].nt = A;
+	conflicts[conflict_count].term = t;
+	conflicts[conflict_count].prod = p;
+	conflict_count++;
+	return true;
+}
+
+static bool set_table(int A, int t, int p) {
+	int16_t *cell = table_cell(A, t);
+	if (*cell == LL_EMPTY) {
+		*cell = (int16_t)p;
+		return true;
+	}
+	has_conflict = true;
+	if (*cell != LL_CONFLICT) {
+		if (!add_conflict(A, t, *cell)) {
+			return false;
 		}
-		p++;
+		*cell = LL_CONFLICT;
+		conflict_cells++;
 	}
-	*q = '\0';
+	return add_conflict(A, t, p);
 }
 
-static int nt_index(char nt) {
-	for (int i = 0; i < nt_count; i++) {
-		if (nt_list[i] == nt) {
-			return i;
+/* Enter production p in every cell of its prediction set. */
+static bool fill_production(int p, uint64_t *predict) {
+	int A = gram.prod_lhs[p];
+	memset(predict, 0, sizeof(uint64_t) * (size_t)ff.words);
+	ff_first_of_sequence(&ff, gram_rhs(&gram, p), gram_rhs_len(&gram, p), predict);
+	if (ff_test(predict, FF_EPS)) {
+		ff_union_no_eps(predict, ff_follow(&ff, A), ff.words);
+	}
+	predict[0] &= ~(uint64_t)1;
+
+	for (int w = 0; w < ff.words; w++) {
+		uint64_t bits = predict[w];
+		while (bits) {
+			int t = w * 64 + __builtin_ctzll(bits) - 1;
+			if (!set_table(A, t, p)) {
+				return false;
+			}
+			bits &= bits - 1;
 		}
 	}
-	if (nt_count < MAX_PROD) {
-		nt_list[nt_count] = nt;
-		return nt_count++;
+	return true;
+}
+
+static bool build_table(void) {
+	size_t cells = (size_t)gram.nt_count * (size_t)gram.term_count;
+	if (gram.prod_count > INT16_MAX) {
+		printf("Too many productions for a 16-bit table\n");
+		return false;
 	}
-	return -1;
+	free(table);
+	table = malloc(sizeof(int16_t) * (cells > 0 ? cells : 1));
+	uint64_t *predict = malloc(sizeof(uint64_t) * (size_t)ff.words);
+	if (!table || !predict) {
+		free(predict);
+		return false;
+	}
+	table_rows = gram.nt_count;
+	table_cols = gram.term_count;
+	for (size_t i = 0; i < cells; i++) {
+		table[i] = LL_EMPTY;
+	}
+	conflict_count = 0;
+	conflict_cells = 0;
+	has_conflict = false;
+
+	bool ok = true;
+	for (int p = 0; p < gram.prod_count && ok; p++) {
+		ok = fill_production(p, predict);
+	}
+	free(predict);
+	return ok;
 }
 
-static int term_index(const char *t) {
-	for (int i = 0; i < term_count; i++) {
-		if (strcmp(term_list[i], t) == 0) {
-			return i;
+/*
+ * After an edit, recompute only the rows whose predictions can have moved:
+ * the edited nonterminal, those whose FOLLOW changed, and those with a
+ * production mentioning a nonterminal whose FIRST changed. Needs
+ * gram_index. Returns the number of rows rebuilt, or -1 on failure.
+ */
+static int rebuild_rows(int lhs, const bool *first_changed, const bool *follow_changed) {
+	bool *dirty = calloc((size_t)gram.nt_count, sizeof(bool));
+	uint64_t *predict = malloc(sizeof(uint64_t) * (size_t)ff.words);
+	if (!dirty || !predict) {
+		free(dirty);
+		free(predict);
+		return -1;
+	}
+	dirty[lhs] = true;
+	for (int p = 0; p < gram.prod_count; p++) {
+		const Sym *rhs = gram_rhs(&gram, p);
+		int A = gram.prod_lhs[p];
+		dirty[A] = dirty[A] || follow_changed[A];
+		for (int k = 0; k < gram_rhs_len(&gram, p) && !dirty[A]; k++) {
+			dirty[A] = !gram_is_term(rhs[k]) && first_changed[rhs[k]];
 		}
 	}
-	if (term_count < MAX_TERMS) {
-		strncpy(term_list[term_count], t, MAX_TOKEN_LEN - 1);
-		term_list[term_count][MAX_TOKEN_LEN - 1] = '\0';
-		return term_count++;
+
+	int kept = 0;
+	for (int i = 0; i < conflict_count; i++) {
+		if (!dirty[conflicts[i].nt]) {
+			conflicts[kept++] = conflicts[i];
+		}
 	}
-	return -1;
+	conflict_count = kept;
+
+	int rows = 0;
+	bool ok = true;
+	for (int A = 0; A < gram.nt_count && ok; A++) {
+		if (!dirty[A]) {
+			continue;
+		}
+		rows++;
+		for (int t = 0; t < gram.term_count; t++) {
+			conflict_cells -= *table_cell(A, t) == LL_CONFLICT;
+			*table_cell(A, t) = LL_EMPTY;
+		}
+		for (int k = gram.nt_first[A]; k < gram.nt_first[A + 1] && ok; k++) {
+			ok = fill_production(gram.nt_prods[k], predict);
+		}
+	}
+	has_conflict = conflict_count > 0;
+	free(dirty);
+	free(predict);
+	return ok ? rows : -1;
 }
 
-static int find_prod(char lhs) {
-	for (int i = 0; i < prod_count; i++) {
-		if (prods[i].lhs == lhs) {
-			return i;
+/*
+ * An edit interned new symbols: widen the table to the grammar, keeping
+ * the existing rows. New cells are empty; the rows that need them are
+ * rebuilt, since a new terminal shows up only in sets the edit changed.
+ */
+static bool grow_table(void) {
+	if (gram.nt_count <= table_rows && gram.term_count <= table_cols) {
+		return true;
+	}
+	size_t cells = (size_t)gram.nt_count * (size_t)gram.term_count;
+	int16_t *grown = malloc(sizeof(int16_t) * (cells > 0 ? cells : 1));
+	if (grown == NULL) {
+		return false;
+	}
+	for (size_t i = 0; i < cells; i++) {
+		grown[i] = LL_EMPTY;
+	}
+	for (int A = 0; A < table_rows; A++) {
+		memcpy(grown + (size_t)A * (size_t)gram.term_count, table + (size_t)A * (size_t)table_cols,
+			   sizeof(int16_t) * (size_t)table_cols);
+	}
+	free(table);
+	table = grown;
+	table_rows = gram.nt_count;
+	table_cols = gram.term_count;
+	return true;
+}
+
+/*
+ * Production p was removed: later production indices move down by one.
+ * Uses the gram_index from before the removal, where each row's
+ * productions are in increasing order, to skip rows with none after p.
+ */
+static void shift_productions(int p) {
+	for (int A = 0; A < gram.nt_count; A++) {
+		int end = gram.nt_first[A + 1];
+		if (end == gram.nt_first[A] || gram.nt_prods[end - 1] <= p) {
+			continue;
+		}
+		for (int t = 0; t < gram.term_count; t++) {
+			*table_cell(A, t) -= *table_cell(A, t) > p;
 		}
 	}
-	return -1;
+	for (int i = 0; i < conflict_count; i++) {
+		conflicts[i].prod -= conflicts[i].prod > p;
+	}
+}
+
+static void packed_free(PackedTable *pt) {
+	free(pt->base);
+	free(pt->deflt);
+	free(pt->next);
+	free(pt->check);
+	memset(pt, 0, sizeof(*pt));
 }
 
-static void add_token(Alternative *alt, const char *tok) {
-	if (alt->token_count < MAX_TOKENS) {
-		strncpy(alt->tokens[alt->token_count], tok, MAX_TOKEN_LEN - 1);
-		alt->tokens[alt->token_count][MAX_TOKEN_LEN - 1] = '\0';
-		alt->token_count++;
+static int packed_lookup(const PackedTable *pt, int A, int t) {
+	int i = pt->base[A] + t;
+	return pt->check[i] == A ? pt->next[i] : pt->deflt[A];
+}
+
+/* Most frequent production in row A; conflict cells are never the default. */
+static int16_t row_default(int A, int *count) {
+	int16_t best = LL_EMPTY;
+	int best_count = 0;
+	for (int t = 0; t < gram.term_count; t++) {
+		int16_t p = *table_cell(A, t);
+		if (p < 0) {
+			continue;
+		}
+		count[p]++;
+		if (count[p] > best_count || (count[p] == best_count && p < best)) {
+			best = p;
+			best_count = count[p];
+		}
+	}
+	for (int t = 0; t < gram.term_count; t++) {
+		int16_t p = *table_cell(A, t);
+		if (p >= 0) {
+			count[p] = 0;
+		}
 	}
+	return best;
 }
 
-static void tokenize_rhs(const char *rhs, Alternative *alt) {
-	alt->token_count = 0;
-	strncpy(alt->rhs_text, rhs, MAX_CELL - 1);
-	alt->rhs_text[MAX_CELL - 1] = '\0';
+static int explicit_entries(int A, int16_t deflt) {
+	int n = 0;
+	for (int t = 0; t < gram.term_count; t++) {
+		int16_t p = *table_cell(A, t);
+		n += p != LL_EMPTY && p != deflt;
+	}
+	return n;
+}
 
-	if (strcmp(rhs, "eps") == 0) {
-		add_token(alt, "eps");
-		return;
+static bool row_fits(const PackedTable *pt, int A, int base) {
+	for (int t = 0; t < pt->cols; t++) {
+		int16_t p = *table_cell(A, t);
+		if (p != LL_EMPTY && p != pt->deflt[A] && pt->check[base + t] != -1) {
+			return false;
+		}
 	}
+	return true;
+}
+
+/* First-fit row displacement, densest rows first. */
+static bool pack_table(PackedTable *pt) {
+	int rows = gram.nt_count;
+	int cols = gram.term_count;
+	packed_free(pt);
+	pt->rows = rows;
+	pt->cols = cols;
+	/* Worst case: every row at its own offset. */
+	int cap = rows * cols + cols;
+	pt->base = calloc((size_t)(rows > 0 ? rows : 1), sizeof(int));
+	pt->deflt = malloc(sizeof(int16_t) * (size_t)(rows > 0 ? rows : 1));
+	pt->next = malloc(sizeof(int16_t) * (size_t)(cap > 0 ? cap : 1));
+	pt->check = malloc(sizeof(int16_t) * (size_t)(cap > 0 ? cap : 1));
+	int *order = malloc(sizeof(int) * (size_t)(rows > 0 ? rows : 1));
+	int *fill = malloc(sizeof(int) * (size_t)(rows > 0 ? rows : 1));
+	int *count = calloc((size_t)gram.prod_count + 1, sizeof(int));
+	bool ok = pt->base && pt->deflt && pt->next && pt->check && order && fill && count;
 
-	int i = 0;
-	while (rhs[i] != '\0') {
-		if (isupper((unsigned char)rhs[i])) {
-			char tok[2] = { rhs[i], '\0' };
-			add_token(alt, tok);
-			nt_index(rhs[i]);
-			i++;
-		} else if (islower((unsigned char)rhs[i]) || isdigit((unsigned char)rhs[i])) {
-			char tok[MAX_TOKEN_LEN];
-			int k = 0;
-			while ((islower((unsigned char)rhs[i]) || isdigit((unsigned char)rhs[i])) && k < MAX_TOKEN_LEN - 1) {
-				tok[k++] = rhs[i++];
+	if (ok) {
+		for (int i = 0; i < cap; i++) {
+			pt->check[i] = -1;
+		}
+		for (int A = 0; A < rows; A++) {
+			pt->deflt[A] = row_default(A, count);
+			fill[A] = explicit_entries(A, pt->deflt[A]);
+			order[A] = A;
+		}
+		/* Insertion sort by fill, descending; stable for equal rows. */
+		for (int i = 1; i < rows; i++) {
+			int A = order[i];
+			int j = i - 1;
+			while (j >= 0 && fill[order[j]] < fill[A]) {
+				order[j + 1] = order[j];
+				j--;
+			}
+			order[j + 1] = A;
+		}
+
+		int lowest_free = 0;
+		for (int i = 0; i < rows; i++) {
+			int A = order[i];
+			int base = 0;
+			if (fill[A] > 0) {
+				/* No slot below lowest_free is open, so start where the first entry can land there. */
+				int first_col = 0;
+				while (*table_cell(A, first_col) == LL_EMPTY || *table_cell(A, first_col) == pt->deflt[A]) {
+					first_col++;
+				}
+				base = lowest_free > first_col ? lowest_free - first_col : 0;
+				while (!row_fits(pt, A, base)) {
+					base++;
+				}
+			}
+			pt->base[A] = base;
+			for (int t = 0; t < cols; t++) {
+				int16_t p = *table_cell(A, t);
+				if (p != LL_EMPTY && p != pt->deflt[A]) {
+					pt->next[base + t] = p;
+					pt->check[base + t] = (int16_t)A;
+				}
+			}
+			if (base + cols > pt->size) {
+				pt->size = base + cols;
+			}
+			while (lowest_free < cap && pt->check[lowest_free] != -1) {
+				lowest_free++;
 			}
-			tok[k] = '\0';
-			add_token(alt, tok);
-		} else {
-			char tok[2] = { rhs[i], '\0' };
-			add_token(alt, tok);
-			i++;
 		}
+		/* Give back the unused tail of the worst-case allocation. */
+		int16_t *next = realloc(pt->next, sizeof(int16_t) * (size_t)(pt->size > 0 ? pt->size : 1));
+		int16_t *check = realloc(pt->check, sizeof(int16_t) * (size_t)(pt->size > 0 ? pt->size : 1));
+		pt->next = next ? next : pt->next;
+		pt->check = check ? check : pt->check;
 	}
+	free(order);
+	free(fill);
+	free(count);
+	return ok;
 }
 
-static void parse_line(char *line) {
-	trim_spaces(line);
-	if (strlen(line) < 4) {
-		return;
+static size_t dense_bytes(void) {
+	return (size_t)gram.nt_count * (size_t)gram.term_count * sizeof(int16_t) +
+		   (size_t)conflict_count * sizeof(Conflict);
+}
+
+static size_t packed_bytes(const PackedTable *pt) {
+	return (size_t)pt->rows * (sizeof(int) + sizeof(int16_t)) + (size_t)pt->size * 2 * sizeof(int16_t) +
+		   (size_t)conflict_count * sizeof(Conflict);
+}
+
+static void print_memory(void) {
+	size_t cells = (size_t)gram.nt_count * (size_t)gram.term_count;
+	printf("Table memory (%d x %d cells)\n", gram.nt_count, gram.term_count);
+	printf("%-20s %10zu bytes\n", "64-byte strings", cells * 64);
+	printf("%-20s %10zu bytes\n", "int16 dense", dense_bytes());
+	printf("%-20s %10zu bytes (%d packed slots)\n", "row-displaced", packed_bytes(&packed), packed.size);
+}
+
+static void print_conflicts(void) {
+	for (int i = 0; i < conflict_count; i++) {
+		const Conflict *c = &conflicts[i];
+		printf("  [%s, %s] %s -> ", gram_nt_name(&gram, c->nt), gram_term_name(&gram, c->term),
+			   gram_nt_name(&gram, c->nt));
+		gram_print_rhs(&gram, c->prod);
+		printf("\n");
 	}
-	char lhs = line[0];
-	if (!isupper((unsigned char)lhs)) {
-		return;
+}
+
+static void print_table(void) {
+	printf("Predictive Parsing Table\n");
+	printf("%-6s", "");
+	for (int t = 0; t < gram.term_count; t++) {
+		printf(" %-12s", gram_term_name(&gram, t));
 	}
-	char *arrow = strstr(line, "->");
-	if (!arrow) {
-		return;
+	printf("\n");
+
+	for (int i = 0; i < gram.nt_count; i++) {
+		printf("%-6s", gram_nt_name(&gram, i));
+		for (int t = 0; t < gram.term_count; t++) {
+			int p = *table_cell(i, t);
+			if (p == LL_CONFLICT) {
+				printf(" %-12s", "conflict");
+			} else if (p == -1) {
+				printf(" %-12s", "-");
+			} else {
+				char rhs[256];
+				char cell[sizeof(rhs) + GRAM_MAX_NAME + 2];
+				gram_format_rhs(&gram, gram_rhs(&gram, p), gram_rhs_len(&gram, p), rhs, sizeof(rhs));
+				snprintf(cell, sizeof(cell), "%s->%s", gram_nt_name(&gram, i), rhs);
+				printf(" %-12s", cell);
+			}
+		}
+		printf("\n");
 	}
-	int pidx = find_prod(lhs);
-	if (pidx == -1) {
-		pidx = prod_count++;
-		prods[pidx].lhs = lhs;
-		prods[pidx].alt_count = 0;
-		nt_index(lhs);
+	printf("\n");
+
+	if (has_conflict) {
+		printf("Note: 'conflict' means the grammar is not LL(1).\n");
+		print_conflicts();
 	}
+}
+
+/* Every lookahead string below row, with the production it picks. */
+static void print_llk_row(int A, int row, int *path, int depth) {
+	for (int t = 0; t < llk.cols; t++) {
+		int v = llk_row(&llk, row)[t];
+		if (v == LLK_EMPTY) {
+			continue;
+		}
+		path[depth] = t;
+		if (v <= LLK_ROW_REF) {
+			print_llk_row(A, LLK_ROW_REF - v, path, depth + 1);
+			continue;
+		}
+		if (depth == 0 && *table_cell(A, t) != LL_CONFLICT) {
+			continue;
+		}
+		printf("  [%s,", gram_nt_name(&gram, A));
+		for (int i = 0; i <= depth; i++) {
+			printf(" %s", gram_term_name(&gram, path[i]));
+		}
+		if (v == LLK_CONFLICT) {
+			printf("] conflict\n");
+			continue;
+		}
+		printf("] %s -> ", gram_nt_name(&gram, A));
+		gram_print_rhs(&gram, v);
+		printf("\n");
+	}
+}
+
+static bool build_llk(int dollar) {
+	return gram_index(&gram) && llk_build(&llk, &gram, table, max_k, gram.start, dollar);
+}
 
-	char *rhs = arrow + 2;
-	char *token = strtok(rhs, "|");
-	while (token) {
-		if (prods[pidx].alt_count < MAX_ALTS) {
-			tokenize_rhs(token, &prods[pidx].alts[prods[pidx].alt_count]);
-			prods[pidx].alt_count++;
+static void print_llk(void) {
+	printf("\nLL(k) lookahead, k <= %d: %d of %d conflicting cells resolved\n", llk.max_k, llk.resolved, llk.cells);
+	for (int A = 0; A < gram.nt_count; A++) {
+		if (llk.k[A] == 1) {
+			continue;
 		}
-		token = strtok(NULL, "|");
+		if (llk.k[A] == 0) {
+			printf("  %s is not strong LL(%d)\n", gram_nt_name(&gram, A), llk.max_k);
+		} else {
+			printf("  %s needs %d tokens\n", gram_nt_name(&gram, A), llk.k[A]);
+		}
+	}
+	for (int A = 0; A < gram.nt_count; A++) {
+		int path[LLK_MAX];
+		if (llk.root[A] >= 0) {
+			print_llk_row(A, llk.root[A], path, 0);
+		}
+	}
+	if (llk.trie_nodes > 0) {
+		double flat = 2.0 * gram.nt_count;
+		for (int i = 0; i < llk.trie_k; i++) {
+			flat *= gram.term_count + 1;
+		}
+		printf("FIRST_%d/FOLLOW_%d tries: %d nodes, %zu bytes (flat bitsets of %d-tuples: %.0f bytes)\n", llk.trie_k,
+			   llk.trie_k, llk.trie_nodes, llk.trie_bytes, llk.trie_k, flat / 8);
 	}
 }
 
-static bool is_nonterminal(const char *tok) {
-	return strlen(tok) == 1 && isupper((unsigned char)tok[0]);
+/*
+ * Non-recursive LL(1) driver. The symbol stack and event log are arrays
+ * owned by the parser and reused across parses; the stack only grows when
+ * a parse goes deeper than any before it, so steady-state parsing does not
+ * allocate. Events are the parse tree in preorder: a production index
+ * (>= 0) for each expansion and -(t + 1) for each matched terminal t.
+ */
+typedef struct {
+	Sym *stack;
+	int stack_cap;
+	int32_t *events;
+	int event_count;
+	int event_cap;
+	int error_pos;
+	long grows;
+} LlParser;
+
+static void ll_init(LlParser *ps, int event_cap) {
+	memset(ps, 0, sizeof(*ps));
+	ps->events = event_cap > 0 ? malloc(sizeof(int32_t) * (size_t)event_cap) : NULL;
+	ps->event_cap = ps->events ? event_cap : 0;
 }
 
-static bool is_epsilon(const char *tok) {
-	return strcmp(tok, "eps") == 0;
+static void ll_free(LlParser *ps) {
+	free(ps->stack);
+	free(ps->events);
+	memset(ps, 0, sizeof(*ps));
 }
 
-static void collect_terminals(void) {
-	for (int i = 0; i < prod_count; i++) {
-		for (int j = 0; j < prods[i].alt_count; j++) {
-			Alternative *alt = &prods[i].alts[j];
-			for (int k = 0; k < alt->token_count; k++) {
-				if (is_nonterminal(alt->tokens[k]) || is_epsilon(alt->tokens[k])) {
-					continue;
-				}
-				term_index(alt->tokens[k]);
+static void ll_event(LlParser *ps, int32_t ev) {
+	if (ps->event_count < ps->event_cap) {
+		ps->events[ps->event_count] = ev;
+	}
+	ps->event_count++;
+}
+
+/*
+ * Parse tokens[0..] up to and including the first dollar token. Returns
+ * the number of tokens consumed, or -1 with error_pos set. When pt is
+ * non-NULL the packed table is consulted instead of the dense one. A
+ * conflicting cell defers to the LL(k) rows, which read further tokens.
+ */
+static int ll_parse(LlParser *ps, const PackedTable *pt, const int *tokens, int n, int start, int dollar) {
+	int depth = 0;
+	int pos = 0;
+	ps->event_count = 0;
+	ps->error_pos = -1;
+	if (ps->stack_cap < 2) {
+		Sym *grown = gram_grow(ps->stack, &ps->stack_cap, 64, sizeof(Sym));
+		if (!grown) {
+			return -1;
+		}
+		ps->stack = grown;
+		ps->grows++;
+	}
+	ps->stack[depth++] = gram_term_sym(dollar);
+	ps->stack[depth++] = (Sym)start;
+
+	while (depth > 0) {
+		Sym top = ps->stack[--depth];
+		int a = pos < n ? tokens[pos] : -1;
+		if (a < 0) {
+			break;
+		}
+		if (gram_is_term(top)) {
+			if (gram_term_index(top) != a) {
+				break;
+			}
+			ll_event(ps, -(a + 1));
+			pos++;
+			if (a == dollar) {
+				return pos;
+			}
+			continue;
+		}
+		int p = pt ? packed_lookup(pt, top, a) : *table_cell(top, a);
+		if (p == LL_CONFLICT && llk.root != NULL && llk.root[top] >= 0) {
+			p = llk_predict(&llk, top, tokens + pos, n - pos);
+		}
+		if (p < 0) {
+			break;
+		}
+		ll_event(ps, p);
+		int len = gram_rhs_len(&gram, p);
+		if (depth + len > ps->stack_cap) {
+			Sym *grown = gram_grow(ps->stack, &ps->stack_cap, depth + len, sizeof(Sym));
+			if (!grown) {
+				break;
 			}
+			ps->stack = grown;
+			ps->grows++;
+		}
+		const Sym *rhs = gram_rhs(&gram, p);
+		for (int i = len - 1; i >= 0; i--) {
+			ps->stack[depth++] = rhs[i];
 		}
 	}
-	term_index("$");
+	ps->error_pos = pos;
+	return -1;
 }
 
-static bool add_first(int A, int t) {
-	if (!first_set[A][t]) {
-		first_set[A][t] = true;
-		return true;
+/* Print the event log as an indented preorder tree. */
+static void print_parse_tree(const LlParser *ps, int dollar) {
+	int *indent = malloc(sizeof(int) * (size_t)(ps->event_count + 1));
+	int depth = 0;
+	if (!indent) {
+		return;
 	}
-	return false;
+	int count = ps->event_count < ps->event_cap ? ps->event_count : ps->event_cap;
+	for (int e = 0; e < count; e++) {
+		int level = depth > 0 ? indent[--depth] : 0;
+		int32_t ev = ps->events[e];
+		if (ev == -(dollar + 1)) {
+			continue;
+		}
+		printf("%*s", level * 2, "");
+		if (ev < 0) {
+			printf("%s\n", gram_term_name(&gram, -ev - 1));
+			continue;
+		}
+		printf("%s -> ", gram_nt_name(&gram, gram.prod_lhs[ev]));
+		gram_print_rhs(&gram, ev);
+		printf("\n");
+		for (int i = 0; i < gram_rhs_len(&gram, ev); i++) {
+			indent[depth++] = level + 1;
+		}
+	}
+	free(indent);
 }
 
-static bool add_follow(int A, int t) {
-	if (!follow_set[A][t]) {
-		follow_set[A][t] = true;
-		return true;
+static void emit_symbol(FILE *out, Sym s, bool tail, int A) {
+	if (gram_is_term(s)) {
+		fprintf(out, "\t\t\tRD_MATCH(st, %d);\n", gram_term_index(s));
+	} else if (tail && s == A) {
+		fprintf(out, "\t\t\tcontinue;\n");
+	} else if (tail) {
+		fprintf(out, "\t\t\treturn rd_nt%d(st);\n", s);
+	} else {
+		fprintf(out, "\t\t\tif (!rd_nt%d(st)) return false;\n", s);
 	}
-	return false;
 }
 
-static bool compute_first(void) {
-	bool changed = false;
-	for (int i = 0; i < prod_count; i++) {
-		int A = nt_index(prods[i].lhs);
-		for (int j = 0; j < prods[i].alt_count; j++) {
-			Alternative *alt = &prods[i].alts[j];
-			bool all_eps = true;
+/*
+ * Emit a recursive-descent parser with one function per nonterminal. Each
+ * function switches on the lookahead using the cells of the LL(1) table;
+ * a production ending in its own nonterminal loops instead of recursing,
+ * and one ending in another nonterminal returns that call as a tail call.
+ * Events match ll_parse, so the two logs can be compared directly.
+ */
+static bool emit_parser_c(FILE *out, int dollar) {
+	if (!gram_index(&gram)) {
+		return false;
+	}
+	fprintf(out, "/* Generated by task6.c: recursive-descent LL(1) parser. Do not edit. */\n");
+	fprintf(out, "#include <stdbool.h>\n#include <stdint.h>\n\n");
+	fprintf(out, "#define RD_GEN_TERMS %d\n#define RD_GEN_PRODS %d\n\n", gram.term_count, gram.prod_count);
+	fprintf(out, "typedef struct {\n\tconst int *tok;\n\tint pos;\n\tint32_t *events;\n");
+	fprintf(out, "\tint event_count;\n\tint event_cap;\n} RdGen;\n\n");
+	fprintf(out, "#define RD_EVENT(st, ev) do { if ((st)->event_count < (st)->event_cap) "
+				 "(st)->events[(st)->event_count] = (ev); (st)->event_count++; } while (0)\n");
+	fprintf(out, "#define RD_MATCH(st, t) do { if ((st)->tok[(st)->pos] != (t)) return false; "
+				 "RD_EVENT(st, -(t) - 1); (st)->pos++; } while (0)\n\n");
 
-			for (int k = 0; k < alt->token_count; k++) {
-				const char *tok = alt->tokens[k];
-				if (is_epsilon(tok)) {
-					if (!first_eps[A]) {
-						first_eps[A] = true;
-						changed = true;
-					}
-					all_eps = false;
-					break;
-				} else if (!is_nonterminal(tok)) {
-					int t = term_index(tok);
-					if (add_first(A, t)) {
-						changed = true;
-					}
-					all_eps = false;
-					break;
-				} else {
-					int B = nt_index(tok[0]);
-					for (int t = 0; t < term_count; t++) {
-						if (first_set[B][t] && add_first(A, t)) {
-							changed = true;
-						}
-					}
-					if (!first_eps[B]) {
-						all_eps = false;
-						break;
-					}
+	for (int A = 0; A < gram.nt_count; A++) {
+		fprintf(out, "static bool rd_nt%d(RdGen *st);\n", A);
+	}
+	for (int A = 0; A < gram.nt_count; A++) {
+		fprintf(out, "\n/* %s */\nstatic bool rd_nt%d(RdGen *st) {\n", gram_nt_name(&gram, A), A);
+		fprintf(out, "\tfor (;;) {\n\t\tswitch (st->tok[st->pos]) {\n");
+		for (int k = gram.nt_first[A]; k < gram.nt_first[A + 1]; k++) {
+			int p = gram.nt_prods[k];
+			bool any = false;
+			for (int t = 0; t < gram.term_count; t++) {
+				if (*table_cell(A, t) == p) {
+					fprintf(out, "%scase %d:", any ? " " : "\t\t", t);
+					any = true;
 				}
 			}
-
-			if (all_eps) {
-				if (!first_eps[A]) {
-					first_eps[A] = true;
-					changed = true;
-				}
+			if (!any) {
+				continue;
+			}
+			fprintf(out, "\n\t\t\tRD_EVENT(st, %d);\n", p);
+			int len = gram_rhs_len(&gram, p);
+			for (int i = 0; i < len; i++) {
+				emit_symbol(out, gram_rhs(&gram, p)[i], i == len - 1, A);
+			}
+			if (len == 0 || gram_is_term(gram_rhs(&gram, p)[len - 1])) {
+				fprintf(out, "\t\t\treturn true;\n");
 			}
 		}
+		fprintf(out, "\t\tdefault:\n\t\t\treturn false;\n\t\t}\n\t}\n}\n");
 	}
-	return changed;
+
+	fprintf(out, "\n/* Parse one sentence ending in dollar; returns tokens consumed or -1. */\n");
+	fprintf(out, "static int rd_gen_parse(RdGen *st, const int *tokens) {\n");
+	fprintf(out, "\tst->tok = tokens;\n\tst->pos = 0;\n\tst->event_count = 0;\n");
+	fprintf(out, "\tif (!rd_nt%d(st) || st->tok[st->pos] != %d) {\n\t\treturn -1;\n\t}\n", gram.start,
+			dollar);
+	fprintf(out, "\tRD_EVENT(st, %d);\n\treturn st->pos + 1;\n}\n", -dollar - 1);
+	return true;
 }
 
-static void first_of_sequence(Alternative *alt, int start, bool *out_first, bool *out_eps) {
-	bool all_eps = true;
-	for (int k = start; k < alt->token_count; k++) {
-		const char *tok = alt->tokens[k];
-		if (is_epsilon(tok)) {
-			*out_eps = true;
-			all_eps = false;
-			break;
-		} else if (!is_nonterminal(tok)) {
-			int t = term_index(tok);
-			out_first[t] = true;
-			all_eps = false;
-			break;
+#ifdef TASK6_GENERATED
+#include "task6_parser_gen.c"
+#endif
+
+/*
+ * Bring FIRST/FOLLOW and the table up to date after lhs -> rhs was added
+ * (added) or removed. Symbols interned since the last update (by this edit or by
+ * run_edit resolving its names) first get empty rows and columns.
+ * Returns rows rebuilt, or -1 on failure.
+ */
+static int update_after_edit(int dollar, int lhs, const Sym *rhs, int len, bool added) {
+	if (!gram_index(&gram) || !grow_table()) {
+		return -1;
+	}
+	bool *first_changed = malloc(sizeof(bool) * (size_t)gram.nt_count);
+	bool *follow_changed = malloc(sizeof(bool) * (size_t)gram.nt_count);
+	int rows = -1;
+	if (first_changed && follow_changed &&
+		ff_update(&gram, &ff, dollar, lhs, rhs, len, added, first_changed, follow_changed)) {
+		rows = rebuild_rows(lhs, first_changed, follow_changed);
+	}
+	free(first_changed);
+	free(follow_changed);
+	return rows;
+}
+
+static int add_alternative(int dollar, Sym lhs, const Sym *rhs, int len) {
+	if (gram_add_prod(&gram, lhs, rhs, len) < 0) {
+		return -1;
+	}
+	return update_after_edit(dollar, lhs, rhs, len, true);
+}
+
+static int remove_production(int dollar, int p) {
+	Sym lhs = gram.prod_lhs[p];
+	int len = gram_rhs_len(&gram, p);
+	Sym *rhs = malloc(sizeof(Sym) * (size_t)(len > 0 ? len : 1));
+	if (rhs == NULL) {
+		return -1;
+	}
+	memcpy(rhs, gram_rhs(&gram, p), sizeof(Sym) * (size_t)len);
+	gram_remove_prod(&gram, p);
+	shift_productions(p);
+	int rows = update_after_edit(dollar, lhs, rhs, len, false);
+	free(rhs);
+	return rows;
+}
+
+/* Production of lhs with exactly this right-hand side, or -1. */
+static int find_production(Sym lhs, const Sym *rhs, int len) {
+	for (int k = gram.nt_first[lhs]; k < gram.nt_first[lhs + 1]; k++) {
+		int p = gram.nt_prods[k];
+		if (gram_rhs_len(&gram, p) == len && memcmp(gram_rhs(&gram, p), rhs, sizeof(Sym) * (size_t)len) == 0) {
+			return p;
+		}
+	}
+	return -1;
+}
+
+/*
+ * One editor command: "+A->alpha|beta" adds alternatives, "-A->alpha"
+ * removes them. Symbols are resolved against a copy of the symbol table,
+ * so a removal naming an unknown symbol leaves the grammar untouched.
+ */
+static void run_edit(char *line, int dollar) {
+	char op = line[0];
+	char *text = line + 1;
+	gram_trim_spaces(text);
+	char *arrow = strstr(text, "->");
+	int lhs_len = gram_nt_token_len(text);
+	if ((op != '+' && op != '-') || !arrow || lhs_len == 0 || text + lhs_len != arrow) {
+		printf("Expected +A->alpha or -A->alpha\n");
+		return;
+	}
+
+	clock_t t0 = clock();
+	int rows = 0;
+	int edits = 0;
+	char name[GRAM_MAX_NAME];
+	gram_copy_name(name, text, lhs_len);
+	int max = (int)strlen(arrow) + 1;
+	Sym *syms = malloc(sizeof(Sym) * (size_t)max);
+	Grammar names;
+	gram_init(&names, gram.mode);
+	if (syms == NULL || !gram_copy_symbols(&names, &gram)) {
+		free(syms);
+		gram_free(&names);
+		return;
+	}
+	Sym lhs = op == '+' ? gram_nt(&gram, name) : (Sym)gram_find_nt(&gram, name);
+	for (char *alt = strtok(arrow + 2, "|"); alt != NULL && rows >= 0; alt = strtok(NULL, "|")) {
+		int r = 0;
+		if (op == '+') {
+			int len = gram_scan_alt(&gram, alt, (int)strlen(alt), syms);
+			r = add_alternative(dollar, lhs, syms, len);
 		} else {
-			int B = nt_index(tok[0]);
-			for (int t = 0; t < term_count; t++) {
-				if (first_set[B][t]) {
-					out_first[t] = true;
-				}
+			int len = gram_scan_alt(&names, alt, (int)strlen(alt), syms);
+			int p = -1;
+			if (lhs != GRAM_NO_SYM && names.nt_count == gram.nt_count && names.term_count == gram.term_count) {
+				p = find_production(lhs, syms, len);
 			}
-			if (!first_eps[B]) {
-				all_eps = false;
-				break;
+			if (p < 0) {
+				printf("No production %s -> %s\n", name, alt);
+				continue;
 			}
+			r = remove_production(dollar, p);
 		}
+		rows = r < 0 ? -1 : rows + r;
+		edits++;
 	}
-	if (all_eps) {
-		*out_eps = true;
+	free(syms);
+	gram_free(&names);
+	if (rows < 0) {
+		printf("Out of memory\n");
+		return;
 	}
+	printf("Conflicting cells: %d (%d edits, %d rows rebuilt, %.3f ms)\n", conflict_cells, edits, rows,
+		   (double)(clock() - t0) * 1000.0 / CLOCKS_PER_SEC);
+	print_conflicts();
 }
 
-static bool compute_follow(void) {
-	bool changed = false;
-	int dollar = term_index("$");
-	int start_nt = nt_index(prods[0].lhs);
-	if (add_follow(start_nt, dollar)) {
-		changed = true;
+static double bench_ms(clock_t t0) {
+	return (double)(clock() - t0) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+/* Generated benchmark input: sentences back to back, each ending in dollar. */
+typedef struct {
+	int *tokens;
+	int count;
+	int cap;
+	int sentences;
+	long events;
+	int max_events;
+} TokenStream;
+
+static bool stream_push(TokenStream *ts, int t) {
+	int *grown = gram_grow(ts->tokens, &ts->cap, ts->count + 1, sizeof(int));
+	if (!grown) {
+		return false;
 	}
+	ts->tokens = grown;
+	ts->tokens[ts->count++] = t;
+	return true;
+}
 
-	for (int i = 0; i < prod_count; i++) {
-		int A = nt_index(prods[i].lhs);
-		for (int j = 0; j < prods[i].alt_count; j++) {
-			Alternative *alt = &prods[i].alts[j];
-			for (int k = 0; k < alt->token_count; k++) {
-				const char *tok = alt->tokens[k];
-				if (!is_nonterminal(tok)) {
-					continue;
-				}
+/* For each nonterminal, the production with the shortest terminal yield. */
+static bool shortest_productions(int *shortest) {
+	int *yield = malloc(sizeof(int) * (size_t)(gram.nt_count > 0 ? gram.nt_count : 1));
+	if (!yield) {
+		return false;
+	}
+	for (int A = 0; A < gram.nt_count; A++) {
+		yield[A] = INT32_MAX;
+		shortest[A] = -1;
+	}
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (int p = 0; p < gram.prod_count; p++) {
+			long len = 0;
+			for (int i = 0; i < gram_rhs_len(&gram, p) && len < INT32_MAX; i++) {
+				Sym s = gram_rhs(&gram, p)[i];
+				len += gram_is_term(s) ? 1 : yield[s];
+			}
+			int A = gram.prod_lhs[p];
+			if (len < yield[A]) {
+				yield[A] = (int)len;
+				shortest[A] = p;
+				changed = true;
+			}
+		}
+	}
+	free(yield);
+	return true;
+}
 
-				int B = nt_index(tok[0]);
-				bool seq_first[MAX_TERMS] = {0};
-				bool seq_eps = false;
-				first_of_sequence(alt, k + 1, seq_first, &seq_eps);
+/*
+ * Random leftmost derivation from start. Until the sentence reaches about
+ * budget tokens, any production other than the shortest one is preferred;
+ * after that every nonterminal takes its shortest production.
+ */
+static bool generate_sentence(TokenStream *ts, const int *shortest, int start, int dollar, int budget) {
+	Sym *stack = NULL;
+	int cap = 0;
+	int depth = 0;
+	int emitted = 0;
+	int events = 1;
+	bool ok = true;
 
-				for (int t = 0; t < term_count; t++) {
-					if (seq_first[t] && t != dollar) {
-						if (add_follow(B, t)) {
-							changed = true;
-						}
-					}
-				}
-				if (seq_eps || k == alt->token_count - 1) {
-					for (int t = 0; t < term_count; t++) {
-						if (follow_set[A][t] && add_follow(B, t)) {
-							changed = true;
-						}
-					}
-				}
+	stack = gram_grow(stack, &cap, 1, sizeof(Sym));
+	if (!stack) {
+		return false;
+	}
+	stack[depth++] = (Sym)start;
+	while (depth > 0 && ok) {
+		Sym s = stack[--depth];
+		if (gram_is_term(s)) {
+			ok = stream_push(ts, gram_term_index(s));
+			emitted++;
+			events++;
+			continue;
+		}
+		int p = shortest[s];
+		int first = gram.nt_first[s];
+		int alts = gram.nt_first[s + 1] - first;
+		if (emitted + depth < budget && alts > 1) {
+			int pick = gram.nt_prods[first + rand() % (alts - 1)];
+			p = pick == p ? gram.nt_prods[first + alts - 1] : pick;
+		}
+		if (p < 0) {
+			ok = false;
+			break;
+		}
+		events++;
+		int len = gram_rhs_len(&gram, p);
+		Sym *grown = gram_grow(stack, &cap, depth + len, sizeof(Sym));
+		if (!grown) {
+			ok = false;
+			break;
+		}
+		stack = grown;
+		for (int i = len - 1; i >= 0; i--) {
+			stack[depth++] = gram_rhs(&gram, p)[i];
+		}
+	}
+	free(stack);
+	ok = ok && stream_push(ts, dollar);
+	ts->sentences++;
+	ts->events += events;
+	ts->max_events = events > ts->max_events ? events : ts->max_events;
+	return ok;
+}
+
+/* Parse every sentence in the stream; returns the number of rejected ones. */
+static int parse_stream(LlParser *ps, const PackedTable *pt, const TokenStream *ts, int start, int dollar,
+						long *events) {
+	int rejected = 0;
+	int pos = 0;
+	*events = 0;
+	while (pos < ts->count) {
+		int used = ll_parse(ps, pt, ts->tokens + pos, ts->count - pos, start, dollar);
+		if (used < 0) {
+			rejected++;
+			while (pos < ts->count && ts->tokens[pos] != dollar) {
+				pos++;
 			}
+			pos++;
+			continue;
 		}
+		*events += ps->event_count;
+		pos += used;
 	}
-	return changed;
+	return rejected;
 }
 
-static void set_table(int A, int t, const char *prod_text) {
-	if (table[A][t][0] == '\0') {
-		strncpy(table[A][t], prod_text, MAX_CELL - 1);
-		table[A][t][MAX_CELL - 1] = '\0';
-	} else if (strcmp(table[A][t], prod_text) != 0) {
-		strncpy(table[A][t], "conflict", MAX_CELL - 1);
-		table[A][t][MAX_CELL - 1] = '\0';
-		has_conflict = true;
+/* Recognize each sentence of the stream with Earley; *items gets the total set sizes. */
+static int earley_stream(EarleyParser *ep, const TokenStream *ts, int dollar, long *items) {
+	int rejected = 0;
+	*items = 0;
+	for (int pos = 0; pos < ts->count;) {
+		int end = pos;
+		while (end < ts->count && ts->tokens[end] != dollar) {
+			end++;
+		}
+		rejected += !earley_recognize(ep, ts->tokens + pos, end - pos);
+		*items += ep->count;
+		pos = end + 1;
 	}
+	return rejected;
 }
 
-static void build_table(void) {
-	for (int i = 0; i < nt_count; i++) {
-		for (int t = 0; t < term_count; t++) {
-			table[i][t][0] = '\0';
+/* Parse a generated token stream with the dense and packed tables, then with Earley. */
+static int run_parse_benchmark(int dollar) {
+	int start = gram.start;
+	int *shortest = malloc(sizeof(int) * (size_t)(gram.nt_count > 0 ? gram.nt_count : 1));
+	TokenStream ts = { 0 };
+	if (!shortest || !gram_index(&gram) || !shortest_productions(shortest)) {
+		free(shortest);
+		return 1;
+	}
+	srand(1);
+	while (ts.count < PARSE_BENCH_TOKENS) {
+		if (!generate_sentence(&ts, shortest, start, dollar, PARSE_SENTENCE_BUDGET)) {
+			printf("Could not generate input\n");
+			free(shortest);
+			free(ts.tokens);
+			return 1;
 		}
 	}
+	free(shortest);
 
-	for (int i = 0; i < prod_count; i++) {
-		int A = nt_index(prods[i].lhs);
-		for (int j = 0; j < prods[i].alt_count; j++) {
-			Alternative *alt = &prods[i].alts[j];
-			bool first_alt[MAX_TERMS] = {0};
-			bool first_eps_alt = false;
-			first_of_sequence(alt, 0, first_alt, &first_eps_alt);
+	LlParser ps;
+	ll_init(&ps, ts.max_events);
+	const char *names[2] = { "dense", "packed" };
+	const PackedTable *tables[2] = { NULL, &packed };
+	printf("Parse input: %d tokens in %d sentences, %ld events\n", ts.count, ts.sentences, ts.events);
+	for (int k = 0; k < 2; k++) {
+		long events = 0;
+		int rejected = parse_stream(&ps, tables[k], &ts, start, dollar, &events);
+		long grows = ps.grows;
+		double best = 1e30;
+		for (int r = 0; r < PARSE_BENCH_ROUNDS; r++) {
+			clock_t t0 = clock();
+			parse_stream(&ps, tables[k], &ts, start, dollar, &events);
+			double ms = bench_ms(t0);
+			best = ms < best ? ms : best;
+		}
+		printf("%-8s %10.3f ms %8.1f Mtokens/s  rejected %d  events %ld  stack grows in timed rounds %ld\n",
+			   names[k], best, best > 0 ? ts.count / best / 1000.0 : 0.0, rejected, events, ps.grows - grows);
+	}
 
-			char prod_text[MAX_CELL];
-			snprintf(prod_text, sizeof(prod_text), "%c->%s", prods[i].lhs, alt->rhs_text);
+	EarleyParser ep;
+	if (!earley_init(&ep, &gram, ff.nullable, start)) {
+		ll_free(&ps);
+		free(ts.tokens);
+		return 1;
+	}
+	for (int leo = 1; leo >= 0; leo--) {
+		long items = 0;
+		long tops = 0;
+		int rejected = 0;
+		double best = 1e30;
+		ep.use_leo = leo;
+		/* Without Leo, right-recursive tails make one round take seconds. */
+		for (int r = 0; r < (leo ? PARSE_BENCH_ROUNDS : 1); r++) {
+			ep.leo_tops = 0;
+			clock_t t0 = clock();
+			rejected = earley_stream(&ep, &ts, dollar, &items);
+			double ms = bench_ms(t0);
+			best = ms < best ? ms : best;
+			tops = ep.leo_tops;
+		}
+		printf("%-8s %10.3f ms %8.1f Mtokens/s  rejected %d  items/token %.1f  Leo tops %ld\n",
+			   leo ? "earley" : "no-leo", best, best > 0 ? ts.count / best / 1000.0 : 0.0, rejected,
+			   (double)items / ts.count, tops);
+	}
+	earley_free(&ep);
 
-			for (int t = 0; t < term_count; t++) {
-				if (first_alt[t]) {
-					set_table(A, t, prod_text);
-				}
-			}
-			if (first_eps_alt) {
-				for (int t = 0; t < term_count; t++) {
-					if (follow_set[A][t]) {
-						set_table(A, t, prod_text);
+#ifdef TASK6_GENERATED
+	if (RD_GEN_TERMS == gram.term_count && RD_GEN_PRODS == gram.prod_count) {
+		RdGen st = { 0 };
+		st.events = ps.events;
+		st.event_cap = ps.event_cap;
+		double best = 1e30;
+		long events = 0;
+		int rejected = 0;
+		for (int r = 0; r <= PARSE_BENCH_ROUNDS; r++) {
+			clock_t t0 = clock();
+			events = 0;
+			rejected = 0;
+			for (int pos = 0; pos < ts.count;) {
+				int used = rd_gen_parse(&st, ts.tokens + pos);
+				if (used < 0) {
+					rejected++;
+					while (ts.tokens[pos] != dollar) {
+						pos++;
 					}
+					pos++;
+					continue;
 				}
+				events += st.event_count;
+				pos += used;
 			}
+			double ms = bench_ms(t0);
+			best = r > 0 && ms < best ? ms : best;
 		}
+		printf("%-8s %10.3f ms %8.1f Mtokens/s  rejected %d  events %ld\n", "codegen", best,
+			   best > 0 ? ts.count / best / 1000.0 : 0.0, rejected, events);
+	} else {
+		printf("task6_parser_gen.c was generated from a different grammar; skipping it.\n");
 	}
+#else
+	printf("Rebuild with -DTASK6_GENERATED after --emit task6_parser_gen.c to compare generated code.\n");
+#endif
+	ll_free(&ps);
+	free(ts.tokens);
+	return 0;
 }
 
-static void print_table(void) {
-	printf("Predictive Parsing Table\n");
-	printf("%-6s", "");
-	for (int t = 0; t < term_count; t++) {
-		printf(" %-12s", term_list[t]);
+/*
+ * Remove and re-add random productions, updating incrementally, then check
+ * the result against a full rebuild and compare the times. Before the
+ * check, two more edits introduce a nonterminal and a terminal the grammar
+ * did not have, so the widened sets and table are checked too.
+ */
+static int run_edit_benchmark(int dollar) {
+	if (!gram_index(&gram) || gram.prod_count < 2) {
+		return 0;
 	}
-	printf("\n");
+	Sym *rhs = malloc(sizeof(Sym) * (size_t)(gram.prod_off[gram.prod_count] + 1));
+	if (rhs == NULL) {
+		return 1;
+	}
+	srand(2);
+	double incremental = 0;
+	long rows = 0;
+	for (int r = 0; r < EDIT_BENCH_ROUNDS; r++) {
+		/* Production 0 stays put so the start symbol does not move. */
+		int p = 1 + rand() % (gram.prod_count - 1);
+		Sym lhs = gram.prod_lhs[p];
+		int len = gram_rhs_len(&gram, p);
+		memcpy(rhs, gram_rhs(&gram, p), sizeof(Sym) * (size_t)len);
+		clock_t t0 = clock();
+		int removed = remove_production(dollar, p);
+		int added = removed < 0 ? -1 : add_alternative(dollar, lhs, rhs, len);
+		incremental += bench_ms(t0);
+		if (added < 0) {
+			free(rhs);
+			return 1;
+		}
+		rows += removed + added;
+	}
+	free(rhs);
 
-	for (int i = 0; i < nt_count; i++) {
-		printf("%-6c", nt_list[i]);
-		for (int t = 0; t < term_count; t++) {
-			if (table[i][t][0] == '\0') {
-				printf(" %-12s", "-");
-			} else {
-				printf(" %-12s", table[i][t]);
+	/* Neither name can come out of the grammar reader, so both are new. */
+	Sym fresh[2] = { gram_nt(&gram, "<edit_bench>"), gram_term(&gram, "edit_bench") };
+	if (add_alternative(dollar, gram.prod_lhs[1], fresh, 2) < 0 || add_alternative(dollar, fresh[0], fresh, 0) < 0) {
+		return 1;
+	}
+
+	size_t set_bytes = sizeof(uint64_t) * (size_t)ff.words * (size_t)gram.nt_count;
+	size_t cells = (size_t)gram.nt_count * (size_t)gram.term_count;
+	uint64_t *first = malloc(set_bytes > 0 ? set_bytes : 1);
+	uint64_t *follow = malloc(set_bytes > 0 ? set_bytes : 1);
+	int16_t *cells_copy = malloc(sizeof(int16_t) * (cells > 0 ? cells : 1));
+	if (!first || !follow || !cells_copy) {
+		return 1;
+	}
+	memcpy(first, ff.first, set_bytes);
+	memcpy(follow, ff.follow, set_bytes);
+	memcpy(cells_copy, table, sizeof(int16_t) * cells);
+	int incremental_conflicts = conflict_cells;
+
+	double full = 1e30;
+	for (int r = 0; r < BENCH_ROUNDS; r++) {
+		clock_t t0 = clock();
+		if (!ff_compute(&gram, &ff, dollar) || !build_table()) {
+			return 1;
+		}
+		double ms = bench_ms(t0);
+		full = ms < full ? ms : full;
+	}
+	bool same = memcmp(first, ff.first, set_bytes) == 0 && memcmp(follow, ff.follow, set_bytes) == 0 &&
+				memcmp(cells_copy, table, sizeof(int16_t) * cells) == 0 && incremental_conflicts == conflict_cells;
+	free(first);
+	free(follow);
+	free(cells_copy);
+
+	printf("Edits (remove and re-add a random production, %d rounds)\n", EDIT_BENCH_ROUNDS);
+	printf("%-20s %10.4f ms per edit, %.1f rows rebuilt\n", "incremental", incremental / (2.0 * EDIT_BENCH_ROUNDS),
+		   rows / (2.0 * EDIT_BENCH_ROUNDS));
+	printf("%-20s %10.4f ms\n", "full rebuild", full);
+	printf("Incremental result %s the full rebuild\n", same ? "matches" : "DIFFERS FROM");
+	return same ? 0 : 1;
+}
+
+/* Time each analysis phase over several rounds and report the best one. */
+static int run_benchmark(int dollar) {
+	double best[4] = { 1e30, 1e30, 1e30, 1e30 };
+	for (int r = 0; r < BENCH_ROUNDS; r++) {
+		clock_t t0 = clock();
+		bool ok = ff_compute_first(&gram, &ff);
+		double ms = bench_ms(t0);
+		best[0] = ms < best[0] ? ms : best[0];
+
+		t0 = clock();
+		ok = ok && ff_compute_follow(&gram, &ff, dollar);
+		ms = bench_ms(t0);
+		best[1] = ms < best[1] ? ms : best[1];
+
+		t0 = clock();
+		ok = ok && build_table();
+		ms = bench_ms(t0);
+		best[2] = ms < best[2] ? ms : best[2];
+
+		t0 = clock();
+		ok = ok && pack_table(&packed);
+		ms = bench_ms(t0);
+		best[3] = ms < best[3] ? ms : best[3];
+		if (!ok) {
+			printf("Out of memory\n");
+			return 1;
+		}
+	}
+
+	/* Sweep every cell through both forms; they must agree off the error cells. */
+	long mismatches = 0;
+	long sum = 0;
+	double sweep[2] = { 1e30, 1e30 };
+	for (int r = 0; r < BENCH_ROUNDS; r++) {
+		clock_t t0 = clock();
+		for (int A = 0; A < gram.nt_count; A++) {
+			for (int t = 0; t < gram.term_count; t++) {
+				sum += *table_cell(A, t);
 			}
 		}
-		printf("\n");
+		double ms = bench_ms(t0);
+		sweep[0] = ms < sweep[0] ? ms : sweep[0];
+
+		t0 = clock();
+		for (int A = 0; A < gram.nt_count; A++) {
+			for (int t = 0; t < gram.term_count; t++) {
+				sum += packed_lookup(&packed, A, t);
+			}
+		}
+		ms = bench_ms(t0);
+		sweep[1] = ms < sweep[1] ? ms : sweep[1];
+	}
+	for (int A = 0; A < gram.nt_count; A++) {
+		for (int t = 0; t < gram.term_count; t++) {
+			int p = *table_cell(A, t);
+			mismatches += p != LL_EMPTY && p != packed_lookup(&packed, A, t);
+		}
 	}
-	printf("\n");
 
-	if (has_conflict) {
-		printf("Note: 'conflict' means the grammar is not LL(1).\n");
+	printf("Grammar: %d nonterminals, %d terminals, %d productions, %d RHS symbols\n", gram.nt_count,
+		   gram.term_count, gram.prod_count, gram.prod_off[gram.prod_count]);
+	printf("%-8s %10s\n", "Phase", "Best ms");
+	printf("%-8s %10.3f\n", "FIRST", best[0]);
+	printf("%-8s %10.3f\n", "FOLLOW", best[1]);
+	printf("%-8s %10.3f\n", "Table", best[2]);
+	printf("%-8s %10.3f\n", "Pack", best[3]);
+	printf("Full-table lookup sweep: dense %.3f ms, packed %.3f ms (checksum %ld)\n", sweep[0], sweep[1], sum);
+	if (mismatches > 0) {
+		printf("Packed table disagrees with the dense table in %ld cells\n", mismatches);
+		return 1;
 	}
+	printf("Conflicting cells: %d\n", conflict_cells);
+	if (has_conflict && max_k > 1) {
+		double llk_best = 1e30;
+		for (int r = 0; r < BENCH_ROUNDS; r++) {
+			clock_t t0 = clock();
+			if (!build_llk(dollar)) {
+				printf("Out of memory\n");
+				return 1;
+			}
+			double ms = bench_ms(t0);
+			llk_best = ms < llk_best ? ms : llk_best;
+		}
+		printf("LL(k) rows: %.3f ms, %d of %d conflicting cells resolved, %d rows\n", llk_best, llk.resolved,
+			   llk.cells, llk.rows);
+	}
+	print_memory();
+	if (!has_conflict && run_parse_benchmark(dollar) != 0) {
+		return 1;
+	}
+	return run_edit_benchmark(dollar);
 }
 
-int main(void) {
-	int n = 0;
-	char line[256];
+/* Analysis results as stored in the --cache file. */
+typedef struct {
+	int32_t nt_count;
+	int32_t words;
+	int32_t start;
+	int32_t conflict_count;
+	int32_t conflict_cells;
+	int32_t has_conflict;
+} CacheCounts;
 
-	printf("Enter number of productions: ");
-	if (scanf("%d", &n) != 1 || n <= 0 || n > MAX_PROD) {
-		return 1;
+#define CACHE_COUNTS GRAM_CACHE_TAG('L', 'C', 'N', 'T')
+#define CACHE_NULLABLE GRAM_CACHE_TAG('F', 'N', 'U', 'L')
+#define CACHE_FIRST GRAM_CACHE_TAG('F', 'F', 'S', 'T')
+#define CACHE_FOLLOW GRAM_CACHE_TAG('F', 'F', 'O', 'L')
+#define CACHE_TABLE GRAM_CACHE_TAG('L', 'T', 'B', 'L')
+#define CACHE_CONFLICTS GRAM_CACHE_TAG('L', 'C', 'F', 'L')
+
+static bool save_cache(const char *path, uint64_t hash) {
+	GramCacheWriter w;
+	GramCacheCounts gcounts;
+	CacheCounts counts = { ff.nt_count, ff.words, ff.start, conflict_count, conflict_cells, has_conflict };
+	size_t rows = (size_t)ff.nt_count;
+	size_t set_bytes = sizeof(uint64_t) * (size_t)ff.words * rows;
+	gram_cache_writer_init(&w, hash);
+	return gram_cache_put_grammar(&w, &gram, &gcounts) && gram_cache_add(&w, CACHE_COUNTS, &counts, sizeof(counts)) &&
+		   gram_cache_add(&w, CACHE_NULLABLE, ff.nullable, sizeof(bool) * rows) &&
+		   gram_cache_add(&w, CACHE_FIRST, ff.first, set_bytes) && gram_cache_add(&w, CACHE_FOLLOW, ff.follow, set_bytes) &&
+		   gram_cache_add(&w, CACHE_TABLE, table, sizeof(int16_t) * rows * (size_t)gram.term_count) &&
+		   gram_cache_add(&w, CACHE_CONFLICTS, conflicts, sizeof(Conflict) * (size_t)conflict_count) &&
+		   gram_cache_write(&w, path);
+}
+
+/* Restore the grammar, its sets and its table from a cache built from the same input. */
+static bool load_cache(const char *path, uint64_t hash) {
+	GramCache c;
+	if (!gram_cache_open(&c, path, hash)) {
+		return false;
+	}
+	const CacheCounts *n = gram_cache_get_sized(&c, CACHE_COUNTS, sizeof(CacheCounts));
+	bool ok = n != NULL && gram_cache_get_grammar(&c, &gram) && n->nt_count == gram.nt_count &&
+			  n->conflict_count >= 0 && ff_alloc(&ff, &gram) && n->words == ff.words;
+	size_t rows = (size_t)gram.nt_count;
+	size_t set_bytes = sizeof(uint64_t) * (size_t)ff.words * rows;
+	size_t cells = rows * (size_t)gram.term_count;
+	const bool *nullable = ok ? gram_cache_get_sized(&c, CACHE_NULLABLE, sizeof(bool) * rows) : NULL;
+	const uint64_t *first = ok ? gram_cache_get_sized(&c, CACHE_FIRST, set_bytes) : NULL;
+	const uint64_t *follow = ok ? gram_cache_get_sized(&c, CACHE_FOLLOW, set_bytes) : NULL;
+	const int16_t *cached = ok ? gram_cache_get_sized(&c, CACHE_TABLE, sizeof(int16_t) * cells) : NULL;
+	const Conflict *list = ok ? gram_cache_get_sized(&c, CACHE_CONFLICTS, sizeof(Conflict) * (size_t)n->conflict_count)
+							  : NULL;
+	ok = ok && nullable && first && follow && cached && list && gram_index(&gram);
+	if (ok) {
+		free(table);
+		table = malloc(sizeof(int16_t) * (cells > 0 ? cells : 1));
+		Conflict *grown = gram_grow(conflicts, &conflict_cap, n->conflict_count, sizeof(Conflict));
+		if (grown) {
+			conflicts = grown;
+		}
+		ok = table && grown;
+		table_rows = gram.nt_count;
+		table_cols = gram.term_count;
 	}
-	fgets(line, sizeof(line), stdin);
+	if (ok) {
+		memcpy(ff.nullable, nullable, sizeof(bool) * rows);
+		memcpy(ff.first, first, set_bytes);
+		memcpy(ff.follow, follow, set_bytes);
+		ff.start = n->start;
+		memcpy(table, cached, sizeof(int16_t) * cells);
+		memcpy(conflicts, list, sizeof(Conflict) * (size_t)n->conflict_count);
+		conflict_count = n->conflict_count;
+		conflict_cells = n->conflict_cells;
+		has_conflict = n->has_conflict != 0;
+	}
+	gram_cache_close(&c);
+	if (!ok) {
+		gram_free(&gram);
+		gram_init(&gram, GRAM_TOK_WORD);
+	}
+	return ok;
+}
 
-	for (int i = 0; i < n; i++) {
-		printf("Enter production %d (e.g., E->TX): ", i + 1);
+int main(int argc, char **argv) {
+	int n = 0;
+	static char line[MAX_LINE];
+	bool bench = false;
+	bool compress = false;
+	bool edit = false;
+	bool use_earley = false;
+	const char *emit_path = NULL;
+	const char *cache_path = NULL;
+	const char *grammar_path = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--bench") == 0) {
+			bench = true;
+		} else if (strcmp(argv[i], "--compress") == 0) {
+			compress = true;
+		} else if (strcmp(argv[i], "--edit") == 0) {
+			edit = true;
+		} else if (strcmp(argv[i], "--emit") == 0 && i + 1 < argc) {
+			emit_path = argv[++i];
+		} else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+			cache_path = argv[++i];
+		} else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+			grammar_path = argv[++i];
+		} else if (strcmp(argv[i], "--earley") == 0) {
+			use_earley = true;
+		} else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+			max_k = atoi(argv[++i]);
+		}
+	}
+	bool quiet = bench || edit || emit_path != NULL;
+
+	/*
+	 * Keep the raw grammar text (the mapped file, or the lines typed in):
+	 * the cache is keyed by its hash and a hit skips parsing it.
+	 */
+	GramFile file;
+	char *text = NULL;
+	int text_len = 0;
+	int text_cap = 0;
+	uint64_t hash = gram_hash_str(GRAM_HASH_INIT, grammar_path != NULL ? "task6 -f" : "task6");
+	memset(&file, 0, sizeof(file));
+	if (grammar_path != NULL) {
+		if (!gram_file_map(&file, grammar_path)) {
+			fprintf(stderr, "%s: cannot read file\n", grammar_path);
+			return 1;
+		}
+		hash = gram_hash(hash, file.data, file.size);
+	} else {
+		if (!quiet) {
+			printf("Enter number of productions: ");
+		}
+		if (scanf("%d", &n) != 1 || n <= 0) {
+			return 1;
+		}
+		fgets(line, sizeof(line), stdin);
+	}
+	for (int i = 0; grammar_path == NULL && i < n; i++) {
+		if (!quiet) {
+			printf("Enter production %d (e.g., E->TX): ", i + 1);
+		}
 		if (!fgets(line, sizeof(line), stdin)) {
 			return 1;
 		}
-		parse_line(line);
+		int len = (int)strlen(line) + 1;
+		text = gram_grow(text, &text_cap, text_len + len, 1);
+		if (text == NULL) {
+			return 1;
+		}
+		memcpy(text + text_len, line, (size_t)len);
+		text_len += len;
+		hash = gram_hash(hash, line, (size_t)len);
+	}
+
+	gram_init(&gram, GRAM_TOK_WORD);
+	clock_t t0 = clock();
+	bool cached = cache_path != NULL && !bench && load_cache(cache_path, hash);
+	if (!cached && grammar_path != NULL) {
+		GramError err;
+		if (!gram_load_buffer(&gram, file.data, file.size, &err)) {
+			gram_print_error(grammar_path, &err);
+			return 1;
+		}
+	} else if (!cached) {
+		for (int i = 0; i < text_len; i += (int)strlen(text + i) + 1) {
+			gram_parse_line(&gram, text + i);
+		}
 	}
+	gram_file_unmap(&file);
+	free(text);
+	if (gram.prod_count == 0) {
+		return 1;
+	}
+	int dollar = gram_term_index(gram_term(&gram, "$"));
 
-	collect_terminals();
+	if (bench) {
+		return run_benchmark(dollar);
+	}
 
-	bool changed = true;
-	while (changed) {
-		changed = compute_first();
+	if (!cached) {
+		if (!ff_compute(&gram, &ff, dollar) || !build_table()) {
+			return 1;
+		}
+		if (cache_path != NULL && !save_cache(cache_path, hash)) {
+			fprintf(stderr, "Could not write cache %s\n", cache_path);
+		}
+	}
+	if (cache_path != NULL) {
+		fprintf(stderr, "Startup (%s): %.3f ms\n", cached ? "warm, cache hit" : "cold, cache written", bench_ms(t0));
+	}
+	if (edit) {
+		/* find_production needs the index; a cold start has not built it. */
+		if (!gram_index(&gram)) {
+			printf("Out of memory\n");
+			return 1;
+		}
+		printf("Conflicting cells: %d\n", conflict_cells);
+		print_conflicts();
+		while (fgets(line, sizeof(line), stdin)) {
+			if (line[0] == '+' || line[0] == '-') {
+				run_edit(line, dollar);
+			}
+		}
+		return 0;
 	}
 
-	changed = true;
-	while (changed) {
-		changed = compute_follow();
+	if (emit_path != NULL) {
+		if (has_conflict) {
+			printf("Grammar is not LL(1); no parser generated.\n");
+			return 1;
+		}
+		FILE *out = fopen(emit_path, "w");
+		if (out == NULL) {
+			perror("fopen");
+			return 1;
+		}
+		bool ok = emit_parser_c(out, dollar);
+		fclose(out);
+		if (!ok) {
+			return 1;
+		}
+		printf("Generated C parser written to %s\n", emit_path);
+		return 0;
 	}
 
-	build_table();
 	print_table();
+	if (has_conflict && max_k > 1) {
+		if (!build_llk(dollar)) {
+			return 1;
+		}
+		print_llk();
+	}
+	if (has_conflict && (max_k <= 1 || llk.resolved < llk.cells)) {
+		printf("\nThe table cannot decide every cell; the input is recognized with Earley.\n");
+		use_earley = true;
+	}
+
+	if (compress) {
+		if (!pack_table(&packed)) {
+			return 1;
+		}
+		print_memory();
+	}
+
+	printf("\nEnter input string: ");
+	if (!fgets(line, sizeof(line), stdin)) {
+		return 0;
+	}
+	int *input = malloc(sizeof(int) * (strlen(line) + 1));
+	if (!input) {
+		return 1;
+	}
+	int len = gram_lex_input(&gram, line, input, (int)strlen(line));
+	if (use_earley) {
+		EarleyParser ep;
+		if (!gram_index(&gram) || !earley_init(&ep, &gram, ff.nullable, gram.start)) {
+			free(input);
+			return 1;
+		}
+		if (earley_recognize(&ep, input, len)) {
+			printf("Accepted (%d items in %d Earley sets)\n", ep.count, ep.sets);
+		} else if (ep.error_pos == len) {
+			printf("Rejected: input ends before a complete sentence\n");
+		} else {
+			printf("Rejected at token %d\n", ep.error_pos + 1);
+		}
+		earley_free(&ep);
+		free(input);
+		return 0;
+	}
+	input[len++] = dollar;
+	LlParser ps;
+	ll_init(&ps, MAX_EVENTS);
+	int used = ll_parse(&ps, compress ? &packed : NULL, input, len, gram.start, dollar);
+	if (used == len) {
+		print_parse_tree(&ps, dollar);
+		printf("Accepted\n");
+	} else if (used > 0) {
+		printf("Rejected: input continues after a complete sentence\n");
+	} else {
+		printf("Rejected at token %d\n", ps.error_pos + 1);
+	}
+	ll_free(&ps);
+	free(input);
 
 	return 0;
 }
@@ -1,116 +1,186 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-
-#define MAX_INPUT 128
-#define MAX_STACK 128
-
-static const char *PRODS[] = {
-	"E->E+E",
-	"E->E*E",
-	"E->(E)",
-	"E->id"
+#include <time.h>
+
+#include "grammar.h"
+#include "opprec.h"
+
+#define TASK7_MAX_INPUT 4096
+#define BENCH_TOKENS (1 << 22)
+#define BENCH_ROUNDS 5
+#define BENCH_MAX_DEPTH 32
+
+/*
+ * The expression grammar in operator form. Precedence and associativity
+ * of + and * follow from its shape, so the relations between terminals
+ * come out of LEADING and TRAILING without conflicts.
+ */
+static const char *GRAMMAR[] = {
+	"E->E+T|T",
+	"T->T*F|F",
+	"F->(E)|id"
 };
 
-static int prod_count = 4;
+static Grammar gram;
+static OpSets sets;
+static OpTable table;
+static int dollar;
+
+typedef struct {
+	const int *tokens;
+	int n;
+} Trace;
 
 static void print_state(const char *stack, const char *input, const char *action) {
 	printf("%-20s %-20s %-20s\n", stack, input, action);
 }
 
-static int match_handle(char *stack, int *top) {
-	if (*top < 0) {
-		return 0;
-	}
+static void append(char *buf, size_t size, const char *s) {
+	size_t used = strlen(buf);
+	snprintf(buf + used, size - used, "%s", s);
+}
 
-	if (*top >= 1 && stack[*top] == 'd' && stack[*top - 1] == 'i') {
-		stack[*top - 1] = 'E';
-		(*top)--;
-		stack[*top + 1] = '\0';
-		return 4;
+static void trace_step(void *ctx, const OpParser *ps, int ip, int action) {
+	const Trace *tr = ctx;
+	char stack[TASK7_MAX_INPUT] = "";
+	char input[TASK7_MAX_INPUT] = "";
+	char text[TASK7_MAX_INPUT];
+	char act[TASK7_MAX_INPUT];
+	for (int i = 1; i < ps->depth; i++) {
+		append(stack, sizeof(stack), gram_name(&gram, ps->stack[i]));
 	}
-
-	if (*top >= 2 && stack[*top] == 'E' && stack[*top - 1] == '+' && stack[*top - 2] == 'E') {
-		stack[*top - 2] = 'E';
-		(*top) -= 2;
-		stack[*top + 1] = '\0';
-		return 1;
+	for (int i = ip; i < tr->n; i++) {
+		append(input, sizeof(input), tr->tokens[i] < 0 ? "?" : gram_term_name(&gram, tr->tokens[i]));
+	}
+	if (action == OP_SHIFT) {
+		snprintf(act, sizeof(act), "Shift %s", gram_term_name(&gram, tr->tokens[ip]));
+	} else if (action == OP_ACCEPT) {
+		snprintf(act, sizeof(act), "Accept");
+	} else if (action == OP_REJECT) {
+		snprintf(act, sizeof(act), "Reject");
+	} else {
+		gram_format_rhs(&gram, gram_rhs(&gram, action), gram_rhs_len(&gram, action), text, sizeof(text));
+		snprintf(act, sizeof(act), "Reduce %s->%.40s", gram_nt_name(&gram, gram.prod_lhs[action]), text);
 	}
+	print_state(stack, input, act);
+}
 
-	if (*top >= 2 && stack[*top] == 'E' && stack[*top - 1] == '*' && stack[*top - 2] == 'E') {
-		stack[*top - 2] = 'E';
-		(*top) -= 2;
-		stack[*top + 1] = '\0';
-		return 2;
+static bool build_grammar(void) {
+	char line[TASK7_MAX_INPUT];
+	gram_init(&gram, GRAM_TOK_WORD);
+	for (size_t i = 0; i < sizeof(GRAMMAR) / sizeof(GRAMMAR[0]); i++) {
+		snprintf(line, sizeof(line), "%s", GRAMMAR[i]);
+		gram_parse_line(&gram, line);
 	}
+	dollar = gram_term_index(gram_term(&gram, "$"));
+	return op_compute_sets(&gram, &sets) && op_build_table(&table, &gram, &sets, dollar);
+}
 
-	if (*top >= 2 && stack[*top] == ')' && stack[*top - 1] == 'E' && stack[*top - 2] == '(') {
-		stack[*top - 2] = 'E';
-		(*top) -= 2;
-		stack[*top + 1] = '\0';
-		return 3;
+static double bench_ms(clock_t t0) {
+	return (double)(clock() - t0) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+/* One long random expression over id, +, *, ( and ), ending with $. */
+static int generate_expression(int *tokens, int max) {
+	int id = gram_find_term(&gram, "id");
+	int plus = gram_find_term(&gram, "+");
+	int times = gram_find_term(&gram, "*");
+	int open = gram_find_term(&gram, "(");
+	int close = gram_find_term(&gram, ")");
+	int n = 0;
+	int depth = 0;
+	srand(1);
+	while (n < max - 2 * BENCH_MAX_DEPTH - 4) {
+		while (depth < BENCH_MAX_DEPTH && rand() % 4 == 0) {
+			tokens[n++] = open;
+			depth++;
+		}
+		tokens[n++] = id;
+		while (depth > 0 && rand() % 3 == 0) {
+			tokens[n++] = close;
+			depth--;
+		}
+		tokens[n++] = rand() % 2 ? plus : times;
 	}
+	tokens[n++] = id;
+	while (depth-- > 0) {
+		tokens[n++] = close;
+	}
+	tokens[n++] = dollar;
+	return n;
+}
 
+/* Parse a long expression with the relation matrix and with f/g, best of several rounds each. */
+static int run_benchmark(void) {
+	int *tokens = malloc(sizeof(int) * BENCH_TOKENS);
+	if (tokens == NULL) {
+		return 1;
+	}
+	int n = generate_expression(tokens, BENCH_TOKENS);
+	OpParser ps;
+	op_parser_init(&ps);
+	bool funcs = table.has_funcs;
+	printf("Expression of %d tokens, %d terminals\n", n, table.n);
+	printf("%-20s %12s %14s %12s\n", "Relations", "bytes", "Mtokens/s", "reductions");
+	for (int mode = 0; mode < 2; mode++) {
+		if (mode == 1 && !funcs) {
+			printf("%-20s (relation graph has a cycle)\n", "functions f/g");
+			break;
+		}
+		table.has_funcs = mode == 1;
+		double best = 1e30;
+		long reductions = 0;
+		for (int r = 0; r < BENCH_ROUNDS; r++) {
+			clock_t t0 = clock();
+			reductions = op_parse(&ps, &table, &gram, tokens, n, NULL, NULL);
+			double ms = bench_ms(t0);
+			best = ms < best ? ms : best;
+		}
+		if (reductions < 0) {
+			printf("Rejected at token %d\n", ps.error_pos + 1);
+			break;
+		}
+		size_t bytes = mode == 0 ? (size_t)table.n * (size_t)table.n : 2 * sizeof(int) * (size_t)table.n;
+		printf("%-20s %12zu %14.1f %12ld\n", mode == 0 ? "matrix" : "functions f/g", bytes,
+			   best > 0 ? n / best / 1000.0 : 0.0, reductions);
+	}
+	table.has_funcs = funcs;
+	op_parser_free(&ps);
+	free(tokens);
 	return 0;
 }
 
-int main(void) {
-	char input[MAX_INPUT];
-	char stack[MAX_STACK];
-	int top = -1;
+int main(int argc, char **argv) {
+	char input[TASK7_MAX_INPUT];
+	if (!build_grammar()) {
+		return 1;
+	}
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		return run_benchmark();
+	}
 
 	printf("Enter input string (use id, +, *, (, )): ");
 	if (!fgets(input, sizeof(input), stdin)) {
 		return 1;
 	}
 	input[strcspn(input, "\r\n")] = '\0';
-	strcat(input, "$" );
+
+	int tokens[TASK7_MAX_INPUT + 1];
+	int n = gram_lex_input(&gram, input, tokens, TASK7_MAX_INPUT);
+	tokens[n++] = dollar;
 
 	printf("\n%-20s %-20s %-20s\n", "Stack", "Input", "Action");
 	printf("------------------------------------------------------------\n");
 
-	stack[0] = '\0';
-	int ip = 0;
-
-	while (1) {
-		int reduced = 0;
-		int rule = match_handle(stack, &top);
-		if (rule != 0) {
-			char action[32];
-			snprintf(action, sizeof(action), "Reduce %s", PRODS[rule - 1]);
-			print_state(stack, &input[ip], action);
-			reduced = 1;
-		}
-
-		if (reduced) {
-			continue;
-		}
-
-		if (input[ip] == '$' && top == 0 && stack[top] == 'E') {
-			print_state(stack, &input[ip], "Accept");
-			break;
-		}
-
-		if (input[ip] == '$') {
-			print_state(stack, &input[ip], "Reject");
-			break;
-		}
-
-		if (input[ip] == 'i' && input[ip + 1] == 'd') {
-			stack[++top] = 'i';
-			stack[++top] = 'd';
-			stack[top + 1] = '\0';
-			print_state(stack, &input[ip], "Shift id");
-			ip += 2;
-			continue;
-		}
-
-		stack[++top] = input[ip];
-		stack[top + 1] = '\0';
-		char action[32];
-		snprintf(action, sizeof(action), "Shift %c", input[ip]);
-		print_state(stack, &input[ip], action);
-		ip++;
-	}
+	/* f/g read blank (error) cells as relations, so the traced parse uses the matrix. */
+	Trace tr = { tokens, n };
+	OpParser ps;
+	OpTable matrix = table;
+	matrix.has_funcs = false;
+	op_parser_init(&ps);
+	op_parse(&ps, &matrix, &gram, tokens, n, trace_step, &tr);
+	op_parser_free(&ps);
 
 	printf("\nSample input: id+id*id\n");
 	return 0;
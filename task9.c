@@ -1,254 +1,339 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include <stdbool.h>
+#include <time.h>
 
-#define MAX_PROD 64
-#define MAX_LEN 64
-#define MAX_ITEMS 256
-#define MAX_STATES 128
-#define MAX_SYMBOLS 64
-
-typedef struct {
-	char lhs;
-	char rhs[MAX_LEN];
-} Production;
+#include "grammar.h"
+#include "gram_cache.h"
 
 typedef struct {
 	int prod;
 	int dot;
 } Item;
 
+/*
+ * The items of state i are items[first .. first + count), sorted by
+ * production and dot. Its kernel (the items a goto produced, before
+ * closure) is kept in the same order in kernels[kernel .. kernel +
+ * kernel_count); the kernel alone decides the state.
+ */
 typedef struct {
-	Item items[MAX_ITEMS];
+	int first;
 	int count;
-	int trans[MAX_SYMBOLS];
+	int kernel;
+	int kernel_count;
+	uint32_t hash;
+	int goto_first;
+	int goto_count;
 } State;
 
-static Production prods[MAX_PROD];
-static int prod_count = 0;
+/* One GOTO entry: from its state on symbols[col] to state to. */
+typedef struct {
+	int col;
+	int to;
+} Goto;
+
+static Grammar input;
+static Grammar gram;
 
-static char symbols[MAX_SYMBOLS];
+/* GOTO table columns: symbols[col], with the column of each symbol in col_nt / col_term. */
+static Sym *symbols;
 static int sym_count = 0;
+static int sym_cap = 0;
+static int *col_nt;
+static int *col_term;
 
-static State states[MAX_STATES];
+static State *states;
 static int state_count = 0;
-
-static void trim_spaces(char *s) {
-	char *p = s;
-	char *q = s;
-	while (*p) {
-		if (!isspace((unsigned char)*p)) {
-			*q++ = *p;
-		}
-		p++;
+static int state_cap = 0;
+static Item *items;
+static int item_count = 0;
+static int item_cap = 0;
+static Item *kernels;
+static int kernel_count = 0;
+static int kernel_cap = 0;
+
+/*
+ * The GOTO entries of state i are gotos[goto_first .. + goto_count), by
+ * column. Only existing transitions are stored; a dense row per state
+ * would grow with states times symbols.
+ */
+static Goto *gotos;
+static int goto_count = 0;
+static int goto_cap = 0;
+
+/* Open-addressing set of state indices keyed by kernel; -1 marks a free slot. */
+static int *state_table;
+static int table_cap = 0;
+
+/* expanded[A] == state + 1 once A's productions are in that state's closure. */
+static int *expanded;
+
+static int sym_index(Sym s) {
+	int *col = gram_is_term(s) ? &col_term[gram_term_index(s)] : &col_nt[s];
+	if (*col >= 0) {
+		return *col;
 	}
-	*q = '\0';
-}
-
-static bool is_nonterminal(char c) {
-	return isupper((unsigned char)c);
+	Sym *grown = gram_grow(symbols, &sym_cap, sym_count + 1, sizeof(Sym));
+	if (!grown) {
+		return -1;
+	}
+	symbols = grown;
+	symbols[sym_count] = s;
+	*col = sym_count;
+	return sym_count++;
 }
 
-static int sym_index(char c) {
-	for (int i = 0; i < sym_count; i++) {
-		if (symbols[i] == c) {
-			return i;
-		}
+static bool collect_symbols(void) {
+	col_nt = malloc(sizeof(int) * (size_t)(gram.nt_count > 0 ? gram.nt_count : 1));
+	col_term = malloc(sizeof(int) * (size_t)(gram.term_count > 0 ? gram.term_count : 1));
+	if (!col_nt || !col_term) {
+		return false;
+	}
+	for (int A = 0; A < gram.nt_count; A++) {
+		col_nt[A] = -1;
 	}
-	if (sym_count < MAX_SYMBOLS) {
-		symbols[sym_count] = c;
-		return sym_count++;
+	for (int t = 0; t < gram.term_count; t++) {
+		col_term[t] = -1;
 	}
-	return -1;
+	for (int p = 0; p < gram.prod_count; p++) {
+		if (sym_index(gram.prod_lhs[p]) < 0) {
+			return false;
+		}
+		const Sym *rhs = gram_rhs(&gram, p);
+		for (int j = 0; j < gram_rhs_len(&gram, p); j++) {
+			if (sym_index(rhs[j]) < 0) {
+				return false;
+			}
+		}
+	}
+	return true;
 }
 
-static void add_production(char lhs, const char *rhs) {
-	if (prod_count < MAX_PROD) {
-		prods[prod_count].lhs = lhs;
-		strncpy(prods[prod_count].rhs, rhs, MAX_LEN - 1);
-		prods[prod_count].rhs[MAX_LEN - 1] = '\0';
-		prod_count++;
-	}
+static int sym_col(Sym s) {
+	return gram_is_term(s) ? col_term[gram_term_index(s)] : col_nt[s];
 }
 
-static void parse_line(char *line) {
-	trim_spaces(line);
-	if (strlen(line) < 4) {
-		return;
-	}
-	char lhs = line[0];
-	if (!is_nonterminal(lhs)) {
-		return;
-	}
-	char *arrow = strstr(line, "->");
-	if (!arrow) {
-		return;
-	}
-	char *rhs = arrow + 2;
-	char *token = strtok(rhs, "|");
-	while (token) {
-		add_production(lhs, token);
-		token = strtok(NULL, "|");
+static bool push_item(Item **pool, int *count, int *cap, int prod, int dot) {
+	Item *grown = gram_grow(*pool, cap, *count + 1, sizeof(Item));
+	if (!grown) {
+		return false;
 	}
+	*pool = grown;
+	(*pool)[*count].prod = prod;
+	(*pool)[*count].dot = dot;
+	(*count)++;
+	return true;
 }
 
-static void collect_symbols(void) {
-	for (int i = 0; i < prod_count; i++) {
-		sym_index(prods[i].lhs);
-		for (int j = 0; prods[i].rhs[j] != '\0'; j++) {
-			sym_index(prods[i].rhs[j]);
-		}
+static int compare_items(const void *a, const void *b) {
+	const Item *x = a;
+	const Item *y = b;
+	if (x->prod != y->prod) {
+		return x->prod < y->prod ? -1 : 1;
 	}
+	return (x->dot > y->dot) - (x->dot < y->dot);
 }
 
-static bool item_exists(State *st, int prod, int dot) {
-	for (int i = 0; i < st->count; i++) {
-		if (st->items[i].prod == prod && st->items[i].dot == dot) {
-			return true;
+/*
+ * Append the closure of state st's kernel to the item pool. Each
+ * nonterminal is expanded once per state, so no item is added twice and
+ * nothing is searched.
+ */
+static bool closure(int st) {
+	State *state = &states[st];
+	state->first = item_count;
+	for (int i = 0; i < state->kernel_count; i++) {
+		Item it = kernels[state->kernel + i];
+		if (!push_item(&items, &item_count, &item_cap, it.prod, it.dot)) {
+			return false;
 		}
 	}
-	return false;
+	for (int i = state->first; i < item_count; i++) {
+		Item it = items[i];
+		if (it.dot >= gram_rhs_len(&gram, it.prod)) {
+			continue;
+		}
+		Sym sym = gram_rhs(&gram, it.prod)[it.dot];
+		if (gram_is_term(sym) || expanded[sym] == st + 1) {
+			continue;
+		}
+		expanded[sym] = st + 1;
+		for (int k = gram.nt_first[sym]; k < gram.nt_first[sym + 1]; k++) {
+			if (!push_item(&items, &item_count, &item_cap, gram.nt_prods[k], 0)) {
+				return false;
+			}
+		}
+	}
+	state->count = item_count - state->first;
+	qsort(&items[state->first], (size_t)state->count, sizeof(Item), compare_items);
+	return true;
 }
 
-static void add_item(State *st, int prod, int dot) {
-	if (st->count >= MAX_ITEMS) {
-		return;
-	}
-	if (!item_exists(st, prod, dot)) {
-		st->items[st->count].prod = prod;
-		st->items[st->count].dot = dot;
-		st->count++;
+static uint32_t hash_kernel(const Item *kernel, int n) {
+	uint64_t h = GRAM_HASH_INIT;
+	for (int i = 0; i < n; i++) {
+		h = (h ^ (uint32_t)kernel[i].prod) * 0x100000001b3ull;
+		h = (h ^ (uint32_t)kernel[i].dot) * 0x100000001b3ull;
 	}
+	return (uint32_t)(h ^ (h >> 32));
 }
 
-static void closure(State *st) {
-	bool changed = true;
-	while (changed) {
-		changed = false;
-		for (int i = 0; i < st->count; i++) {
-			Item it = st->items[i];
-			char *rhs = prods[it.prod].rhs;
-			int len = (int)strlen(rhs);
-			if (it.dot < len) {
-				char sym = rhs[it.dot];
-				if (is_nonterminal(sym)) {
-					for (int p = 0; p < prod_count; p++) {
-						if (prods[p].lhs == sym) {
-							if (!item_exists(st, p, 0)) {
-								add_item(st, p, 0);
-								changed = true;
-							}
-						}
-					}
-				}
-			}
-		}
-	}
+static bool same_kernel(const State *st, const Item *kernel, int n) {
+	return st->kernel_count == n && memcmp(&kernels[st->kernel], kernel, sizeof(Item) * (size_t)n) == 0;
 }
 
-static void sort_items(State *st) {
-	for (int i = 0; i < st->count - 1; i++) {
-		for (int j = i + 1; j < st->count; j++) {
-			Item a = st->items[i];
-			Item b = st->items[j];
-			if (a.prod > b.prod || (a.prod == b.prod && a.dot > b.dot)) {
-				st->items[i] = b;
-				st->items[j] = a;
-			}
+/* The slot holding the state with this kernel, or the free slot where it would go. */
+static size_t table_slot(const Item *kernel, int n, uint32_t hash) {
+	size_t i = hash & (size_t)(table_cap - 1);
+	while (state_table[i] >= 0) {
+		const State *st = &states[state_table[i]];
+		if (st->hash == hash && same_kernel(st, kernel, n)) {
+			break;
 		}
+		i = (i + 1) & (size_t)(table_cap - 1);
 	}
+	return i;
 }
 
-static bool same_state(State *a, State *b) {
-	if (a->count != b->count) {
+static bool table_grow(void) {
+	int cap = table_cap > 0 ? table_cap * 2 : 256;
+	int *table = malloc(sizeof(int) * (size_t)cap);
+	if (!table) {
 		return false;
 	}
-	for (int i = 0; i < a->count; i++) {
-		if (a->items[i].prod != b->items[i].prod || a->items[i].dot != b->items[i].dot) {
-			return false;
-		}
+	for (int i = 0; i < cap; i++) {
+		table[i] = -1;
+	}
+	free(state_table);
+	state_table = table;
+	table_cap = cap;
+	for (int st = 0; st < state_count; st++) {
+		const State *s = &states[st];
+		state_table[table_slot(&kernels[s->kernel], s->kernel_count, s->hash)] = st;
 	}
 	return true;
 }
 
-static int find_state(State *st) {
-	for (int i = 0; i < state_count; i++) {
-		if (same_state(&states[i], st)) {
-			return i;
-		}
+/* Index of the state with this sorted kernel, adding it (closure and all) when new; -1 when out of memory. */
+static int find_state(const Item *kernel, int n) {
+	uint32_t hash = hash_kernel(kernel, n);
+	if (2 * (state_count + 1) > table_cap && !table_grow()) {
+		return -1;
 	}
-	return -1;
-}
-
-static State goto_state(State *st, char sym) {
-	State next;
-	next.count = 0;
-	for (int i = 0; i < MAX_SYMBOLS; i++) {
-		next.trans[i] = -1;
+	size_t slot = table_slot(kernel, n, hash);
+	if (state_table[slot] >= 0) {
+		return state_table[slot];
 	}
 
-	for (int i = 0; i < st->count; i++) {
-		Item it = st->items[i];
-		char *rhs = prods[it.prod].rhs;
-		int len = (int)strlen(rhs);
-		if (it.dot < len && rhs[it.dot] == sym) {
-			add_item(&next, it.prod, it.dot + 1);
+	State *grown = gram_grow(states, &state_cap, state_count + 1, sizeof(State));
+	if (!grown) {
+		return -1;
+	}
+	states = grown;
+	int st = state_count++;
+	states[st].kernel = kernel_count;
+	states[st].kernel_count = n;
+	states[st].hash = hash;
+	for (int i = 0; i < n; i++) {
+		if (!push_item(&kernels, &kernel_count, &kernel_cap, kernel[i].prod, kernel[i].dot)) {
+			return -1;
 		}
 	}
-
-	closure(&next);
-	sort_items(&next);
-	return next;
+	states[st].goto_first = 0;
+	states[st].goto_count = 0;
+	state_table[slot] = st;
+	return closure(st) ? st : -1;
 }
 
-static void build_canonical_collection(void) {
-	State start;
-	start.count = 0;
-	for (int i = 0; i < MAX_SYMBOLS; i++) {
-		start.trans[i] = -1;
-	}
-
-	add_item(&start, 0, 0);
-	closure(&start);
-	sort_items(&start);
-
-	states[state_count++] = start;
+static int compare_ints(const void *a, const void *b) {
+	int x = *(const int *)a;
+	int y = *(const int *)b;
+	return (x > y) - (x < y);
+}
 
-	int idx = 0;
-	while (idx < state_count) {
-		State *cur = &states[idx];
-		for (int s = 0; s < sym_count; s++) {
-			State next = goto_state(cur, symbols[s]);
-			if (next.count == 0) {
-				continue;
-			}
-			int existing = find_state(&next);
-			if (existing == -1) {
-				if (state_count >= MAX_STATES) {
-					return;
+/*
+ * Worklist over states in creation order, visiting goto symbols by
+ * column so numbering matches a symbol-by-symbol goto. One pass over a
+ * state's items sorts the advanced items into a bucket per symbol;
+ * because the items are sorted, every bucket is already a sorted kernel.
+ * Only the columns a state uses are visited.
+ */
+static bool build_canonical_collection(void) {
+	int *count = calloc((size_t)(sym_count > 0 ? sym_count : 1), sizeof(int));
+	int *offset = malloc(sizeof(int) * (size_t)(sym_count > 0 ? sym_count : 1));
+	int *used = malloc(sizeof(int) * (size_t)(sym_count > 0 ? sym_count : 1));
+	Item *bucket = NULL;
+	int bucket_cap = 0;
+	expanded = calloc((size_t)(gram.nt_count > 0 ? gram.nt_count : 1), sizeof(int));
+	Item start = { 0, 0 };
+	bool ok = count && offset && used && expanded && find_state(&start, 1) == 0;
+
+	for (int idx = 0; ok && idx < state_count; idx++) {
+		const State *cur = &states[idx];
+		int used_count = 0;
+		for (int i = 0; i < cur->count; i++) {
+			Item it = items[cur->first + i];
+			if (it.dot < gram_rhs_len(&gram, it.prod)) {
+				int s = sym_col(gram_rhs(&gram, it.prod)[it.dot]);
+				if (count[s]++ == 0) {
+					used[used_count++] = s;
 				}
-				states[state_count] = next;
-				cur->trans[s] = state_count;
-				state_count++;
-			} else {
-				cur->trans[s] = existing;
 			}
 		}
-		idx++;
+		qsort(used, (size_t)used_count, sizeof(int), compare_ints);
+		int total = 0;
+		for (int u = 0; u < used_count; u++) {
+			offset[used[u]] = total;
+			total += count[used[u]];
+		}
+		Item *grown = gram_grow(bucket, &bucket_cap, total + 1, sizeof(Item));
+		Goto *edges = gram_grow(gotos, &goto_cap, goto_count + used_count, sizeof(Goto));
+		bucket = grown ? grown : bucket;
+		gotos = edges ? edges : gotos;
+		if (!grown || !edges) {
+			ok = false;
+			break;
+		}
+		for (int i = 0; i < cur->count; i++) {
+			Item it = items[cur->first + i];
+			if (it.dot < gram_rhs_len(&gram, it.prod)) {
+				int s = sym_col(gram_rhs(&gram, it.prod)[it.dot]);
+				bucket[offset[s]].prod = it.prod;
+				bucket[offset[s]].dot = it.dot + 1;
+				offset[s]++;
+			}
+		}
+		states[idx].goto_first = goto_count;
+		for (int u = 0; u < used_count && ok; u++) {
+			int s = used[u];
+			int n = count[s];
+			count[s] = 0;
+			int next = find_state(&bucket[offset[s] - n], n);
+			ok = next >= 0;
+			gotos[goto_count].col = s;
+			gotos[goto_count++].to = next;
+		}
+		states[idx].goto_count = goto_count - states[idx].goto_first;
 	}
+	free(count);
+	free(offset);
+	free(used);
+	free(bucket);
+	return ok;
 }
 
 static void print_item(Item it) {
-	char *rhs = prods[it.prod].rhs;
-	int len = (int)strlen(rhs);
-	printf("%c -> ", prods[it.prod].lhs);
+	const Sym *rhs = gram_rhs(&gram, it.prod);
+	int len = gram_rhs_len(&gram, it.prod);
+	printf("%s -> ", gram_nt_name(&gram, gram.prod_lhs[it.prod]));
 	for (int i = 0; i <= len; i++) {
 		if (i == it.dot) {
 			printf(".");
 		}
 		if (i < len) {
-			printf("%c", rhs[i]);
+			printf("%s", gram_name(&gram, rhs[i]));
 		}
 	}
 }
@@ -258,7 +343,7 @@ static void print_states(void) {
 		printf("I%d:\n", i);
 		for (int j = 0; j < states[i].count; j++) {
 			printf("  ");
-			print_item(states[i].items[j]);
+			print_item(items[states[i].first + j]);
 			printf("\n");
 		}
 		printf("\n");
@@ -269,17 +354,20 @@ static void print_goto_table(void) {
 	printf("GOTO Table\n");
 	printf("%-6s", "");
 	for (int s = 0; s < sym_count; s++) {
-		printf(" %-6c", symbols[s]);
+		printf(" %-6s", gram_name(&gram, symbols[s]));
 	}
 	printf("\n");
 
 	for (int i = 0; i < state_count; i++) {
+		const Goto *g = &gotos[states[i].goto_first];
+		const Goto *end = g + states[i].goto_count;
 		printf("%-6d", i);
 		for (int s = 0; s < sym_count; s++) {
-			if (states[i].trans[s] == -1) {
-				printf(" %-6s", "-");
+			if (g < end && g->col == s) {
+				printf(" %-6d", g->to);
+				g++;
 			} else {
-				printf(" %-6d", states[i].trans[s]);
+				printf(" %-6s", "-");
 			}
 		}
 		printf("\n");
@@ -287,57 +375,240 @@ static void print_goto_table(void) {
 	printf("\n");
 }
 
+#define CACHE_COUNTS GRAM_CACHE_TAG('L', 'R', 'C', 'N')
+#define CACHE_SYMBOLS GRAM_CACHE_TAG('L', 'R', 'S', 'Y')
+#define CACHE_ITEM_OFF GRAM_CACHE_TAG('L', 'R', 'I', 'O')
+#define CACHE_ITEMS GRAM_CACHE_TAG('L', 'R', 'I', 'T')
+#define CACHE_GOTO_OFF GRAM_CACHE_TAG('L', 'R', 'G', 'O')
+#define CACHE_GOTOS GRAM_CACHE_TAG('L', 'R', 'G', 'T')
+
+/*
+ * States are stored flat: items of state i are items[item_off[i] ..
+ * item_off[i + 1]) and its GOTO entries gotos[goto_off[i] .. goto_off[i + 1]).
+ */
+static bool save_cache(const char *path, uint64_t hash) {
+	int32_t counts[2] = { state_count, sym_count };
+	int *item_off = malloc(sizeof(int) * (size_t)(state_count + 1));
+	int *goto_off = malloc(sizeof(int) * (size_t)(state_count + 1));
+	if (!item_off || !goto_off) {
+		free(item_off);
+		free(goto_off);
+		return false;
+	}
+	for (int i = 0; i < state_count; i++) {
+		item_off[i] = states[i].first;
+		goto_off[i] = states[i].goto_first;
+	}
+	item_off[state_count] = item_count;
+	goto_off[state_count] = goto_count;
+
+	GramCacheWriter w;
+	GramCacheCounts gcounts;
+	gram_cache_writer_init(&w, hash);
+	bool ok = gram_cache_put_grammar(&w, &gram, &gcounts) && gram_cache_add(&w, CACHE_COUNTS, counts, sizeof(counts)) &&
+			  gram_cache_add(&w, CACHE_SYMBOLS, symbols, sizeof(Sym) * (size_t)sym_count) &&
+			  gram_cache_add(&w, CACHE_ITEM_OFF, item_off, sizeof(int) * (size_t)(state_count + 1)) &&
+			  gram_cache_add(&w, CACHE_ITEMS, items, sizeof(Item) * (size_t)item_count) &&
+			  gram_cache_add(&w, CACHE_GOTO_OFF, goto_off, sizeof(int) * (size_t)(state_count + 1)) &&
+			  gram_cache_add(&w, CACHE_GOTOS, gotos, sizeof(Goto) * (size_t)goto_count) &&
+			  gram_cache_write(&w, path);
+	free(item_off);
+	free(goto_off);
+	return ok;
+}
+
+/* Restore the augmented grammar and its canonical collection from a cache built from the same input. */
+static bool load_cache(const char *path, uint64_t hash) {
+	GramCache c;
+	if (!gram_cache_open(&c, path, hash)) {
+		return false;
+	}
+	const int32_t *counts = gram_cache_get_sized(&c, CACHE_COUNTS, sizeof(int32_t) * 2);
+	bool ok = counts != NULL && counts[0] > 0 && counts[1] >= 0 && gram_cache_get_grammar(&c, &gram) &&
+			  gram_index(&gram);
+	int nstates = ok ? counts[0] : 0;
+	int nsyms = ok ? counts[1] : 0;
+	const Sym *syms = ok ? gram_cache_get_sized(&c, CACHE_SYMBOLS, sizeof(Sym) * (size_t)nsyms) : NULL;
+	const int *item_off = ok ? gram_cache_get_sized(&c, CACHE_ITEM_OFF, sizeof(int) * (size_t)(nstates + 1)) : NULL;
+	const int *goto_off = ok ? gram_cache_get_sized(&c, CACHE_GOTO_OFF, sizeof(int) * (size_t)(nstates + 1)) : NULL;
+	size_t items_size;
+	size_t gotos_size;
+	const Item *cached_items = ok ? gram_cache_get(&c, CACHE_ITEMS, &items_size) : NULL;
+	const Goto *cached_gotos = ok ? gram_cache_get(&c, CACHE_GOTOS, &gotos_size) : NULL;
+	ok = ok && syms && item_off && goto_off && cached_items && cached_gotos && item_off[0] == 0 &&
+		 goto_off[0] == 0 && item_off[nstates] >= 0 && goto_off[nstates] >= 0 &&
+		 (size_t)item_off[nstates] * sizeof(Item) <= items_size && (size_t)goto_off[nstates] * sizeof(Goto) <= gotos_size;
+	for (int i = 0; ok && i < nstates; i++) {
+		ok = item_off[i + 1] >= item_off[i] && goto_off[i + 1] >= goto_off[i];
+	}
+	for (int i = 0; ok && i < item_off[nstates]; i++) {
+		Item it = cached_items[i];
+		ok = it.prod >= 0 && it.prod < gram.prod_count && it.dot >= 0 && it.dot <= gram_rhs_len(&gram, it.prod);
+	}
+	for (int i = 0; ok && i < nstates; i++) {
+		/* print_goto_table relies on each state's entries being in column order. */
+		for (int k = goto_off[i]; ok && k < goto_off[i + 1]; k++) {
+			const Goto *g = &cached_gotos[k];
+			ok = g->col >= 0 && g->col < nsyms && g->to >= 0 && g->to < nstates &&
+				 (k == goto_off[i] || g->col > cached_gotos[k - 1].col);
+		}
+	}
+	if (ok) {
+		State *st = gram_grow(states, &state_cap, nstates, sizeof(State));
+		states = st ? st : states;
+		Item *it = gram_grow(items, &item_cap, item_off[nstates], sizeof(Item));
+		items = it ? it : items;
+		Goto *gt = gram_grow(gotos, &goto_cap, goto_off[nstates], sizeof(Goto));
+		gotos = gt ? gt : gotos;
+		Sym *sy = gram_grow(symbols, &sym_cap, nsyms, sizeof(Sym));
+		symbols = sy ? sy : symbols;
+		ok = st && it && gt && sy;
+	}
+	if (ok) {
+		for (int i = 0; i < nstates; i++) {
+			states[i].first = item_off[i];
+			states[i].count = item_off[i + 1] - item_off[i];
+			states[i].goto_first = goto_off[i];
+			states[i].goto_count = goto_off[i + 1] - goto_off[i];
+		}
+		memcpy(items, cached_items, sizeof(Item) * (size_t)item_off[nstates]);
+		memcpy(gotos, cached_gotos, sizeof(Goto) * (size_t)goto_off[nstates]);
+		memcpy(symbols, syms, sizeof(Sym) * (size_t)nsyms);
+		item_count = item_off[nstates];
+		goto_count = goto_off[nstates];
+		sym_count = nsyms;
+		state_count = nstates;
+	}
+	gram_cache_close(&c);
+	if (!ok) {
+		gram_free(&gram);
+		state_count = 0;
+	}
+	return ok;
+}
+
 static char pick_augmented_start(void) {
 	for (char c = 'Z'; c >= 'A'; c--) {
-		bool used = false;
-		for (int i = 0; i < prod_count; i++) {
-			if (prods[i].lhs == c) {
-				used = true;
-				break;
-			}
-		}
-		if (!used) {
+		char name[2] = { c, '\0' };
+		if (gram_find_nt(&input, name) < 0) {
 			return c;
 		}
 	}
 	return 'Z';
 }
 
-int main(void) {
-	int n = 0;
-	char line[256];
+/* One line of stdin, newline included, however long; false at end of input. */
+static bool read_line(char **buf, int *cap) {
+	int len = 0;
+	for (;;) {
+		char *grown = gram_grow(*buf, cap, len + 256, 1);
+		if (!grown) {
+			return false;
+		}
+		*buf = grown;
+		if (!fgets(*buf + len, *cap - len, stdin)) {
+			return len > 0;
+		}
+		len += (int)strlen(*buf + len);
+		if ((*buf)[len - 1] == '\n') {
+			return true;
+		}
+	}
+}
 
-	printf("Enter number of productions: ");
-	if (scanf("%d", &n) != 1 || n <= 0) {
-		return 1;
+int main(int argc, char **argv) {
+	int n = 0;
+	char *line = NULL;
+	int line_cap = 0;
+	const char *cache_path = NULL;
+	const char *grammar_path = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+			cache_path = argv[++i];
+		} else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+			grammar_path = argv[++i];
+		}
 	}
-	fgets(line, sizeof(line), stdin);
 
-	for (int i = 0; i < n; i++) {
+	/*
+	 * Keep the raw grammar text (the mapped file, or the lines typed in):
+	 * the cache is keyed by its hash and a hit skips parsing it.
+	 */
+	GramFile file;
+	char *text = NULL;
+	int text_len = 0;
+	int text_cap = 0;
+	uint64_t hash = gram_hash_str(GRAM_HASH_INIT, grammar_path != NULL ? "task9 -f" : "task9");
+	memset(&file, 0, sizeof(file));
+	if (grammar_path != NULL) {
+		if (!gram_file_map(&file, grammar_path)) {
+			fprintf(stderr, "%s: cannot read file\n", grammar_path);
+			return 1;
+		}
+		hash = gram_hash(hash, file.data, file.size);
+	} else {
+		printf("Enter number of productions: ");
+		if (scanf("%d", &n) != 1 || n <= 0) {
+			return 1;
+		}
+		read_line(&line, &line_cap);
+	}
+	for (int i = 0; grammar_path == NULL && i < n; i++) {
 		printf("Enter production %d (e.g., S->CC|c): ", i + 1);
-		if (!fgets(line, sizeof(line), stdin)) {
+		if (!read_line(&line, &line_cap)) {
 			return 1;
 		}
-		parse_line(line);
+		int len = (int)strlen(line) + 1;
+		text = gram_grow(text, &text_cap, text_len + len, 1);
+		if (text == NULL) {
+			return 1;
+		}
+		memcpy(text + text_len, line, (size_t)len);
+		text_len += len;
+		hash = gram_hash(hash, line, (size_t)len);
 	}
 
-	if (prod_count == 0) {
-		return 1;
-	}
+	clock_t t0 = clock();
+	bool cached = cache_path != NULL && load_cache(cache_path, hash);
+	if (!cached) {
+		gram_init(&input, GRAM_TOK_CHAR);
+		GramError err;
+		if (grammar_path != NULL && !gram_load_buffer(&input, file.data, file.size, &err)) {
+			gram_print_error(grammar_path, &err);
+			return 1;
+		}
+		for (int i = 0; i < text_len; i += (int)strlen(text + i) + 1) {
+			gram_parse_line(&input, text + i);
+		}
+		if (input.prod_count == 0) {
+			return 1;
+		}
 
-	char start_lhs = prods[0].lhs;
-	char aug = pick_augmented_start();
+		/* The augmented production Z -> S must be production 0. */
+		char aug_name[2] = { pick_augmented_start(), '\0' };
+		gram_copy_symbols(&gram, &input);
+		Sym aug = gram_nt(&gram, aug_name);
+		gram_add_prod(&gram, aug, &input.prod_lhs[0], 1);
+		for (int p = 0; p < input.prod_count; p++) {
+			gram_add_prod(&gram, input.prod_lhs[p], gram_rhs(&input, p), gram_rhs_len(&input, p));
+		}
+		gram_index(&gram);
 
-	for (int i = prod_count; i > 0; i--) {
-		prods[i] = prods[i - 1];
+		if (!collect_symbols() || !build_canonical_collection()) {
+			printf("Out of memory\n");
+			return 1;
+		}
+		if (cache_path != NULL && !save_cache(cache_path, hash)) {
+			fprintf(stderr, "Could not write cache %s\n", cache_path);
+		}
+	}
+	gram_file_unmap(&file);
+	free(text);
+	free(line);
+	if (cache_path != NULL) {
+		fprintf(stderr, "Startup (%s): %.3f ms\n", cached ? "warm, cache hit" : "cold, cache written",
+				(double)(clock() - t0) * 1000.0 / CLOCKS_PER_SEC);
 	}
-	prod_count++;
-	prods[0].lhs = aug;
-	prods[0].rhs[0] = start_lhs;
-	prods[0].rhs[1] = '\0';
-
-	collect_symbols();
-	build_canonical_collection();
 
 	printf("\nLR(0) Items (Canonical Collection)\n\n");
 	print_states();